@@ -0,0 +1,102 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <gsl/gsl-lite.hpp>
+#include <platform/compress.h>
+#include <platform/compression/batch.h>
+#include <platform/sysinfo.h>
+
+#include <algorithm>
+#include <atomic>
+#include <latch>
+#include <stdexcept>
+#include <vector>
+
+namespace cb::compression {
+
+BatchCompressor::BatchCompressor(size_t threads_)
+    : threads(threads_ ? threads_ : cb::get_available_cpu_count()),
+      executor(std::make_unique<folly::CPUThreadPoolExecutor>(
+              threads,
+              std::make_shared<folly::NamedThreadFactory>("cb:compress"))) {
+}
+
+BatchCompressor::~BatchCompressor() {
+    executor->join();
+}
+
+bool BatchCompressor::deflate(folly::io::CodecType type,
+                              std::span<const std::string_view> inputs,
+                              std::span<std::string_view> outputs,
+                              Buffer& arena) {
+    if (inputs.size() != outputs.size()) {
+        throw std::invalid_argument(
+                "BatchCompressor::deflate(): inputs and outputs must be the "
+                "same size");
+    }
+    if (inputs.empty()) {
+        return true;
+    }
+
+    // Reserve the worst case size for all of the values in the arena.
+    // offsets[ii] is the start of the area reserved for inputs[ii]
+    std::vector<size_t> offsets;
+    offsets.reserve(inputs.size() + 1);
+    offsets.push_back(0);
+    for (const auto& input : inputs) {
+        offsets.push_back(offsets.back() +
+                          getMaxCompressedLength(type, input.size()));
+    }
+    arena.resize(offsets.back());
+
+    // Split the batch into a few ranges per thread so that a range
+    // containing big values doesn't leave the other threads idle at the end
+    const auto ntasks = std::min(inputs.size(), threads * 4);
+    const auto range = (inputs.size() + ntasks - 1) / ntasks;
+    std::atomic_bool success{true};
+    std::latch done(gsl::narrow<std::ptrdiff_t>(ntasks));
+    for (size_t task = 0; task < ntasks; ++task) {
+        const auto begin = std::min(task * range, inputs.size());
+        const auto end = std::min(begin + range, inputs.size());
+        executor->add([type,
+                       begin,
+                       end,
+                       &inputs,
+                       &outputs,
+                       &offsets,
+                       &arena,
+                       &success,
+                       &done]() {
+            // The values in the range are packed back to back within the
+            // area reserved for the range.
+            static thread_local Buffer scratch;
+            auto* dest = arena.data() + offsets[begin];
+            try {
+                for (auto ii = begin; ii < end; ++ii) {
+                    if (!cb::compression::deflate(type, inputs[ii], scratch)) {
+                        success = false;
+                        break;
+                    }
+                    std::copy_n(scratch.data(), scratch.size(), dest);
+                    outputs[ii] = {dest, scratch.size()};
+                    dest += scratch.size();
+                }
+            } catch (const std::exception&) {
+                success = false;
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    return success;
+}
+
+} // namespace cb::compression
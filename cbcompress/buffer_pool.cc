@@ -0,0 +1,246 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <platform/cb_arena_malloc.h>
+#include <platform/cb_malloc.h>
+#include <platform/compression/buffer_pool.h>
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace cb::compression {
+
+/// The number of free list sets of a client, one per domain and one for
+/// MemoryDomain::None (used when no client is current)
+static constexpr size_t NumDomains = size_t(MemoryDomain::Count) + 1;
+
+struct BufferPool::ClientBlocks {
+    ClientBlocks(uint8_t index,
+                 uint32_t generation,
+                 const cb::ArenaMalloc::ClientHandle& handle)
+        : index(index), generation(generation), handle(handle) {
+    }
+
+    /// Was the client unregistered since the blocks were pooled?
+    bool isStale() const {
+        return generation != cb::ArenaMalloc::getClientGeneration(index);
+    }
+
+    const uint8_t index;
+    /// The ArenaMalloc::getClientGeneration of the index when the blocks
+    /// were first pooled
+    const uint32_t generation;
+    /// The client when the blocks were first pooled, used to free them if
+    /// the pool is cleared (or destroyed) before the client is purged
+    cb::ArenaMalloc::ClientHandle handle;
+    std::array<std::array<std::vector<char*>, NumSizeClasses>, NumDomains>
+            free_lists;
+};
+
+/// All of the pools, so that purge() can reach the pools of every thread
+struct PoolRegistry {
+    std::mutex mutex;
+    std::vector<BufferPool*> pools;
+};
+
+static PoolRegistry& getPoolRegistry() {
+    // Never destroyed, as thread local pools may be destroyed after static
+    // destruction started
+    static auto* registry = [] {
+        NoArenaGuard guard;
+        return new PoolRegistry;
+    }();
+    return *registry;
+}
+
+BufferPool::BufferPool(size_t max_pooled_bytes)
+    : max_pooled_bytes(max_pooled_bytes) {
+    NoArenaGuard guard;
+    auto& registry = getPoolRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.pools.push_back(this);
+}
+
+BufferPool::~BufferPool() {
+    {
+        NoArenaGuard guard;
+        auto& registry = getPoolRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.pools.erase(
+                std::find(registry.pools.begin(), registry.pools.end(), this));
+    }
+    clear();
+    NoArenaGuard guard;
+    std::vector<std::unique_ptr<ClientBlocks>>().swap(clients);
+}
+
+BufferPool& BufferPool::getThreadLocal() {
+    static thread_local BufferPool pool;
+    return pool;
+}
+
+size_t BufferPool::getAllocationSize(size_t nbytes) {
+    if (nbytes > MaxSizeClass) {
+        return nbytes;
+    }
+    return std::max(MinSizeClass, std::bit_ceil(nbytes));
+}
+
+size_t BufferPool::getSizeClassIndex(size_t size) {
+    static_assert(MaxSizeClass == MinSizeClass << (NumSizeClasses - 1));
+    // Round down; the usable size of a block may exceed the size class
+    return std::bit_width(size / MinSizeClass) - 1;
+}
+
+std::vector<char*>& BufferPool::getFreeList(size_t size_class) {
+    const auto index = cb::ArenaMalloc::getCurrentClientIndex();
+    const auto current = cb::ArenaMalloc::getCurrentClient();
+    auto it = std::find_if(clients.begin(), clients.end(), [index](auto& c) {
+        return c->index == index;
+    });
+    if (it != clients.end() && (*it)->isStale()) {
+        // Blocks of a client which was unregistered without purge(), they
+        // must not be handed to the new client using the index
+        freeBlocks(index, nullptr);
+        it = clients.end();
+    }
+    if (it == clients.end()) {
+        NoArenaGuard guard;
+        it = clients.insert(
+                clients.end(),
+                std::make_unique<ClientBlocks>(
+                        index,
+                        cb::ArenaMalloc::getClientGeneration(index),
+                        current));
+    }
+    const auto domain = std::min(size_t(current.domain), NumDomains - 1);
+    return (*it)->free_lists[domain][size_class];
+}
+
+char* BufferPool::allocate(size_t nbytes) {
+    const auto size = getAllocationSize(nbytes);
+    if (size <= MaxSizeClass) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& list = getFreeList(getSizeClassIndex(size));
+        if (!list.empty()) {
+            auto* ret = list.back();
+            list.pop_back();
+            pooled_bytes -= size;
+            ++hits;
+            return ret;
+        }
+    }
+
+    ++misses;
+    auto* ret = static_cast<char*>(cb_malloc(size));
+    if (ret == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ret;
+}
+
+void BufferPool::deallocate(char* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    const auto usable = cb_malloc_usable_size(ptr);
+    if (usable >= MinSizeClass && usable < MaxSizeClass * 2) {
+        const auto index = getSizeClassIndex(usable);
+        const auto size = MinSizeClass << index;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pooled_bytes + size <= max_pooled_bytes) {
+            try {
+                auto& list = getFreeList(index);
+                if (list.size() == list.capacity()) {
+                    NoArenaGuard guard;
+                    list.reserve(std::max(size_t(4), list.size() * 2));
+                }
+                list.push_back(ptr);
+                pooled_bytes += size;
+                return;
+            } catch (const std::bad_alloc&) {
+                // Fall through and free the block
+            }
+        }
+    }
+    cb_free(ptr);
+}
+
+void BufferPool::freeBlocks(uint8_t index, const ArenaMallocClient* client) {
+    auto it = std::find_if(clients.begin(), clients.end(), [index](auto& c) {
+        return c->index == index;
+    });
+    if (it == clients.end()) {
+        return;
+    }
+
+    auto& blocks = **it;
+    const bool stale = blocks.isStale();
+    for (size_t domain = 0; domain < NumDomains; ++domain) {
+        auto& lists = blocks.free_lists[domain];
+        if (std::all_of(lists.begin(), lists.end(), [](const auto& list) {
+                return list.empty();
+            })) {
+            continue;
+        }
+
+        // The blocks must be freed while the owning client and domain are
+        // current. If the client was unregistered they are freed without a
+        // client, as its index may now belong to another client.
+        cb::ArenaMalloc::ClientHandle previous;
+        if (stale) {
+            previous = cb::ArenaMalloc::switchFromClient();
+        } else if (client) {
+            previous = cb::ArenaMalloc::switchToClient(*client);
+        } else {
+            previous = cb::ArenaMalloc::switchToClient(blocks.handle);
+        }
+        if (!stale && domain < size_t(MemoryDomain::Count)) {
+            cb::ArenaMalloc::setDomain(MemoryDomain(domain));
+        }
+        for (size_t ii = 0; ii < NumSizeClasses; ++ii) {
+            for (auto* ptr : lists[ii]) {
+                cb_free(ptr);
+                pooled_bytes -= MinSizeClass << ii;
+            }
+        }
+        cb::ArenaMalloc::switchToClient(previous);
+    }
+
+    NoArenaGuard guard;
+    clients.erase(it);
+}
+
+void BufferPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!clients.empty()) {
+        freeBlocks(clients.front()->index, nullptr);
+    }
+    pooled_bytes = 0;
+}
+
+void BufferPool::purge(const ArenaMallocClient& client) {
+    auto& registry = getPoolRegistry();
+    std::lock_guard<std::mutex> registryLock(registry.mutex);
+    for (auto* pool : registry.pools) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->freeBlocks(client.index, &client);
+    }
+}
+
+void BufferPool::setMaxPooledBytes(size_t limit) {
+    max_pooled_bytes = limit;
+    if (pooled_bytes > max_pooled_bytes) {
+        clear();
+    }
+}
+
+} // namespace cb::compression
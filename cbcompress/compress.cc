@@ -7,112 +7,23 @@
  *   software will be governed by the Apache License, Version 2.0, included in
  *   the file licenses/APL2.txt.
  */
+#include <folly/Varint.h>
 #include <folly/compression/Compression.h>
 #include <folly/io/IOBuf.h>
 #include <gsl/gsl-lite.hpp>
+#include <lz4.h>
 #include <platform/compress.h>
+#include <platform/compression/context.h>
 #include <snappy.h>
 #include <zlib.h>
+#include <zstd.h>
 
+#include <array>
+#include <cmath>
+#include <optional>
 #include <stdexcept>
 
 namespace cb::compression {
-static std::unique_ptr<folly::IOBuf> deflateZlib(std::string_view input) {
-    auto ret = folly::IOBuf::createCombined(
-            compressBound(static_cast<uLong>(input.size())));
-    uLong destlen = static_cast<uLong>(input.size()) + 128;
-    const auto rv = compress(ret->writableTail(),
-                             &destlen,
-                             reinterpret_cast<const uint8_t*>(input.data()),
-                             static_cast<uLong>(input.size()));
-    if (rv != Z_OK) {
-        throw std::runtime_error(fmt::format(
-                "deflateZlib(): compress() failed with error code: {}", rv));
-    }
-    ret->append(destlen);
-
-    return ret;
-}
-
-static std::unique_ptr<folly::IOBuf> inflateZlib(
-        std::string_view input, std::size_t max_inflated_size) {
-    static constexpr size_t chunk_size = 256 * 1024;
-    std::unique_ptr<folly::IOBuf> ret = folly::IOBuf::create(chunk_size);
-
-    Expects(!input.empty());
-
-    z_stream stream;
-    std::memset(&stream, 0, sizeof(stream));
-
-    auto status = inflateInit(&stream);
-    if (status != Z_OK) {
-        throw std::runtime_error(fmt::format(
-                "inflateZlib(): inflateInit() failed with error code: {}",
-                status));
-    }
-
-    stream.avail_in = gsl::narrow_cast<uInt>(input.size());
-    stream.next_in = const_cast<uint8_t*>(
-            reinterpret_cast<const uint8_t*>(input.data()));
-
-    do {
-        if (stream.total_out > max_inflated_size) {
-            throw std::range_error(
-                    fmt::format("inflate(): Inflated length {} "
-                                " exceeds max: {}",
-                                stream.total_out,
-                                max_inflated_size));
-        }
-        auto iobuf = folly::IOBuf::create(chunk_size);
-        stream.avail_out = gsl::narrow_cast<uInt>(iobuf->tailroom());
-        stream.next_out = iobuf->writableTail();
-        status = inflate(&stream, Z_NO_FLUSH);
-        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
-            (void)inflateEnd(&stream);
-            throw std::runtime_error(fmt::format(
-                    "inflateZlib(): inflate() failed with error code: {}",
-                    status));
-        }
-        iobuf->append(ret->tailroom() - stream.avail_out);
-        if (!ret) {
-            ret = std::move(iobuf);
-        } else {
-            ret->insertAfterThisOne(std::move(iobuf));
-        }
-    } while (status != Z_STREAM_END);
-    (void)inflateEnd(&stream);
-    return ret;
-}
-
-static bool inflateZlib(std::string_view input,
-                        Buffer& output,
-                        std::size_t max_inflated_size) {
-    try {
-        auto inflated = inflateZlib(input, max_inflated_size);
-        output.resize(inflated->length());
-        std::copy(inflated->data(),
-                  inflated->data() + inflated->length(),
-                  output.data());
-        return true;
-    } catch (const std::exception&) {
-        return false;
-    }
-}
-
-static bool deflateZlib(std::string_view input, Buffer& output) {
-    output.resize(compressBound(static_cast<uLong>(input.size())));
-    uLong destlen = static_cast<uLong>(input.size()) + 128;
-    if (compress(reinterpret_cast<uint8_t*>(output.data()),
-                 &destlen,
-                 reinterpret_cast<const uint8_t*>(input.data()),
-                 static_cast<uLong>(input.size())) != Z_OK) {
-        return false;
-    }
-    output.resize(destlen);
-
-    return true;
-}
-
 bool inflate(folly::io::CodecType type,
              std::string_view input,
              Buffer& output,
@@ -121,10 +32,18 @@ bool inflate(folly::io::CodecType type,
         return inflateSnappy(input, output, max_inflated_size);
     }
     if (type == folly::io::CodecType::ZLIB) {
-        return inflateZlib(input, output, max_inflated_size);
+        return Context::getThreadLocal().inflateZlib(
+                input, output, max_inflated_size);
+    }
+    if (type == folly::io::CodecType::ZSTD) {
+        return inflateZstd(input, output, max_inflated_size);
+    }
+    if (type == folly::io::CodecType::LZ4) {
+        return inflateLZ4(input, output, max_inflated_size);
     }
     throw std::invalid_argument(
-            "cb::compression::inflate(): type must be SNAPPY or ZLIB");
+            "cb::compression::inflate(): type must be SNAPPY, ZLIB, ZSTD or "
+            "LZ4");
 }
 
 std::unique_ptr<folly::IOBuf> inflate(folly::io::CodecType type,
@@ -134,10 +53,18 @@ std::unique_ptr<folly::IOBuf> inflate(folly::io::CodecType type,
         return inflateSnappy(input, max_inflated_size);
     }
     if (type == folly::io::CodecType::ZLIB) {
-        return inflateZlib(input, max_inflated_size);
+        return Context::getThreadLocal().inflateZlib(input,
+                                                     max_inflated_size);
+    }
+    if (type == folly::io::CodecType::ZSTD) {
+        return inflateZstd(input, max_inflated_size);
+    }
+    if (type == folly::io::CodecType::LZ4) {
+        return inflateLZ4(input, max_inflated_size);
     }
     throw std::invalid_argument(
-            "cb::compression::inflate(): type must be SNAPPY or ZLIB");
+            "cb::compression::inflate(): type must be SNAPPY, ZLIB, ZSTD or "
+            "LZ4");
 }
 
 bool deflate(folly::io::CodecType type,
@@ -147,10 +74,17 @@ bool deflate(folly::io::CodecType type,
         return deflateSnappy(input_buffer, output);
     }
     if (type == folly::io::CodecType::ZLIB) {
-        return deflateZlib(input_buffer, output);
+        return Context::getThreadLocal().deflateZlib(input_buffer, output);
+    }
+    if (type == folly::io::CodecType::ZSTD) {
+        return deflateZstd(input_buffer, output);
+    }
+    if (type == folly::io::CodecType::LZ4) {
+        return deflateLZ4(input_buffer, output);
     }
     throw std::invalid_argument(
-            "cb::compression::deflate(): type must be SNAPPY or ZLIB");
+            "cb::compression::deflate(): type must be SNAPPY, ZLIB, ZSTD or "
+            "LZ4");
 }
 
 std::unique_ptr<folly::IOBuf> deflate(folly::io::CodecType type,
@@ -159,10 +93,17 @@ std::unique_ptr<folly::IOBuf> deflate(folly::io::CodecType type,
         return deflateSnappy(input);
     }
     if (type == folly::io::CodecType::ZLIB) {
-        return deflateZlib(input);
+        return Context::getThreadLocal().deflateZlib(input);
+    }
+    if (type == folly::io::CodecType::ZSTD) {
+        return deflateZstd(input);
+    }
+    if (type == folly::io::CodecType::LZ4) {
+        return deflateLZ4(input);
     }
     throw std::invalid_argument(
-            "cb::compression::deflate(): type must be SNAPPY or ZLIB");
+            "cb::compression::deflate(): type must be SNAPPY, ZLIB, ZSTD or "
+            "LZ4");
 }
 
 size_t get_uncompressed_length(folly::io::CodecType type,
@@ -170,8 +111,15 @@ size_t get_uncompressed_length(folly::io::CodecType type,
     if (type == folly::io::CodecType::SNAPPY) {
         return getUncompressedLengthSnappy(input);
     }
+    if (type == folly::io::CodecType::ZSTD) {
+        return getUncompressedLengthZstd(input);
+    }
+    if (type == folly::io::CodecType::LZ4) {
+        return getUncompressedLengthLZ4(input);
+    }
     throw std::invalid_argument(
-            "cb::compression::get_uncompressed_length(): type must be SNAPPY");
+            "cb::compression::get_uncompressed_length(): type must be SNAPPY, "
+            "ZSTD or LZ4");
 }
 
 bool inflateSnappy(std::string_view input,
@@ -251,4 +199,250 @@ size_t getUncompressedLengthSnappy(std::string_view input) {
             input.data(), input.size(), &uncompressed_length);
     return uncompressed_length;
 }
+
+bool inflateZstd(std::string_view input,
+                 Buffer& output,
+                 size_t max_inflated_size) {
+    return Context::getThreadLocal().inflateZstd(
+            input, output, max_inflated_size);
+}
+
+std::unique_ptr<folly::IOBuf> inflateZstd(std::string_view input,
+                                          size_t max_inflated_size) {
+    return Context::getThreadLocal().inflateZstd(input, max_inflated_size);
+}
+
+bool deflateZstd(std::string_view input, Buffer& output, int level) {
+    return Context::getThreadLocal().deflateZstd(input, output, level);
+}
+
+std::unique_ptr<folly::IOBuf> deflateZstd(std::string_view input, int level) {
+    return Context::getThreadLocal().deflateZstd(input, level);
+}
+
+bool deflateZstd(std::string_view input,
+                 Buffer& output,
+                 const ZstdDictionary& dictionary) {
+    return Context::getThreadLocal().deflateZstd(input, output, dictionary);
+}
+
+bool inflateZstd(std::string_view input,
+                 Buffer& output,
+                 size_t max_inflated_size,
+                 const ZstdDictionary& dictionary) {
+    return Context::getThreadLocal().inflateZstd(
+            input, output, max_inflated_size, dictionary);
+}
+
+size_t getUncompressedLengthZstd(std::string_view input) {
+    const auto length = ZSTD_getFrameContentSize(input.data(), input.size());
+    if (length == ZSTD_CONTENTSIZE_UNKNOWN ||
+        length == ZSTD_CONTENTSIZE_ERROR) {
+        return 0;
+    }
+    return length;
+}
+
+/**
+ * Split the LZ4 encoded data into the uncompressed length and the raw
+ * LZ4 block.
+ *
+ * @return The uncompressed length and the raw block, or std::nullopt if the
+ *         input isn't a valid length prefixed LZ4 block
+ */
+static std::optional<std::pair<size_t, std::string_view>> decodeLZ4Header(
+        std::string_view input) {
+    folly::ByteRange range{reinterpret_cast<const uint8_t*>(input.data()),
+                           input.size()};
+    const auto length = folly::tryDecodeVarint(range);
+    if (!length.hasValue() || *length > LZ4_MAX_INPUT_SIZE ||
+        range.size() > LZ4_MAX_INPUT_SIZE) {
+        return {};
+    }
+    return {{gsl::narrow_cast<size_t>(*length),
+             {reinterpret_cast<const char*>(range.data()), range.size()}}};
+}
+
+bool inflateLZ4(std::string_view input,
+                Buffer& output,
+                size_t max_inflated_size) {
+    const auto header = decodeLZ4Header(input);
+    if (!header || header->first > max_inflated_size) {
+        return false;
+    }
+
+    const auto [inflated_length, block] = *header;
+    output.resize(inflated_length);
+    const auto rv =
+            LZ4_decompress_safe(block.data(),
+                                output.data(),
+                                gsl::narrow_cast<int>(block.size()),
+                                gsl::narrow_cast<int>(inflated_length));
+    return rv >= 0 && size_t(rv) == inflated_length;
+}
+
+std::unique_ptr<folly::IOBuf> inflateLZ4(std::string_view input,
+                                         size_t max_inflated_size) {
+    const auto header = decodeLZ4Header(input);
+    if (!header) {
+        throw std::runtime_error(
+                "cb::compression::inflateLZ4(): Failed to get uncompressed "
+                "length");
+    }
+
+    const auto [inflated_length, block] = *header;
+    if (inflated_length > max_inflated_size) {
+        throw std::range_error(
+                fmt::format("cb::compression::inflate(): Inflated length {} "
+                            "would exceed max: {}",
+                            inflated_length,
+                            max_inflated_size));
+    }
+
+    auto ret = folly::IOBuf::createCombined(inflated_length);
+    const auto rv = LZ4_decompress_safe(
+            block.data(),
+            reinterpret_cast<char*>(ret->writableData()),
+            gsl::narrow_cast<int>(block.size()),
+            gsl::narrow_cast<int>(inflated_length));
+    if (rv < 0 || size_t(rv) != inflated_length) {
+        throw std::runtime_error(
+                "cb::compression::inflateLZ4(): Failed to inflate data");
+    }
+    ret->append(inflated_length);
+    return ret;
+}
+
+/// Get the maximum size of the length prefixed LZ4 block for the input
+static size_t maxCompressedLengthLZ4(size_t size) {
+    if (size > LZ4_MAX_INPUT_SIZE) {
+        throw std::invalid_argument(fmt::format(
+                "cb::compression::deflateLZ4(): Input length {} exceeds "
+                "max: {}",
+                size,
+                LZ4_MAX_INPUT_SIZE));
+    }
+    return folly::kMaxVarintLength64 +
+           LZ4_compressBound(gsl::narrow_cast<int>(size));
+}
+
+/**
+ * Encode the input as a length prefixed LZ4 block into the provided
+ * destination (which must be at least maxCompressedLengthLZ4() bytes)
+ *
+ * @return the number of bytes written to the destination, or 0 on failure
+ */
+static size_t doDeflateLZ4(std::string_view input, char* destination) {
+    const auto header_size = folly::encodeVarint(
+            input.size(), reinterpret_cast<uint8_t*>(destination));
+    const auto rv = LZ4_compress_default(
+            input.data(),
+            destination + header_size,
+            gsl::narrow_cast<int>(input.size()),
+            LZ4_compressBound(gsl::narrow_cast<int>(input.size())));
+    if (rv <= 0) {
+        return 0;
+    }
+    return header_size + size_t(rv);
+}
+
+bool deflateLZ4(std::string_view input, Buffer& output) {
+    if (input.size() > LZ4_MAX_INPUT_SIZE) {
+        return false;
+    }
+    output.resize(maxCompressedLengthLZ4(input.size()));
+    const auto nbytes = doDeflateLZ4(input, output.data());
+    if (nbytes == 0) {
+        return false;
+    }
+    output.resize(nbytes);
+    return true;
+}
+
+std::unique_ptr<folly::IOBuf> deflateLZ4(std::string_view input) {
+    auto ret = folly::IOBuf::createCombined(
+            maxCompressedLengthLZ4(input.size()));
+    const auto nbytes =
+            doDeflateLZ4(input, reinterpret_cast<char*>(ret->writableData()));
+    if (nbytes == 0) {
+        throw std::runtime_error(
+                "cb::compression::deflateLZ4(): Failed to deflate data");
+    }
+    ret->append(nbytes);
+    return ret;
+}
+
+size_t getUncompressedLengthLZ4(std::string_view input) {
+    const auto header = decodeLZ4Header(input);
+    if (!header) {
+        return 0;
+    }
+    return header->first;
+}
+
+size_t getMaxCompressedLength(folly::io::CodecType type, size_t size) {
+    switch (type) {
+    case folly::io::CodecType::SNAPPY:
+        return snappy::MaxCompressedLength(size);
+    case folly::io::CodecType::ZLIB:
+        return compressBound(gsl::narrow<uLong>(size));
+    case folly::io::CodecType::ZSTD:
+        return ZSTD_compressBound(size);
+    case folly::io::CodecType::LZ4:
+        return maxCompressedLengthLZ4(size);
+    default:
+        break;
+    }
+    throw std::invalid_argument(
+            "cb::compression::getMaxCompressedLength(): type must be SNAPPY, "
+            "ZLIB, ZSTD or LZ4");
+}
+
+double estimateCompressibility(std::string_view input) {
+    // Sample up to WindowCount windows of WindowSize bytes spread evenly
+    // across the input
+    static constexpr size_t WindowSize = 512;
+    static constexpr size_t WindowCount = 8;
+
+    if (input.empty()) {
+        return 0;
+    }
+
+    std::array<uint32_t, 256> histogram{};
+    size_t sampled = 0;
+    const auto count = [&histogram, &sampled](std::string_view window) {
+        for (const auto c : window) {
+            ++histogram[static_cast<uint8_t>(c)];
+        }
+        sampled += window.size();
+    };
+
+    if (input.size() <= WindowSize * WindowCount) {
+        count(input);
+    } else {
+        const auto stride = (input.size() - WindowSize) / (WindowCount - 1);
+        for (size_t ii = 0; ii < WindowCount; ++ii) {
+            count(input.substr(ii * stride, WindowSize));
+        }
+    }
+
+    double entropy = 0;
+    for (const auto frequency : histogram) {
+        if (frequency) {
+            const auto p = double(frequency) / double(sampled);
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy / 8;
+}
+
+bool deflateIfCompressible(folly::io::CodecType type,
+                           std::string_view input,
+                           Buffer& output,
+                           double threshold) {
+    if (estimateCompressibility(input) >= threshold) {
+        return false;
+    }
+    return deflate(type, input, output) && output.size() < input.size();
+}
 } // namespace cb::compression
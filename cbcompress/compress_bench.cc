@@ -7,16 +7,29 @@
  *   software will be governed by the Apache License, Version 2.0, included in
  *   the file licenses/APL2.txt.
  */
+#include <JSON_checker.h>
 #include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <platform/byte_literals.h>
+#include <platform/cb_malloc.h>
+#include <platform/compress.h>
+#include <platform/compression/batch.h>
+#include <platform/compression/context.h>
+#include <platform/compression/dictionary.h>
+#include <platform/compression/validate.h>
 
 #include <snappy.h>
 #include <array>
+#include <atomic>
 #include <memory>
+#include <random>
+#include <string>
+#include <vector>
 
-// We don't use the cbcompress API here, as it include memory allocation
-// in each operation..
+// SnappyCompress doesn't use the cbcompress API, as it measures the raw
+// compression without any of the wrapping.
 #define START 256
-#define END 40960
+#define END 65536
 #define FACTOR 2
 
 std::array<char, END> blob;
@@ -38,12 +51,729 @@ static void SnappyCompress(benchmark::State& state) {
 
 BENCHMARK(SnappyCompress)->RangeMultiplier(FACTOR)->Range(START, END);
 
+// Measure the per call cost of setting up the codec state by comparing a
+// fresh Context for each operation (which is what the zlib code used to
+// do) with reusing the same Context for all of the operations.
+static void ZlibDeflateFreshContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer output;
+    while (state.KeepRunning()) {
+        cb::compression::Context context;
+        if (!context.deflateZlib(input, output)) {
+            state.SkipWithError("Failed to deflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void ZlibDeflateReusedContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer output;
+    cb::compression::Context context;
+    while (state.KeepRunning()) {
+        if (!context.deflateZlib(input, output)) {
+            state.SkipWithError("Failed to deflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void ZlibInflateFreshContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(
+                folly::io::CodecType::ZLIB, input, deflated)) {
+        state.SkipWithError("Failed to deflate data");
+        return;
+    }
+    cb::compression::Buffer output;
+    while (state.KeepRunning()) {
+        cb::compression::Context context;
+        if (!context.inflateZlib(deflated, output, END)) {
+            state.SkipWithError("Failed to inflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void ZlibInflateReusedContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(
+                folly::io::CodecType::ZLIB, input, deflated)) {
+        state.SkipWithError("Failed to deflate data");
+        return;
+    }
+    cb::compression::Buffer output;
+    cb::compression::Context context;
+    while (state.KeepRunning()) {
+        if (!context.inflateZlib(deflated, output, END)) {
+            state.SkipWithError("Failed to inflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void ZstdDeflateFreshContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer output;
+    while (state.KeepRunning()) {
+        cb::compression::Context context;
+        if (!context.deflateZstd(
+                    input,
+                    output,
+                    cb::compression::DefaultZstdCompressionLevel)) {
+            state.SkipWithError("Failed to deflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void ZstdDeflateReusedContext(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    cb::compression::Buffer output;
+    cb::compression::Context context;
+    while (state.KeepRunning()) {
+        if (!context.deflateZstd(
+                    input,
+                    output,
+                    cb::compression::DefaultZstdCompressionLevel)) {
+            state.SkipWithError("Failed to deflate data");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(ZlibDeflateFreshContext)->RangeMultiplier(FACTOR)->Range(START, END);
+BENCHMARK(ZlibDeflateReusedContext)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK(ZlibInflateFreshContext)->RangeMultiplier(FACTOR)->Range(START, END);
+BENCHMARK(ZlibInflateReusedContext)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK(ZstdDeflateFreshContext)->RangeMultiplier(FACTOR)->Range(START, END);
+BENCHMARK(ZstdDeflateReusedContext)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+
+/**
+ * A corpus of JSON documents between ~200 bytes and ~2KiB with the same
+ * set of keys (but different values), which is typical for documents
+ * stored in a bucket. The first half of the corpus is used to train the
+ * dictionary and the benchmarks run on the second half.
+ */
+struct JsonCorpus {
+    JsonCorpus() {
+        std::mt19937 generator(0xdeadbeef);
+        std::uniform_int_distribution<int> tags(0, 30);
+        for (int ii = 0; ii < 2000; ++ii) {
+            std::string doc = fmt::format(
+                    R"({{"id":"user::{}","type":"user","name":"User {}",)"
+                    R"("email":"user{}@example.com","created":{},)"
+                    R"("active":{},"balance":{}.{:02},"tags":[)",
+                    ii,
+                    generator() % 100000,
+                    generator() % 100000,
+                    1700000000 + generator() % 100000000,
+                    generator() % 2 == 0 ? "true" : "false",
+                    generator() % 10000,
+                    generator() % 100);
+            const auto ntags = tags(generator);
+            for (int tag = 0; tag < ntags; ++tag) {
+                doc.append(fmt::format(
+                        R"({}{{"name":"tag{}","weight":{},"source":"import"}})",
+                        tag == 0 ? "" : ",",
+                        generator() % 1000,
+                        generator() % 100));
+            }
+            doc.append("]}");
+            documents.emplace_back(std::move(doc));
+        }
+        const auto half = documents.size() / 2;
+        std::vector<std::string_view> samples(documents.begin(),
+                                              documents.begin() + half);
+        dictionary = cb::compression::ZstdDictionary::train(samples, 16384);
+        input.assign(documents.begin() + half, documents.end());
+        for (const auto& doc : input) {
+            bytes += doc.size();
+        }
+    }
+
+    std::vector<std::string> documents;
+    std::vector<std::string_view> input;
+    size_t bytes = 0;
+    std::shared_ptr<cb::compression::ZstdDictionary> dictionary;
+};
+
+static JsonCorpus& getJsonCorpus() {
+    static JsonCorpus corpus;
+    return corpus;
+}
+
+template <typename Deflate>
+static void runJsonCorpusDeflate(benchmark::State& state, Deflate deflate) {
+    const auto& corpus = getJsonCorpus();
+    cb::compression::Buffer output;
+    size_t compressed = 0;
+    while (state.KeepRunning()) {
+        compressed = 0;
+        for (const auto& doc : corpus.input) {
+            if (!deflate(doc, output)) {
+                state.SkipWithError("Failed to deflate data");
+                return;
+            }
+            compressed += output.size();
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(corpus.bytes));
+    state.counters["ratio"] =
+            static_cast<double>(corpus.bytes) / static_cast<double>(compressed);
+}
+
+template <typename Deflate, typename Inflate>
+static void runJsonCorpusInflate(benchmark::State& state,
+                                 Deflate deflate,
+                                 Inflate inflate) {
+    const auto& corpus = getJsonCorpus();
+    std::vector<std::string> deflated;
+    cb::compression::Buffer output;
+    for (const auto& doc : corpus.input) {
+        if (!deflate(doc, output)) {
+            state.SkipWithError("Failed to deflate data");
+            return;
+        }
+        deflated.emplace_back(std::string_view(output));
+    }
+    while (state.KeepRunning()) {
+        for (const auto& doc : deflated) {
+            if (!inflate(doc, output)) {
+                state.SkipWithError("Failed to inflate data");
+                return;
+            }
+            benchmark::DoNotOptimize(output.data());
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(corpus.bytes));
+}
+
+static bool snappyDeflate(std::string_view in, cb::compression::Buffer& out) {
+    return cb::compression::deflateSnappy(in, out);
+}
+
+static bool snappyInflate(std::string_view in, cb::compression::Buffer& out) {
+    return cb::compression::inflateSnappy(in, out, END);
+}
+
+static bool zstdDeflate(std::string_view in, cb::compression::Buffer& out) {
+    return cb::compression::deflateZstd(in, out);
+}
+
+static bool zstdInflate(std::string_view in, cb::compression::Buffer& out) {
+    return cb::compression::inflateZstd(in, out, END);
+}
+
+static bool zstdDictDeflate(std::string_view in,
+                            cb::compression::Buffer& out) {
+    return cb::compression::deflateZstd(
+            in, out, *getJsonCorpus().dictionary);
+}
+
+static bool zstdDictInflate(std::string_view in,
+                            cb::compression::Buffer& out) {
+    return cb::compression::inflateZstd(
+            in, out, END, *getJsonCorpus().dictionary);
+}
+
+static void JsonCorpusDeflateSnappy(benchmark::State& state) {
+    runJsonCorpusDeflate(state, snappyDeflate);
+}
+
+static void JsonCorpusDeflateZstd(benchmark::State& state) {
+    runJsonCorpusDeflate(state, zstdDeflate);
+}
+
+static void JsonCorpusDeflateZstdDictionary(benchmark::State& state) {
+    runJsonCorpusDeflate(state, zstdDictDeflate);
+}
+
+static void JsonCorpusInflateSnappy(benchmark::State& state) {
+    runJsonCorpusInflate(state, snappyDeflate, snappyInflate);
+}
+
+static void JsonCorpusInflateZstd(benchmark::State& state) {
+    runJsonCorpusInflate(state, zstdDeflate, zstdInflate);
+}
+
+static void JsonCorpusInflateZstdDictionary(benchmark::State& state) {
+    runJsonCorpusInflate(state, zstdDictDeflate, zstdDictInflate);
+}
+
+BENCHMARK(JsonCorpusDeflateSnappy);
+BENCHMARK(JsonCorpusDeflateZstd);
+BENCHMARK(JsonCorpusDeflateZstdDictionary);
+BENCHMARK(JsonCorpusInflateSnappy);
+BENCHMARK(JsonCorpusInflateZstd);
+BENCHMARK(JsonCorpusInflateZstdDictionary);
+
+// Deflate the JSON corpus as a single batch by using a BatchCompressor with
+// the given number of threads
+static void BatchDeflate(benchmark::State& state) {
+    const auto& corpus = getJsonCorpus();
+    cb::compression::BatchCompressor compressor(size_t(state.range(0)));
+    std::vector<std::string_view> outputs(corpus.documents.size());
+    std::vector<std::string_view> inputs(corpus.documents.begin(),
+                                         corpus.documents.end());
+    size_t bytes = 0;
+    for (const auto& doc : inputs) {
+        bytes += doc.size();
+    }
+    cb::compression::Buffer arena;
+    while (state.KeepRunning()) {
+        if (!compressor.deflate(
+                    folly::io::CodecType::SNAPPY, inputs, outputs, arena)) {
+            state.SkipWithError("Failed to deflate batch");
+            break;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(bytes));
+}
+BENCHMARK(BatchDeflate)
+        ->RangeMultiplier(2)
+        ->Range(1, 32)
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+/**
+ * Inputs which don't compress: random data, and "JPEG-like" data (a small
+ * header followed by entropy coded data, which we emulate by compressing
+ * the JSON corpus with ZSTD).
+ */
+struct IncompressibleInput {
+    IncompressibleInput() {
+        std::mt19937 generator(0xc0ffee);
+        random.resize(END);
+        for (auto& c : random) {
+            c = static_cast<char>(generator());
+        }
+
+        // SOI and APP0 markers
+        jpeg.assign("\xff\xd8\xff\xe0\x00\x10JFIF", 10);
+        cb::compression::Buffer deflated;
+        for (const auto& doc : getJsonCorpus().documents) {
+            if (jpeg.size() >= END) {
+                break;
+            }
+            if (cb::compression::deflateZstd(doc, deflated, 19)) {
+                jpeg.append(std::string_view(deflated));
+            }
+        }
+        jpeg.resize(END);
+    }
+    std::string random;
+    std::string jpeg;
+};
+
+static IncompressibleInput& getIncompressibleInput() {
+    static IncompressibleInput input;
+    return input;
+}
+
+static std::string_view getIncompressibleData(benchmark::State& state,
+                                              bool jpeg) {
+    const auto& input = getIncompressibleInput();
+    return std::string_view{jpeg ? input.jpeg : input.random}.substr(
+            0, size_t(state.range(0)));
+}
+
+// Always compress the data (and throw away the result as it isn't smaller)
+static void DeflateIncompressible(benchmark::State& state,
+                                  folly::io::CodecType type,
+                                  bool jpeg) {
+    const auto input = getIncompressibleData(state, jpeg);
+    cb::compression::Buffer output;
+    while (state.KeepRunning()) {
+        const auto success = cb::compression::deflate(type, input, output) &&
+                             output.size() < input.size();
+        benchmark::DoNotOptimize(success);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+// Use the compressibility probe to skip compressing the data
+static void DeflateIfCompressible(benchmark::State& state,
+                                  folly::io::CodecType type,
+                                  bool jpeg) {
+    const auto input = getIncompressibleData(state, jpeg);
+    cb::compression::Buffer output;
+    while (state.KeepRunning()) {
+        const auto success =
+                cb::compression::deflateIfCompressible(type, input, output);
+        benchmark::DoNotOptimize(success);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK_CAPTURE(DeflateIncompressible,
+                  SnappyRandom,
+                  folly::io::CodecType::SNAPPY,
+                  false)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIfCompressible,
+                  SnappyRandom,
+                  folly::io::CodecType::SNAPPY,
+                  false)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIncompressible,
+                  SnappyJpeg,
+                  folly::io::CodecType::SNAPPY,
+                  true)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIfCompressible,
+                  SnappyJpeg,
+                  folly::io::CodecType::SNAPPY,
+                  true)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIncompressible,
+                  ZstdRandom,
+                  folly::io::CodecType::ZSTD,
+                  false)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIfCompressible,
+                  ZstdRandom,
+                  folly::io::CodecType::ZSTD,
+                  false)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIncompressible,
+                  ZstdJpeg,
+                  folly::io::CodecType::ZSTD,
+                  true)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+BENCHMARK_CAPTURE(DeflateIfCompressible,
+                  ZstdJpeg,
+                  folly::io::CodecType::ZSTD,
+                  true)
+        ->RangeMultiplier(FACTOR)
+        ->Range(START, END);
+
+// The cost of the probe on data which compresses well
+static void EstimateCompressibility(benchmark::State& state) {
+    const std::string_view input{blob.data(), size_t(state.range(0))};
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(
+                cb::compression::estimateCompressibility(input));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(EstimateCompressibility)->RangeMultiplier(FACTOR)->Range(START, END);
+
+/*
+ * The codec suite runs inflate and deflate for all of the codecs through
+ * both the Buffer and IOBuf paths of cb::compression on a set of corpora
+ * with different characteristics. It reports the throughput (bytes per
+ * second of uncompressed data), the compression ratio and the number of
+ * operator new / cb_malloc allocations per operation ("new_allocs/op").
+ *
+ * The allocations are counted by a cb_malloc new hook, which sees all
+ * allocations done through operator new and cb_malloc (Buffer, Snappy,
+ * std containers). Allocations done by the codec libraries or folly with
+ * plain malloc (zlib, zstd, IOBuf) are not included, so the counter must
+ * not be used to compare the total allocations of the paths.
+ */
+static std::atomic<size_t> allocations{0};
+
+static void countAllocation(const void*, size_t) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+enum class Operation { Deflate, Inflate };
+enum class Path { Buffer, IOBuf };
+enum class Corpus { Json, Binary, Random, Repetitive };
+
+static std::string to_string(Operation operation) {
+    return operation == Operation::Deflate ? "Deflate" : "Inflate";
+}
+
+static std::string to_string(Path path) {
+    return path == Path::Buffer ? "Buffer" : "IOBuf";
+}
+
+static std::string to_string(folly::io::CodecType type) {
+    switch (type) {
+    case folly::io::CodecType::SNAPPY:
+        return "Snappy";
+    case folly::io::CodecType::ZLIB:
+        return "Zlib";
+    case folly::io::CodecType::ZSTD:
+        return "Zstd";
+    case folly::io::CodecType::LZ4:
+        return "LZ4";
+    default:
+        return "Unknown";
+    }
+}
+
+static std::string to_string(Corpus corpus) {
+    switch (corpus) {
+    case Corpus::Json:
+        return "Json";
+    case Corpus::Binary:
+        return "Binary";
+    case Corpus::Random:
+        return "Random";
+    case Corpus::Repetitive:
+        return "Repetitive";
+    }
+    return "Unknown";
+}
+
+/// Generate size bytes of data of the requested corpus
+static std::string makeCorpus(Corpus corpus, size_t size) {
+    std::string ret;
+    ret.reserve(size + 4096);
+    std::mt19937 generator(0xbadf00d);
+
+    switch (corpus) {
+    case Corpus::Json:
+        // The JSON documents back to back
+        while (ret.size() < size) {
+            for (const auto& doc : getJsonCorpus().documents) {
+                ret.append(doc);
+                if (ret.size() >= size) {
+                    break;
+                }
+            }
+        }
+        break;
+    case Corpus::Binary: {
+        // Fixed size records with a sequential id, a slowly increasing
+        // timestamp, a few distinct types and a random walk value (typical
+        // for time series and binary documents)
+        uint64_t id = 0;
+        uint32_t timestamp = 1700000000;
+        double value = 100;
+        std::normal_distribution<double> step(0, 1);
+        while (ret.size() < size) {
+            const uint16_t type = uint16_t(generator() % 8);
+            const uint16_t flags = 0;
+            timestamp += uint32_t(generator() % 10);
+            value += step(generator);
+            ret.append(reinterpret_cast<const char*>(&id), sizeof(id));
+            ret.append(reinterpret_cast<const char*>(&timestamp),
+                       sizeof(timestamp));
+            ret.append(reinterpret_cast<const char*>(&type), sizeof(type));
+            ret.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+            ret.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            ++id;
+        }
+        break;
+    }
+    case Corpus::Random:
+        while (ret.size() < size) {
+            ret.push_back(static_cast<char>(generator()));
+        }
+        break;
+    case Corpus::Repetitive:
+        while (ret.size() < size) {
+            ret.append(blob.data(), 'z' - 'a');
+        }
+        break;
+    }
+    ret.resize(size);
+    return ret;
+}
+
+static void CodecSuite(benchmark::State& state,
+                       Operation operation,
+                       Path path,
+                       folly::io::CodecType type,
+                       Corpus corpus) {
+    const auto input = makeCorpus(corpus, size_t(state.range(0)));
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(type, input, deflated)) {
+        state.SkipWithError("Failed to deflate data");
+        return;
+    }
+
+    cb::compression::Buffer output;
+    const auto start = allocations.load();
+    while (state.KeepRunning()) {
+        bool success = true;
+        if (operation == Operation::Deflate) {
+            if (path == Path::Buffer) {
+                success = cb::compression::deflate(type, input, output);
+                benchmark::DoNotOptimize(output.data());
+            } else {
+                auto iobuf = cb::compression::deflate(type, input);
+                benchmark::DoNotOptimize(iobuf->data());
+            }
+        } else {
+            if (path == Path::Buffer) {
+                success = cb::compression::inflate(
+                        type, deflated, output, input.size());
+                benchmark::DoNotOptimize(output.data());
+            } else {
+                auto iobuf =
+                        cb::compression::inflate(type, deflated, input.size());
+                benchmark::DoNotOptimize(iobuf->data());
+            }
+        }
+        if (!success) {
+            state.SkipWithError("Operation failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(input.size()));
+    state.counters["ratio"] = static_cast<double>(input.size()) /
+                              static_cast<double>(deflated.size());
+    state.counters["new_allocs/op"] =
+            benchmark::Counter(static_cast<double>(allocations.load() - start),
+                               benchmark::Counter::kAvgIterations);
+}
+
+/// A JSON array of the documents in the JSON corpus of (about) size bytes
+static std::string makeJsonArray(size_t size) {
+    std::string ret = "[";
+    while (ret.size() < size) {
+        for (const auto& doc : getJsonCorpus().documents) {
+            if (ret.size() > 1) {
+                ret.push_back(',');
+            }
+            ret.append(doc);
+            if (ret.size() >= size) {
+                break;
+            }
+        }
+    }
+    ret.push_back(']');
+    return ret;
+}
+
+/// Inflate the document and then validate the inflated document (two
+/// passes over the inflated data)
+static void InflateThenValidateJson(benchmark::State& state,
+                                    folly::io::CodecType type) {
+    const auto input = makeJsonArray(size_t(state.range(0)));
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(type, input, deflated)) {
+        state.SkipWithError("Failed to deflate data");
+        return;
+    }
+    cb::compression::Buffer inflated;
+    JSON_checker::Validator validator;
+    while (state.KeepRunning()) {
+        if (!cb::compression::inflate(
+                    type, deflated, inflated, input.size()) ||
+            !validator.validate(inflated)) {
+            state.SkipWithError("Failed to inflate and validate data");
+            break;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(input.size()));
+}
+
+/// Validate each block of the document as it is inflated
+static void InflateAndValidateJson(benchmark::State& state,
+                                   folly::io::CodecType type) {
+    const auto input = makeJsonArray(size_t(state.range(0)));
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(type, input, deflated)) {
+        state.SkipWithError("Failed to deflate data");
+        return;
+    }
+    cb::compression::Buffer inflated;
+    JSON_checker::Validator validator;
+    while (state.KeepRunning()) {
+        if (cb::compression::inflateAndValidateJson(
+                    type, deflated, inflated, input.size(), validator) !=
+            cb::compression::InflateValidateResult::Json) {
+            state.SkipWithError("Failed to inflate and validate data");
+            break;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(input.size()));
+}
+
+BENCHMARK_CAPTURE(InflateThenValidateJson, Zlib, folly::io::CodecType::ZLIB)
+        ->RangeMultiplier(8)
+        ->Range(4096, END * 64);
+BENCHMARK_CAPTURE(InflateAndValidateJson, Zlib, folly::io::CodecType::ZLIB)
+        ->RangeMultiplier(8)
+        ->Range(4096, END * 64);
+BENCHMARK_CAPTURE(InflateThenValidateJson, Zstd, folly::io::CodecType::ZSTD)
+        ->RangeMultiplier(8)
+        ->Range(4096, END * 64);
+BENCHMARK_CAPTURE(InflateAndValidateJson, Zstd, folly::io::CodecType::ZSTD)
+        ->RangeMultiplier(8)
+        ->Range(4096, END * 64);
+
+static void registerCodecSuite() {
+    for (const auto operation : {Operation::Deflate, Operation::Inflate}) {
+        for (const auto path : {Path::Buffer, Path::IOBuf}) {
+            for (const auto type : {folly::io::CodecType::SNAPPY,
+                                    folly::io::CodecType::ZLIB,
+                                    folly::io::CodecType::ZSTD,
+                                    folly::io::CodecType::LZ4}) {
+                for (const auto corpus : {Corpus::Json,
+                                          Corpus::Binary,
+                                          Corpus::Random,
+                                          Corpus::Repetitive}) {
+                    const auto name = fmt::format("CodecSuite/{}/{}/{}/{}",
+                                                  to_string(operation),
+                                                  to_string(path),
+                                                  to_string(type),
+                                                  to_string(corpus));
+                    benchmark::RegisterBenchmark(name.c_str(),
+                                                 CodecSuite,
+                                                 operation,
+                                                 path,
+                                                 type,
+                                                 corpus)
+                            ->RangeMultiplier(16)
+                            ->Range(256, 1_MiB);
+                }
+            }
+        }
+    }
+}
+
 int main(int argc, char** argv) {
     int ii = 0;
     for (auto& a : blob) {
         a = 'a' + (ii++ % ('z' - 'a'));
     }
 
+    cb_add_new_hook(countAllocation);
+    benchmark::AddCustomContext(
+            "new_allocs/op",
+            "operator new / cb_malloc allocations only, the malloc "
+            "allocations of zlib, zstd and folly::IOBuf are not counted");
+    registerCodecSuite();
+
     ::benchmark::Initialize(&argc, argv);
     ::benchmark::RunSpecifiedBenchmarks();
 }
@@ -7,11 +7,23 @@
  *   software will be governed by the Apache License, Version 2.0, included in
  *   the file licenses/APL2.txt.
  */
+#include <JSON_checker.h>
+#include <fmt/format.h>
 #include <folly/io/IOBuf.h>
 #include <folly/portability/GTest.h>
 #include <platform/byte_literals.h>
+#include <platform/cb_arena_malloc.h>
+#include <platform/cb_malloc.h>
 #include <platform/compress.h>
+#include <platform/compression/batch.h>
+#include <platform/compression/buffer_pool.h>
+#include <platform/compression/context.h>
+#include <platform/compression/dictionary.h>
+#include <platform/compression/snappy_stream.h>
+#include <platform/compression/validate.h>
+#include <random>
 #include <stdexcept>
+#include <thread>
 
 using cb::compression::Allocator;
 using cb::compression::Buffer;
@@ -79,3 +91,681 @@ TEST(Compression, TestGetUncompressedLength) {
     EXPECT_EQ(8192u,
               getUncompressedLengthSnappy({output.data(), output.size()}));
 }
+
+/// Tests which should pass for all of the codecs supported by cbcompress
+class CodecTest : public ::testing::TestWithParam<folly::io::CodecType> {
+protected:
+    void SetUp() override {
+        input.resize(8192);
+        for (size_t ii = 0; ii < input.size(); ++ii) {
+            input.data()[ii] = char('a' + ii % 13);
+        }
+    }
+
+    Buffer input;
+};
+
+TEST_P(CodecTest, BufferRoundTrip) {
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(GetParam(), input, deflated));
+    EXPECT_LT(deflated.size(), input.size());
+
+    Buffer inflated;
+    ASSERT_TRUE(cb::compression::inflate(
+            GetParam(), deflated, inflated, 30_MiB));
+    ASSERT_EQ(input.size(), inflated.size());
+    EXPECT_EQ(0, memcmp(input.data(), inflated.data(), input.size()));
+
+    // Verify that we don't exceed the max size
+    EXPECT_FALSE(
+            cb::compression::inflate(GetParam(), deflated, inflated, 4096));
+}
+
+TEST_P(CodecTest, IOBufRoundTrip) {
+    auto deflated = cb::compression::deflate(GetParam(), input);
+    ASSERT_TRUE(deflated);
+    EXPECT_LT(deflated->computeChainDataLength(), input.size());
+
+    const auto view = folly::StringPiece{deflated->coalesce()};
+    auto inflated = cb::compression::inflate(GetParam(), view, 30_MiB);
+    ASSERT_TRUE(inflated);
+    const auto data = folly::StringPiece{inflated->coalesce()};
+    EXPECT_EQ(std::string_view(input), std::string_view(data));
+
+    EXPECT_THROW(
+            (void)cb::compression::inflate(GetParam(), view, 4096),
+            std::range_error);
+}
+
+TEST_P(CodecTest, GetUncompressedLength) {
+    if (GetParam() == folly::io::CodecType::ZLIB) {
+        GTEST_SKIP() << "zlib doesn't store the uncompressed length";
+    }
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(GetParam(), input, deflated));
+    EXPECT_EQ(input.size(),
+              cb::compression::get_uncompressed_length(GetParam(), deflated));
+}
+
+TEST_P(CodecTest, IllegalInflate) {
+    Buffer output;
+    EXPECT_FALSE(cb::compression::inflate(GetParam(), input, output, 30_MiB));
+}
+
+INSTANTIATE_TEST_SUITE_P(Compression,
+                         CodecTest,
+                         ::testing::Values(folly::io::CodecType::SNAPPY,
+                                           folly::io::CodecType::ZLIB,
+                                           folly::io::CodecType::ZSTD,
+                                           folly::io::CodecType::LZ4),
+                         [](const auto& info) {
+                             switch (info.param) {
+                             case folly::io::CodecType::SNAPPY:
+                                 return "Snappy";
+                             case folly::io::CodecType::ZLIB:
+                                 return "Zlib";
+                             case folly::io::CodecType::ZSTD:
+                                 return "Zstd";
+                             case folly::io::CodecType::LZ4:
+                                 return "LZ4";
+                             default:
+                                 return "Unknown";
+                             }
+                         });
+
+TEST(Compression, ZstdCompressionLevels) {
+    std::string input;
+    for (int ii = 0; ii < 1024; ++ii) {
+        input.append(fmt::format("{{\"id\":{},\"name\":\"user{}\"}}", ii, ii));
+    }
+
+    Buffer fast;
+    Buffer best;
+    ASSERT_TRUE(cb::compression::deflateZstd(input, fast, 1));
+    ASSERT_TRUE(cb::compression::deflateZstd(input, best, 19));
+    EXPECT_LE(best.size(), fast.size());
+
+    Buffer inflated;
+    ASSERT_TRUE(cb::compression::inflateZstd(best, inflated, 30_MiB));
+    EXPECT_EQ(input, std::string_view(inflated));
+}
+
+TEST(Compression, UnsupportedCodec) {
+    Buffer output;
+    EXPECT_THROW((void)cb::compression::deflate(
+                         folly::io::CodecType::BZIP2, "foo", output),
+                 std::invalid_argument);
+    EXPECT_THROW((void)cb::compression::get_uncompressed_length(
+                         folly::io::CodecType::ZLIB, "foo"),
+                 std::invalid_argument);
+}
+
+TEST(Compression, ContextReuse) {
+    cb::compression::Context context;
+    for (int ii = 0; ii < 10; ++ii) {
+        const auto input = fmt::format("{{\"id\":{},\"value\":\"{}\"}}",
+                                       ii,
+                                       std::string(size_t(ii) * 100, 'x'));
+        Buffer zlib;
+        ASSERT_TRUE(context.deflateZlib(input, zlib));
+        Buffer zstd;
+        ASSERT_TRUE(context.deflateZstd(
+                input, zstd, cb::compression::DefaultZstdCompressionLevel));
+
+        // The reused state must produce the same output as a fresh context
+        cb::compression::Context fresh;
+        Buffer expected;
+        ASSERT_TRUE(fresh.deflateZlib(input, expected));
+        EXPECT_EQ(std::string_view(expected), std::string_view(zlib));
+
+        Buffer inflated;
+        ASSERT_TRUE(context.inflateZlib(zlib, inflated, 30_MiB));
+        EXPECT_EQ(input, std::string_view(inflated));
+        ASSERT_TRUE(context.inflateZstd(zstd, inflated, 30_MiB));
+        EXPECT_EQ(input, std::string_view(inflated));
+
+        // A failure should not leave the context in a bad state
+        EXPECT_FALSE(context.inflateZlib(input, inflated, 30_MiB));
+        EXPECT_FALSE(context.inflateZlib(
+                std::string_view{zlib}.substr(0, zlib.size() / 2),
+                inflated,
+                30_MiB));
+
+        if (ii == 5) {
+            context.reset();
+        }
+    }
+}
+
+TEST(Compression, BufferGrowPreservesContent) {
+    Buffer buffer;
+    buffer.resize(4);
+    std::memcpy(buffer.data(), "abcd", 4);
+    buffer.grow(8192);
+    EXPECT_EQ(8192u, buffer.size());
+    EXPECT_LE(8192u, buffer.capacity());
+    EXPECT_EQ("abcd", std::string_view(buffer.data(), 4));
+}
+
+TEST(Compression, BufferPool) {
+    using cb::compression::BufferPool;
+    EXPECT_EQ(BufferPool::MinSizeClass, BufferPool::getAllocationSize(1));
+    EXPECT_EQ(8192u, BufferPool::getAllocationSize(4097));
+    EXPECT_EQ(BufferPool::MaxSizeClass,
+              BufferPool::getAllocationSize(BufferPool::MaxSizeClass));
+    EXPECT_EQ(BufferPool::MaxSizeClass + 1,
+              BufferPool::getAllocationSize(BufferPool::MaxSizeClass + 1));
+
+    auto& pool = BufferPool::getThreadLocal();
+    pool.clear();
+    const auto hits = pool.getHits();
+    const auto misses = pool.getMisses();
+
+    std::string input(100_KiB, 'a');
+    Buffer deflated;
+    ASSERT_TRUE(deflateSnappy(input, deflated));
+    for (int ii = 0; ii < 10; ++ii) {
+        Buffer inflated(Allocator{Allocator::Mode::Pool});
+        ASSERT_TRUE(inflateSnappy(deflated, inflated, input.size()));
+        EXPECT_EQ(input, std::string_view(inflated));
+        EXPECT_EQ(128_KiB, inflated.capacity());
+    }
+    // Only the first buffer should have allocated memory
+    EXPECT_EQ(misses + 1, pool.getMisses());
+    EXPECT_EQ(hits + 9, pool.getHits());
+    EXPECT_EQ(128_KiB, pool.getPooledBytes());
+
+    // The pool is bounded
+    pool.setMaxPooledBytes(64_KiB);
+    EXPECT_EQ(0u, pool.getPooledBytes());
+    {
+        Buffer inflated(Allocator{Allocator::Mode::Pool});
+        ASSERT_TRUE(inflateSnappy(deflated, inflated, input.size()));
+    }
+    EXPECT_EQ(0u, pool.getPooledBytes());
+
+    pool.setMaxPooledBytes(BufferPool::DefaultMaxPooledBytes);
+    pool.clear();
+}
+
+/// The pooled blocks are kept per client (and domain), and purge() frees
+/// the blocks of a client from the pools of all threads
+TEST(Compression, BufferPoolClients) {
+    using cb::compression::BufferPool;
+    auto& pool = BufferPool::getThreadLocal();
+    pool.clear();
+
+    auto client = cb::ArenaMalloc::registerClient();
+    cb::ArenaMalloc::switchToClient(client);
+    pool.deallocate(pool.allocate(8_KiB));
+    EXPECT_EQ(8_KiB, pool.getPooledBytes());
+
+    // Changing the domain or client doesn't release the blocks
+    cb::ArenaMalloc::setDomain(cb::MemoryDomain::Secondary);
+    pool.deallocate(pool.allocate(16_KiB));
+    cb::ArenaMalloc::switchFromClient();
+    pool.deallocate(pool.allocate(4_KiB));
+    EXPECT_EQ(28_KiB, pool.getPooledBytes());
+
+    // And the blocks are reused by the same client and domain
+    cb::ArenaMalloc::switchToClient(client);
+    const auto hits = pool.getHits();
+    pool.deallocate(pool.allocate(8_KiB));
+    EXPECT_EQ(hits + 1, pool.getHits());
+    cb::ArenaMalloc::switchFromClient();
+
+    std::thread([&client]() { BufferPool::purge(client); }).join();
+    EXPECT_EQ(4_KiB, pool.getPooledBytes());
+    if (cb::ArenaMalloc::canTrackAllocations()) {
+        EXPECT_EQ(0u, cb::ArenaMalloc::getPreciseAllocated(client));
+    }
+    cb::ArenaMalloc::unregisterClient(client);
+    pool.clear();
+    EXPECT_EQ(0u, pool.getPooledBytes());
+}
+
+/// A client unregistered without purge() must not leave its pooled blocks to
+/// (or have them freed against) the next client using its index
+TEST(Compression, BufferPoolClientUnregisteredWithoutPurge) {
+    using cb::compression::BufferPool;
+    auto& pool = BufferPool::getThreadLocal();
+    pool.clear();
+
+    auto client = cb::ArenaMalloc::registerClient();
+    cb::ArenaMalloc::switchToClient(client);
+    pool.deallocate(pool.allocate(8_KiB));
+    cb::ArenaMalloc::switchFromClient();
+    EXPECT_EQ(8_KiB, pool.getPooledBytes());
+    cb::ArenaMalloc::unregisterClient(client);
+
+    auto next = cb::ArenaMalloc::registerClient();
+    ASSERT_EQ(client.index, next.index);
+    cb::ArenaMalloc::switchToClient(next);
+    const auto hits = pool.getHits();
+    auto* block = pool.allocate(8_KiB);
+    // The stale block was freed rather than reused
+    EXPECT_EQ(hits, pool.getHits());
+    EXPECT_EQ(0u, pool.getPooledBytes());
+    pool.deallocate(block);
+    cb::ArenaMalloc::switchFromClient();
+
+    // The next client was charged for the block it allocated itself, and
+    // clearing the pool frees it against that client only
+    pool.clear();
+    EXPECT_EQ(0u, pool.getPooledBytes());
+    if (cb::ArenaMalloc::canTrackAllocations()) {
+        EXPECT_EQ(0u, cb::ArenaMalloc::getPreciseAllocated(next));
+    }
+
+    // Clearing a pool (as at thread exit) with stale blocks doesn't free
+    // them against the client now using the index either
+    cb::ArenaMalloc::switchToClient(next);
+    pool.deallocate(pool.allocate(8_KiB));
+    cb::ArenaMalloc::switchFromClient();
+    cb::ArenaMalloc::unregisterClient(next);
+    auto third = cb::ArenaMalloc::registerClient();
+    ASSERT_EQ(next.index, third.index);
+    cb::ArenaMalloc::switchToClient(third);
+    auto* live = cb_malloc(100);
+    cb::ArenaMalloc::switchFromClient();
+    const auto allocated = cb::ArenaMalloc::getPreciseAllocated(third);
+    pool.clear();
+    EXPECT_EQ(0u, pool.getPooledBytes());
+    EXPECT_EQ(allocated, cb::ArenaMalloc::getPreciseAllocated(third));
+
+    cb::ArenaMalloc::switchToClient(third);
+    cb_free(live);
+    cb::ArenaMalloc::switchFromClient();
+    cb::ArenaMalloc::unregisterClient(third);
+}
+
+/// Inflating zlib into a Buffer grows the buffer as needed, and respects
+/// the max inflated size
+TEST(Compression, ZlibInflateIntoBuffer) {
+    std::string input;
+    for (int ii = 0; input.size() < 4_MiB; ++ii) {
+        input.append(fmt::format("{{\"id\":{},\"name\":\"user{}\"}}", ii, ii));
+    }
+
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(
+            folly::io::CodecType::ZLIB, input, deflated));
+
+    Buffer inflated;
+    ASSERT_TRUE(cb::compression::inflate(
+            folly::io::CodecType::ZLIB, deflated, inflated, input.size()));
+    EXPECT_EQ(input, std::string_view(inflated));
+
+    EXPECT_FALSE(cb::compression::inflate(
+            folly::io::CodecType::ZLIB, deflated, inflated, input.size() - 1));
+
+    auto iobuf = cb::compression::inflate(
+            folly::io::CodecType::ZLIB, deflated, input.size());
+    EXPECT_EQ(input, std::string_view(folly::StringPiece{iobuf->coalesce()}));
+}
+
+/// Generate a JSON document which looks like a typical user profile
+static std::string makeJsonDocument(int id) {
+    return fmt::format(
+            R"({{"id":{},"type":"user","name":"user{}","email":"user{}@)"
+            R"(example.com","age":{},"active":{},"address":{{"street":)"
+            R"("{} Main Street","city":"City{}","country":"NO"}}}})",
+            id,
+            id,
+            id,
+            20 + id % 50,
+            id % 2 == 0 ? "true" : "false",
+            id * 7,
+            id % 17);
+}
+
+TEST(Compression, ZstdDictionary) {
+    std::vector<std::string> documents;
+    for (int ii = 0; ii < 2000; ++ii) {
+        documents.emplace_back(makeJsonDocument(ii));
+    }
+    std::vector<std::string_view> samples(documents.begin(),
+                                          documents.end());
+
+    auto dictionary = cb::compression::ZstdDictionary::train(samples, 4096);
+    ASSERT_TRUE(dictionary);
+    EXPECT_NE(0u, dictionary->getId());
+    EXPECT_LE(dictionary->getContent().size(), 4096u);
+
+    // Loading the same content should give the same id
+    cb::compression::ZstdDictionary loaded(
+            std::string{dictionary->getContent()});
+    EXPECT_EQ(dictionary->getId(), loaded.getId());
+
+    const auto document = makeJsonDocument(100000);
+    Buffer with;
+    ASSERT_TRUE(cb::compression::deflateZstd(document, with, *dictionary));
+    Buffer without;
+    ASSERT_TRUE(cb::compression::deflateZstd(document, without));
+    EXPECT_LT(with.size(), without.size());
+
+    EXPECT_EQ(dictionary->getId(),
+              cb::compression::ZstdDictionary::getFrameDictionaryId(with));
+    EXPECT_EQ(0u,
+              cb::compression::ZstdDictionary::getFrameDictionaryId(without));
+
+    Buffer inflated;
+    ASSERT_TRUE(
+            cb::compression::inflateZstd(with, inflated, 30_MiB, loaded));
+    EXPECT_EQ(document, std::string_view(inflated));
+
+    // We can't inflate it without the dictionary
+    EXPECT_FALSE(cb::compression::inflateZstd(with, inflated, 30_MiB));
+}
+
+TEST(Compression, ZstdDictionaryInvalidContent) {
+    EXPECT_THROW(cb::compression::ZstdDictionary("not a dictionary"),
+                 std::invalid_argument);
+}
+
+TEST(Compression, EstimateCompressibility) {
+    EXPECT_EQ(0.0, cb::compression::estimateCompressibility({}));
+    const std::string repetitive(1_MiB, 'a');
+    EXPECT_EQ(0.0, cb::compression::estimateCompressibility(repetitive));
+
+    std::string random(1_MiB, '\0');
+    std::mt19937 generator(0);
+    for (auto& c : random) {
+        c = static_cast<char>(generator());
+    }
+    EXPECT_LT(0.95, cb::compression::estimateCompressibility(random));
+
+    std::string json;
+    for (int ii = 0; json.size() < 1_MiB; ++ii) {
+        json.append(makeJsonDocument(ii));
+    }
+    EXPECT_GT(0.8, cb::compression::estimateCompressibility(json));
+}
+
+TEST(Compression, DeflateIfCompressible) {
+    std::string random(64_KiB, '\0');
+    std::mt19937 generator(0);
+    for (auto& c : random) {
+        c = static_cast<char>(generator());
+    }
+
+    Buffer output;
+    EXPECT_FALSE(cb::compression::deflateIfCompressible(
+            folly::io::CodecType::SNAPPY, random, output));
+
+    // With a threshold above 1 we'll always try to compress, but random
+    // data doesn't get smaller
+    EXPECT_FALSE(cb::compression::deflateIfCompressible(
+            folly::io::CodecType::SNAPPY, random, output, 1.1));
+
+    std::string json;
+    for (int ii = 0; ii < 10; ++ii) {
+        json.append(makeJsonDocument(ii));
+    }
+    ASSERT_TRUE(cb::compression::deflateIfCompressible(
+            folly::io::CodecType::SNAPPY, json, output));
+    EXPECT_LT(output.size(), json.size());
+}
+
+TEST(Compression, BatchDeflate) {
+    std::vector<std::string> documents;
+    for (int ii = 0; ii < 1000; ++ii) {
+        documents.emplace_back(makeJsonDocument(ii));
+    }
+    std::vector<std::string_view> inputs(documents.begin(), documents.end());
+    std::vector<std::string_view> outputs(inputs.size());
+
+    cb::compression::BatchCompressor compressor(4);
+    EXPECT_EQ(4u, compressor.getThreadCount());
+    Buffer arena;
+    ASSERT_TRUE(compressor.deflate(
+            folly::io::CodecType::SNAPPY, inputs, outputs, arena));
+
+    for (size_t ii = 0; ii < inputs.size(); ++ii) {
+        Buffer expected;
+        ASSERT_TRUE(deflateSnappy(inputs[ii], expected));
+        EXPECT_EQ(std::string_view(expected), outputs[ii]);
+        EXPECT_GE(outputs[ii].data(), arena.data());
+        EXPECT_LE(outputs[ii].data() + outputs[ii].size(),
+                  arena.data() + arena.size());
+    }
+
+    EXPECT_THROW((void)compressor.deflate(folly::io::CodecType::SNAPPY,
+                                          inputs,
+                                          std::span(outputs).subspan(1),
+                                          arena),
+                 std::invalid_argument);
+}
+
+/// Sink which collects all of the data in memory
+class StringSink : public cb::io::Sink {
+public:
+    explicit StringSink(std::string& data) : data(data) {
+    }
+    void sink(std::string_view chunk) override {
+        data.append(chunk);
+    }
+    std::size_t fsync() override {
+        return data.size();
+    }
+    std::size_t close() override {
+        return data.size();
+    }
+    std::size_t getBytesWritten() const override {
+        return data.size();
+    }
+
+protected:
+    std::string& data;
+};
+
+/// Decode the framed stream by feeding it to the decoder in pieces of the
+/// given size
+static std::string decodeFramed(std::string_view stream, size_t piece) {
+    std::string ret;
+    cb::compression::SnappyFramedDecoder decoder;
+    while (!stream.empty()) {
+        const auto nbytes = std::min(piece, stream.size());
+        decoder.feed(stream.substr(0, nbytes),
+                     [&ret](auto data) { ret.append(data); });
+        stream.remove_prefix(nbytes);
+    }
+    EXPECT_TRUE(decoder.isComplete());
+    EXPECT_EQ(ret.size(), decoder.getBytesProduced());
+    return ret;
+}
+
+TEST(SnappyFraming, RoundTrip) {
+    // Mix compressible and incompressible data so that both the compressed
+    // and uncompressed chunk types get used
+    std::string content;
+    std::mt19937 generator(0xbadf00d);
+    for (int ii = 0; ii < 100; ++ii) {
+        content.append(makeJsonDocument(ii));
+    }
+    while (content.size() < 200_KiB) {
+        content.push_back(static_cast<char>(generator()));
+    }
+    for (int ii = 100; ii < 200; ++ii) {
+        content.append(makeJsonDocument(ii));
+    }
+
+    std::string stream;
+    cb::compression::SnappyFramedSink sink(
+            std::make_unique<StringSink>(stream));
+    std::string_view input = content;
+    size_t piece = 1;
+    while (!input.empty()) {
+        const auto nbytes = std::min(piece, input.size());
+        sink.sink(input.substr(0, nbytes));
+        input.remove_prefix(nbytes);
+        piece = piece * 3 + 1;
+    }
+    EXPECT_EQ(stream.size(), sink.close());
+    EXPECT_EQ(content.size(), sink.getBytesConsumed());
+    EXPECT_TRUE(cb::compression::snappy_framing::isFramedStream(stream));
+
+    EXPECT_EQ(content, decodeFramed(stream, stream.size()));
+    EXPECT_EQ(content, decodeFramed(stream, 1));
+    EXPECT_EQ(content, decodeFramed(stream, 4093));
+}
+
+TEST(SnappyFraming, EmptyStream) {
+    std::string stream;
+    cb::compression::SnappyFramedSink sink(
+            std::make_unique<StringSink>(stream));
+    sink.close();
+    EXPECT_EQ(cb::compression::snappy_framing::StreamIdentifier, stream);
+    EXPECT_TRUE(decodeFramed(stream, 1).empty());
+}
+
+TEST(SnappyFraming, FsyncFlushesChunk) {
+    std::string stream;
+    cb::compression::SnappyFramedSink sink(
+            std::make_unique<StringSink>(stream));
+    sink.sink("hello");
+    EXPECT_TRUE(stream.empty());
+    sink.fsync();
+    EXPECT_EQ("hello", decodeFramed(stream, stream.size()));
+    sink.sink(" world");
+    sink.close();
+    EXPECT_EQ("hello world", decodeFramed(stream, stream.size()));
+    EXPECT_THROW(sink.sink("more"), std::logic_error);
+}
+
+TEST(SnappyFraming, CorruptStream) {
+    std::string stream;
+    {
+        cb::compression::SnappyFramedSink sink(
+                std::make_unique<StringSink>(stream));
+        sink.sink(std::string(1000, 'a'));
+    }
+    const auto noop = [](auto) {};
+
+    // Missing stream identifier
+    cb::compression::SnappyFramedDecoder missing;
+    EXPECT_THROW(missing.feed(stream.substr(10), noop), std::runtime_error);
+
+    // Checksum mismatch
+    auto corrupt = stream;
+    corrupt[14] ^= 0x01;
+    cb::compression::SnappyFramedDecoder checksum;
+    EXPECT_THROW(checksum.feed(corrupt, noop), std::runtime_error);
+
+    // Reserved unskippable chunk
+    cb::compression::SnappyFramedDecoder unskippable;
+    EXPECT_THROW(unskippable.feed(stream.substr(0, 10) +
+                                          std::string("\x02\x01\x00\x00x", 5),
+                                  noop),
+                 std::runtime_error);
+
+    // Skippable (and padding) chunks are ignored
+    const auto skippable = stream.substr(0, 10) +
+                           std::string("\x80\x03\x00\x00xyz", 7) +
+                           std::string("\xfe\x01\x00\x00\x00", 5) +
+                           stream.substr(10);
+    EXPECT_EQ(std::string(1000, 'a'), decodeFramed(skippable, 3));
+
+    // Streams may be concatenated
+    EXPECT_EQ(std::string(2000, 'a'), decodeFramed(stream + stream, 5));
+
+    // Truncated stream
+    cb::compression::SnappyFramedDecoder truncated;
+    truncated.feed(stream.substr(0, stream.size() - 1), noop);
+    EXPECT_FALSE(truncated.isComplete());
+}
+
+TEST_P(CodecTest, InflateAndValidateJson) {
+    // Big enough to span multiple validation (and ZSTD) blocks
+    std::string content = "[";
+    for (int ii = 0; ii < 2000; ++ii) {
+        content.append(ii ? "," : "").append(makeJsonDocument(ii));
+    }
+    content.append("]");
+    ASSERT_GT(content.size(), 256_KiB);
+
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(GetParam(), content, deflated));
+    Buffer inflated;
+    JSON_checker::Validator validator;
+    EXPECT_EQ(cb::compression::InflateValidateResult::Json,
+              cb::compression::inflateAndValidateJson(
+                      GetParam(), deflated, inflated, 1_MiB, validator));
+    EXPECT_EQ(content, std::string_view(inflated));
+
+    // The validator may be reused
+    EXPECT_EQ(cb::compression::InflateValidateResult::Json,
+              cb::compression::inflateAndValidateJson(
+                      GetParam(), deflated, inflated, 1_MiB, validator));
+
+    // Exceeding the max size fails
+    EXPECT_EQ(cb::compression::InflateValidateResult::InflateFailed,
+              cb::compression::inflateAndValidateJson(GetParam(),
+                                                      deflated,
+                                                      inflated,
+                                                      content.size() - 1,
+                                                      validator));
+}
+
+TEST_P(CodecTest, InflateAndValidateNotJson) {
+    // Valid JSON up until the last character
+    std::string content = "[";
+    for (int ii = 0; ii < 1000; ++ii) {
+        content.append(ii ? "," : "").append(makeJsonDocument(ii));
+    }
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(GetParam(), content, deflated));
+    Buffer inflated;
+    JSON_checker::Validator validator;
+    EXPECT_EQ(cb::compression::InflateValidateResult::NotJson,
+              cb::compression::inflateAndValidateJson(
+                      GetParam(), deflated, inflated, 1_MiB, validator));
+    EXPECT_EQ(content, std::string_view(inflated));
+
+    // Invalid UTF-8 (a continuation byte without a leading byte)
+    content = R"({"key":"value)" + std::string(1, char(0x80)) + R"("})";
+    ASSERT_TRUE(cb::compression::deflate(GetParam(), content, deflated));
+    EXPECT_EQ(cb::compression::InflateValidateResult::NotJson,
+              cb::compression::inflateAndValidateJson(
+                      GetParam(), deflated, inflated, 1_MiB, validator));
+}
+
+/// Trailing data after the ZSTD frame is rejected by both the block by block
+/// and the one shot inflate
+TEST(Compression, ZstdTrailingData) {
+    const auto content = makeJsonDocument(1);
+    Buffer deflated;
+    ASSERT_TRUE(cb::compression::deflate(
+            folly::io::CodecType::ZSTD, content, deflated));
+    const std::string frame(deflated.data(), deflated.size());
+
+    for (const auto& input : {frame + "garbage", frame + frame}) {
+        Buffer inflated;
+        JSON_checker::Validator validator;
+        EXPECT_EQ(cb::compression::InflateValidateResult::InflateFailed,
+                  cb::compression::inflateAndValidateJson(
+                          folly::io::CodecType::ZSTD,
+                          input,
+                          inflated,
+                          1_MiB,
+                          validator));
+        EXPECT_FALSE(cb::compression::inflate(
+                folly::io::CodecType::ZSTD, input, inflated, 1_MiB));
+    }
+}
+
+TEST(Compression, ValidatorFeedMatchesValidate) {
+    const std::string json = makeJsonDocument(1) + "\xc3\xa6";
+    const std::string doc = "{\"name\":\"\xc3\xa6\xc3\xb8\xc3\xa5\"}";
+    JSON_checker::Validator validator;
+    for (const auto& input : {doc, json, std::string("12345")}) {
+        const auto expected = validator.validate(input);
+        // Split the document at every possible offset
+        for (size_t ii = 0; ii <= input.size(); ++ii) {
+            validator.begin();
+            validator.feed(std::string_view{input}.substr(0, ii));
+            validator.feed(std::string_view{input}.substr(ii));
+            EXPECT_EQ(expected, validator.finish()) << input << " " << ii;
+        }
+    }
+}
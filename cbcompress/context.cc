@@ -0,0 +1,493 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <fmt/format.h>
+#include <folly/io/IOBuf.h>
+#include <gsl/gsl-lite.hpp>
+#include <platform/cb_arena_malloc.h>
+#include <platform/compression/context.h>
+#include <platform/compression/dictionary.h>
+#include <zlib.h>
+// ZSTD_decompressContinue() is part of the "static linking only" API
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace cb::compression {
+
+// The codec state is long lived and (for the thread local context) freed at
+// thread exit under whichever client is current then, so whatever of it is
+// allocated with operator new (the Impl and the z_streams) is allocated and
+// freed under a NoArenaGuard to keep it out of the clients' memory
+// accounting. zlib and ZSTD allocate their internal state with malloc.
+struct Context::Impl {
+    ~Impl() {
+        reset();
+    }
+
+    /// Get the deflate stream (initialized on first use, reset otherwise)
+    z_stream& getDeflater() {
+        if (deflater) {
+            (void)deflateReset(deflater.get());
+        } else {
+            NoArenaGuard guard;
+            auto stream = std::make_unique<z_stream>();
+            const auto status =
+                    deflateInit(stream.get(), Z_DEFAULT_COMPRESSION);
+            if (status != Z_OK) {
+                throw std::runtime_error(fmt::format(
+                        "Context::getDeflater(): deflateInit() failed with "
+                        "error code: {}",
+                        status));
+            }
+            deflater = std::move(stream);
+        }
+        return *deflater;
+    }
+
+    /// Get the inflate stream (initialized on first use, reset otherwise)
+    z_stream& getInflater() {
+        if (inflater) {
+            (void)inflateReset(inflater.get());
+        } else {
+            NoArenaGuard guard;
+            auto stream = std::make_unique<z_stream>();
+            const auto status = inflateInit(stream.get());
+            if (status != Z_OK) {
+                throw std::runtime_error(fmt::format(
+                        "Context::getInflater(): inflateInit() failed with "
+                        "error code: {}",
+                        status));
+            }
+            inflater = std::move(stream);
+        }
+        return *inflater;
+    }
+
+    ZSTD_CCtx* getCCtx() {
+        if (!cctx) {
+            cctx = ZSTD_createCCtx();
+            if (!cctx) {
+                throw std::bad_alloc();
+            }
+        }
+        return cctx;
+    }
+
+    ZSTD_DCtx* getDCtx() {
+        if (!dctx) {
+            dctx = ZSTD_createDCtx();
+            if (!dctx) {
+                throw std::bad_alloc();
+            }
+        }
+        return dctx;
+    }
+
+    void reset() {
+        NoArenaGuard guard;
+        if (deflater) {
+            (void)deflateEnd(deflater.get());
+            deflater.reset();
+        }
+        if (inflater) {
+            (void)inflateEnd(inflater.get());
+            inflater.reset();
+        }
+        ZSTD_freeCCtx(cctx);
+        cctx = nullptr;
+        ZSTD_freeDCtx(dctx);
+        dctx = nullptr;
+    }
+
+    std::unique_ptr<z_stream> deflater;
+    std::unique_ptr<z_stream> inflater;
+    ZSTD_CCtx* cctx = nullptr;
+    ZSTD_DCtx* dctx = nullptr;
+};
+
+Context::Context() {
+    NoArenaGuard guard;
+    impl = std::make_unique<Impl>();
+}
+
+Context::~Context() {
+    NoArenaGuard guard;
+    impl.reset();
+}
+
+Context& Context::getThreadLocal() {
+    static thread_local Context context;
+    return context;
+}
+
+void Context::reset() {
+    impl->reset();
+}
+
+/**
+ * Deflate all of the input into the provided destination by using the
+ * provided (reset) stream
+ *
+ * @return The number of bytes written to the destination, or 0 on failure
+ */
+static size_t doDeflateZlib(z_stream& stream,
+                            std::string_view input,
+                            uint8_t* destination,
+                            size_t size) {
+    stream.avail_in = gsl::narrow<uInt>(input.size());
+    stream.next_in = const_cast<uint8_t*>(
+            reinterpret_cast<const uint8_t*>(input.data()));
+    stream.avail_out = gsl::narrow<uInt>(size);
+    stream.next_out = destination;
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+    return stream.total_out;
+}
+
+bool Context::deflateZlib(std::string_view input, Buffer& output) {
+    auto& stream = impl->getDeflater();
+    output.resize(deflateBound(&stream, gsl::narrow<uLong>(input.size())));
+    const auto nbytes = doDeflateZlib(stream,
+                                      input,
+                                      reinterpret_cast<uint8_t*>(output.data()),
+                                      output.size());
+    if (nbytes == 0) {
+        return false;
+    }
+    output.resize(nbytes);
+    return true;
+}
+
+std::unique_ptr<folly::IOBuf> Context::deflateZlib(std::string_view input) {
+    auto& stream = impl->getDeflater();
+    auto ret = folly::IOBuf::createCombined(
+            deflateBound(&stream, gsl::narrow<uLong>(input.size())));
+    const auto nbytes =
+            doDeflateZlib(stream, input, ret->writableTail(), ret->tailroom());
+    if (nbytes == 0) {
+        throw std::runtime_error(
+                "Context::deflateZlib(): deflate() failed to complete");
+    }
+    ret->append(nbytes);
+    return ret;
+}
+
+/**
+ * The initial guess for the size of the inflated data. The output grows
+ * geometrically from here so it doesn't need to be exact; the goal is to
+ * avoid allocating big buffers for small documents.
+ */
+static size_t initialInflateSize(size_t input_size, size_t limit) {
+    return std::min(std::max(input_size * 4, size_t(4096)), limit);
+}
+
+/// The largest output buffer needed to detect that max_inflated_size is
+/// exceeded (one byte more than the max, without overflowing)
+static size_t inflateLimit(size_t max_inflated_size) {
+    return max_inflated_size == std::numeric_limits<size_t>::max()
+                   ? max_inflated_size
+                   : max_inflated_size + 1;
+}
+
+bool Context::inflateZlib(std::string_view input,
+                          Buffer& output,
+                          size_t max_inflated_size) {
+    return inflateZlib(input,
+                       output,
+                       max_inflated_size,
+                       std::numeric_limits<size_t>::max(),
+                       {});
+}
+
+bool Context::inflateZlib(std::string_view input,
+                          Buffer& output,
+                          size_t max_inflated_size,
+                          size_t block_size,
+                          const BlockCallback& callback) {
+    if (input.empty()) {
+        return false;
+    }
+
+    auto& stream = impl->getInflater();
+    stream.avail_in = gsl::narrow_cast<uInt>(input.size());
+    stream.next_in = const_cast<uint8_t*>(
+            reinterpret_cast<const uint8_t*>(input.data()));
+
+    // Inflate straight into the output buffer and grow it (preserving the
+    // data inflated so far) until all of the data is inflated or we hit
+    // the limit.
+    const auto limit = inflateLimit(max_inflated_size);
+    output.resize(initialInflateSize(input.size(), limit));
+    size_t produced = 0;
+    int status;
+    do {
+        if (produced == output.size()) {
+            if (output.size() >= limit) {
+                return false;
+            }
+            output.grow(std::min(output.size() * 2, limit));
+        }
+        stream.avail_out = gsl::narrow_cast<uInt>(
+                std::min({output.size() - produced,
+                          block_size,
+                          size_t(std::numeric_limits<uInt>::max())}));
+        stream.next_out = reinterpret_cast<uint8_t*>(output.data() + produced);
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            return false;
+        }
+        if (status == Z_BUF_ERROR && stream.avail_in == 0) {
+            // truncated input
+            return false;
+        }
+        if (stream.total_out > max_inflated_size) {
+            return false;
+        }
+        if (callback && stream.total_out > produced) {
+            callback({output.data() + produced, stream.total_out - produced});
+        }
+        produced = stream.total_out;
+    } while (status != Z_STREAM_END);
+
+    output.resize(produced);
+    return true;
+}
+
+std::unique_ptr<folly::IOBuf> Context::inflateZlib(
+        std::string_view input, size_t max_inflated_size) {
+    static constexpr size_t max_chunk_size = 256 * 1024;
+    std::unique_ptr<folly::IOBuf> ret;
+
+    Expects(!input.empty());
+
+    auto& stream = impl->getInflater();
+    stream.avail_in = gsl::narrow_cast<uInt>(input.size());
+    stream.next_in = const_cast<uint8_t*>(
+            reinterpret_cast<const uint8_t*>(input.data()));
+
+    // Start with a chunk sized for the expected output and grow the
+    // chunk size geometrically (up to max_chunk_size) for big documents
+    auto chunk_size = std::min(
+            initialInflateSize(input.size(), inflateLimit(max_inflated_size)),
+            max_chunk_size);
+    int status;
+    do {
+        auto iobuf = folly::IOBuf::create(chunk_size);
+        chunk_size = std::min(chunk_size * 2, max_chunk_size);
+        stream.avail_out = gsl::narrow_cast<uInt>(iobuf->tailroom());
+        stream.next_out = iobuf->writableTail();
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            throw std::runtime_error(fmt::format(
+                    "inflateZlib(): inflate() failed with error code: {}",
+                    status));
+        }
+        if (status == Z_BUF_ERROR && stream.avail_in == 0) {
+            throw std::runtime_error(
+                    "inflateZlib(): inflate() failed: truncated input");
+        }
+        if (stream.total_out > max_inflated_size) {
+            throw std::range_error(
+                    fmt::format("inflate(): Inflated length {} "
+                                " exceeds max: {}",
+                                stream.total_out,
+                                max_inflated_size));
+        }
+        iobuf->append(iobuf->tailroom() - stream.avail_out);
+        if (!ret) {
+            ret = std::move(iobuf);
+        } else {
+            ret->appendToChain(std::move(iobuf));
+        }
+    } while (status != Z_STREAM_END);
+    return ret;
+}
+
+bool Context::deflateZstd(std::string_view input, Buffer& output, int level) {
+    output.resize(ZSTD_compressBound(input.size()));
+    const auto rv = ZSTD_compressCCtx(impl->getCCtx(),
+                                      output.data(),
+                                      output.size(),
+                                      input.data(),
+                                      input.size(),
+                                      level);
+    if (ZSTD_isError(rv)) {
+        return false;
+    }
+    output.resize(rv);
+    return true;
+}
+
+std::unique_ptr<folly::IOBuf> Context::deflateZstd(std::string_view input,
+                                                   int level) {
+    const auto max_compressed_length = ZSTD_compressBound(input.size());
+    auto ret = folly::IOBuf::createCombined(max_compressed_length);
+    const auto rv = ZSTD_compressCCtx(impl->getCCtx(),
+                                      ret->writableData(),
+                                      max_compressed_length,
+                                      input.data(),
+                                      input.size(),
+                                      level);
+    if (ZSTD_isError(rv)) {
+        throw std::runtime_error(fmt::format(
+                "cb::compression::deflateZstd(): Failed to deflate data: {}",
+                ZSTD_getErrorName(rv)));
+    }
+    ret->append(rv);
+    return ret;
+}
+
+bool Context::inflateZstd(std::string_view input,
+                          Buffer& output,
+                          size_t max_inflated_size) {
+    const auto inflated_length =
+            ZSTD_getFrameContentSize(input.data(), input.size());
+    if (inflated_length == ZSTD_CONTENTSIZE_UNKNOWN ||
+        inflated_length == ZSTD_CONTENTSIZE_ERROR ||
+        inflated_length > max_inflated_size) {
+        return false;
+    }
+
+    output.resize(inflated_length);
+    const auto rv = ZSTD_decompressDCtx(impl->getDCtx(),
+                                        output.data(),
+                                        output.size(),
+                                        input.data(),
+                                        input.size());
+    return !ZSTD_isError(rv) && rv == inflated_length;
+}
+
+bool Context::inflateZstd(std::string_view input,
+                          Buffer& output,
+                          size_t max_inflated_size,
+                          const BlockCallback& callback) {
+    const auto inflated_length =
+            ZSTD_getFrameContentSize(input.data(), input.size());
+    if (inflated_length == ZSTD_CONTENTSIZE_UNKNOWN ||
+        inflated_length == ZSTD_CONTENTSIZE_ERROR ||
+        inflated_length > max_inflated_size) {
+        return false;
+    }
+
+    // Use the buffer-less streaming API which decodes a single block per
+    // call straight into the output buffer (using the data inflated so far
+    // as the window)
+    output.resize(inflated_length);
+    auto* dctx = impl->getDCtx();
+    if (ZSTD_isError(ZSTD_decompressBegin(dctx))) {
+        return false;
+    }
+    size_t consumed = 0;
+    size_t produced = 0;
+    size_t next;
+    while ((next = ZSTD_nextSrcSizeToDecompress(dctx)) != 0) {
+        if (next > input.size() - consumed) {
+            // truncated input
+            return false;
+        }
+        const auto rv = ZSTD_decompressContinue(dctx,
+                                                output.data() + produced,
+                                                output.size() - produced,
+                                                input.data() + consumed,
+                                                next);
+        if (ZSTD_isError(rv)) {
+            return false;
+        }
+        consumed += next;
+        if (callback && rv) {
+            callback({output.data() + produced, rv});
+        }
+        produced += rv;
+    }
+    // Like ZSTD_decompressDCtx(), reject trailing data (including
+    // additional frames)
+    return produced == inflated_length && consumed == input.size();
+}
+
+std::unique_ptr<folly::IOBuf> Context::inflateZstd(
+        std::string_view input, size_t max_inflated_size) {
+    const auto inflated_length =
+            ZSTD_getFrameContentSize(input.data(), input.size());
+    if (inflated_length == ZSTD_CONTENTSIZE_UNKNOWN ||
+        inflated_length == ZSTD_CONTENTSIZE_ERROR) {
+        throw std::runtime_error(
+                "cb::compression::inflateZstd(): Failed to get uncompressed "
+                "length");
+    }
+
+    if (inflated_length > max_inflated_size) {
+        throw std::range_error(
+                fmt::format("cb::compression::inflate(): Inflated length {} "
+                            "would exceed max: {}",
+                            inflated_length,
+                            max_inflated_size));
+    }
+
+    auto ret = folly::IOBuf::createCombined(inflated_length);
+    const auto rv = ZSTD_decompressDCtx(impl->getDCtx(),
+                                        ret->writableData(),
+                                        inflated_length,
+                                        input.data(),
+                                        input.size());
+    if (ZSTD_isError(rv) || rv != inflated_length) {
+        throw std::runtime_error(fmt::format(
+                "cb::compression::inflateZstd(): Failed to inflate data: {}",
+                ZSTD_isError(rv) ? ZSTD_getErrorName(rv) : "length mismatch"));
+    }
+    ret->append(inflated_length);
+    return ret;
+}
+
+bool Context::deflateZstd(std::string_view input,
+                          Buffer& output,
+                          const ZstdDictionary& dictionary) {
+    output.resize(ZSTD_compressBound(input.size()));
+    const auto rv = ZSTD_compress_usingCDict(
+            impl->getCCtx(),
+            output.data(),
+            output.size(),
+            input.data(),
+            input.size(),
+            dictionary.getCompressionDictionary());
+    if (ZSTD_isError(rv)) {
+        return false;
+    }
+    output.resize(rv);
+    return true;
+}
+
+bool Context::inflateZstd(std::string_view input,
+                          Buffer& output,
+                          size_t max_inflated_size,
+                          const ZstdDictionary& dictionary) {
+    const auto inflated_length =
+            ZSTD_getFrameContentSize(input.data(), input.size());
+    if (inflated_length == ZSTD_CONTENTSIZE_UNKNOWN ||
+        inflated_length == ZSTD_CONTENTSIZE_ERROR ||
+        inflated_length > max_inflated_size) {
+        return false;
+    }
+
+    output.resize(inflated_length);
+    const auto rv = ZSTD_decompress_usingDDict(
+            impl->getDCtx(),
+            output.data(),
+            output.size(),
+            input.data(),
+            input.size(),
+            dictionary.getDecompressionDictionary());
+    return !ZSTD_isError(rv) && rv == inflated_length;
+}
+
+} // namespace cb::compression
@@ -0,0 +1,77 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <fmt/format.h>
+#include <gsl/gsl-lite.hpp>
+#include <platform/compression/dictionary.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace cb::compression {
+
+std::shared_ptr<ZstdDictionary> ZstdDictionary::train(
+        std::span<const std::string_view> samples, size_t max_size, int level) {
+    // ZDICT wants all of the samples in a single continuous buffer
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto& sample : samples) {
+        buffer.append(sample);
+        sizes.push_back(sample.size());
+    }
+
+    std::string dictionary;
+    dictionary.resize(max_size);
+    const auto rv = ZDICT_trainFromBuffer(dictionary.data(),
+                                          dictionary.size(),
+                                          buffer.data(),
+                                          sizes.data(),
+                                          gsl::narrow<unsigned>(sizes.size()));
+    if (ZDICT_isError(rv)) {
+        throw std::runtime_error(fmt::format(
+                "ZstdDictionary::train(): Failed to train dictionary from {} "
+                "samples: {}",
+                sizes.size(),
+                ZDICT_getErrorName(rv)));
+    }
+    dictionary.resize(rv);
+    return std::make_shared<ZstdDictionary>(std::move(dictionary), level);
+}
+
+ZstdDictionary::ZstdDictionary(std::string content_, int level_)
+    : content(std::move(content_)), level(level_) {
+    id = ZDICT_getDictID(content.data(), content.size());
+    if (id == 0) {
+        throw std::invalid_argument(
+                "ZstdDictionary(): content is not a ZSTD dictionary");
+    }
+
+    cdict = ZSTD_createCDict(content.data(), content.size(), level);
+    ddict = ZSTD_createDDict(content.data(), content.size());
+    if (!cdict || !ddict) {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+        throw std::invalid_argument(
+                "ZstdDictionary(): Failed to digest the dictionary");
+    }
+}
+
+ZstdDictionary::~ZstdDictionary() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+}
+
+uint32_t ZstdDictionary::getFrameDictionaryId(std::string_view frame) {
+    return ZSTD_getDictID_fromFrame(frame.data(), frame.size());
+}
+
+} // namespace cb::compression
@@ -0,0 +1,290 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <fmt/format.h>
+#include <folly/compression/Compression.h>
+#include <platform/compress.h>
+#include <platform/compression/snappy_stream.h>
+#include <platform/crc32c.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cb::compression {
+
+using namespace snappy_framing;
+
+/// The chunk types defined in the framing format
+enum ChunkType : uint8_t {
+    Compressed = 0x00,
+    Uncompressed = 0x01,
+    FirstReservedUnskippable = 0x02,
+    FirstReservedSkippable = 0x80,
+    Padding = 0xfe,
+    StreamIdentifierType = 0xff
+};
+
+/// Each chunk starts with a 1 byte type followed by a 3 byte length
+static constexpr size_t HeaderSize = 4;
+/// The data chunks start with the masked CRC32C of the uncompressed data
+static constexpr size_t ChecksumSize = 4;
+
+static uint32_t decodeLittleEndian(std::string_view data, size_t nbytes) {
+    uint32_t ret = 0;
+    for (size_t ii = 0; ii < nbytes; ++ii) {
+        ret |= uint32_t(uint8_t(data[ii])) << (ii * 8);
+    }
+    return ret;
+}
+
+static void encodeLittleEndian(char* dest, uint32_t value, size_t nbytes) {
+    for (size_t ii = 0; ii < nbytes; ++ii) {
+        dest[ii] = static_cast<char>((value >> (ii * 8)) & 0xff);
+    }
+}
+
+/// The maximum length of a chunk containing (compressed) data
+static size_t getMaxDataChunkLength() {
+    static const size_t length =
+            ChecksumSize + getMaxCompressedLength(folly::io::CodecType::SNAPPY,
+                                                  MaxChunkSize);
+    return length;
+}
+
+SnappyFramedSink::SnappyFramedSink(std::unique_ptr<cb::io::Sink> underlying)
+    : underlying(std::move(underlying)) {
+    if (!this->underlying) {
+        throw std::invalid_argument(
+                "SnappyFramedSink: underlying sink must be specified");
+    }
+    pending.reserve(MaxChunkSize);
+}
+
+SnappyFramedSink::~SnappyFramedSink() {
+    if (!closed) {
+        try {
+            close();
+        } catch (const std::exception&) {
+            // ignore
+        }
+    }
+}
+
+void SnappyFramedSink::sink(std::string_view data) {
+    if (closed) {
+        throw std::logic_error("SnappyFramedSink::sink(): stream is closed");
+    }
+    bytes_consumed += data.size();
+
+    // Top up the pending chunk first
+    if (!pending.empty()) {
+        const auto nbytes =
+                std::min(MaxChunkSize - pending.size(), data.size());
+        pending.append(data.data(), nbytes);
+        data.remove_prefix(nbytes);
+        if (pending.size() == MaxChunkSize) {
+            flushChunk();
+        }
+    }
+
+    // Compress full chunks directly from the input without copying
+    while (data.size() >= MaxChunkSize) {
+        writeChunk(data.substr(0, MaxChunkSize));
+        data.remove_prefix(MaxChunkSize);
+    }
+
+    pending.append(data);
+}
+
+std::size_t SnappyFramedSink::fsync() {
+    flushChunk();
+    return underlying->fsync();
+}
+
+std::size_t SnappyFramedSink::close() {
+    if (closed) {
+        return getBytesWritten();
+    }
+    flushChunk();
+    if (!stream_identifier_written) {
+        // An empty stream still needs the stream identifier
+        underlying->sink(StreamIdentifier);
+        stream_identifier_written = true;
+    }
+    closed = true;
+    return underlying->close();
+}
+
+void SnappyFramedSink::flushChunk() {
+    if (!pending.empty()) {
+        writeChunk(pending);
+        pending.clear();
+    }
+}
+
+void SnappyFramedSink::writeChunk(std::string_view data) {
+    if (!stream_identifier_written) {
+        underlying->sink(StreamIdentifier);
+        stream_identifier_written = true;
+    }
+
+    if (!deflateSnappy(data, compressed)) {
+        throw std::runtime_error(
+                "SnappyFramedSink::writeChunk(): Failed to deflate data");
+    }
+
+    // Store the data uncompressed unless compression saves at least 12.5%
+    // (as recommended by the specification) to make decompression cheaper
+    ChunkType type = Uncompressed;
+    std::string_view payload = data;
+    if (compressed.size() < data.size() - data.size() / 8) {
+        type = Compressed;
+        payload = compressed;
+    }
+
+    frame.resize(HeaderSize + ChecksumSize);
+    frame[0] = static_cast<char>(type);
+    encodeLittleEndian(frame.data() + 1,
+                       uint32_t(ChecksumSize + payload.size()),
+                       HeaderSize - 1);
+    encodeLittleEndian(frame.data() + HeaderSize,
+                       maskChecksum(crc32c(data)),
+                       ChecksumSize);
+    frame.append(payload);
+    underlying->sink(frame);
+}
+
+void SnappyFramedDecoder::feed(std::string_view data,
+                               const Callback& callback) {
+    while (!data.empty()) {
+        if (skip) {
+            const auto nbytes = std::min(skip, data.size());
+            skip -= nbytes;
+            data.remove_prefix(nbytes);
+            continue;
+        }
+
+        if (!pending.empty()) {
+            // Complete the header first, and then the chunk
+            size_t wanted = HeaderSize;
+            if (pending.size() >= HeaderSize) {
+                wanted += decodeLittleEndian(
+                        std::string_view{pending}.substr(1), HeaderSize - 1);
+            }
+            const auto nbytes = std::min(wanted - pending.size(), data.size());
+            pending.append(data.data(), nbytes);
+            data.remove_prefix(nbytes);
+            if (decodeChunk(pending, callback)) {
+                pending.clear();
+            }
+            continue;
+        }
+
+        const auto nbytes = decodeChunk(data, callback);
+        if (nbytes == 0) {
+            // Partial chunk; decodeChunk() validated the chunk length (if
+            // the header is present) so this is bounded by the max chunk size
+            pending.assign(data);
+            return;
+        }
+        data.remove_prefix(nbytes);
+    }
+}
+
+std::size_t SnappyFramedDecoder::decodeChunk(std::string_view data,
+                                             const Callback& callback) {
+    if (data.size() < HeaderSize) {
+        return 0;
+    }
+
+    const auto type = static_cast<uint8_t>(data.front());
+    const auto length = decodeLittleEndian(data.substr(1), HeaderSize - 1);
+
+    if (type != StreamIdentifierType && !stream_identifier_seen) {
+        throw std::runtime_error(fmt::format(
+                "SnappyFramedDecoder: Expected stream identifier, got chunk "
+                "type {:#x}",
+                type));
+    }
+
+    if (type >= FirstReservedSkippable && type <= Padding) {
+        // Skip the chunk without buffering it (it may be up to 16MiB)
+        skip = length;
+        return HeaderSize;
+    }
+
+    if (type >= FirstReservedUnskippable && type < FirstReservedSkippable) {
+        throw std::runtime_error(fmt::format(
+                "SnappyFramedDecoder: Reserved unskippable chunk type {:#x}",
+                type));
+    }
+
+    size_t max_length = getMaxDataChunkLength();
+    if (type == StreamIdentifierType) {
+        max_length = StreamIdentifier.size() - HeaderSize;
+    } else if (type == Uncompressed) {
+        max_length = ChecksumSize + MaxChunkSize;
+    }
+    if (length > max_length) {
+        throw std::runtime_error(fmt::format(
+                "SnappyFramedDecoder: Chunk length {} exceeds max: {}",
+                length,
+                max_length));
+    }
+
+    if (data.size() < HeaderSize + length) {
+        return 0;
+    }
+
+    processChunk(type, data.substr(HeaderSize, length), callback);
+    return HeaderSize + length;
+}
+
+void SnappyFramedDecoder::processChunk(uint8_t type,
+                                       std::string_view payload,
+                                       const Callback& callback) {
+    if (type == StreamIdentifierType) {
+        if (payload != StreamIdentifier.substr(HeaderSize)) {
+            throw std::runtime_error(
+                    "SnappyFramedDecoder: Invalid stream identifier");
+        }
+        stream_identifier_seen = true;
+        return;
+    }
+
+    if (payload.size() < ChecksumSize) {
+        throw std::runtime_error(fmt::format(
+                "SnappyFramedDecoder: Chunk too short for checksum: {}",
+                payload.size()));
+    }
+    const auto checksum = decodeLittleEndian(payload, ChecksumSize);
+    payload.remove_prefix(ChecksumSize);
+
+    std::string_view content = payload;
+    if (type == Compressed) {
+        if (!inflateSnappy(payload, inflated, MaxChunkSize)) {
+            throw std::runtime_error(
+                    "SnappyFramedDecoder: Failed to inflate chunk");
+        }
+        content = inflated;
+    }
+
+    const auto actual = maskChecksum(crc32c(content));
+    if (actual != checksum) {
+        throw std::runtime_error(fmt::format(
+                "SnappyFramedDecoder: Checksum mismatch. Expected {:#x}, got "
+                "{:#x}",
+                checksum,
+                actual));
+    }
+    bytes_produced += content.size();
+    callback(content);
+}
+
+} // namespace cb::compression
@@ -0,0 +1,64 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <JSON_checker.h>
+#include <platform/compress.h>
+#include <platform/compression/context.h>
+#include <platform/compression/validate.h>
+
+#include <stdexcept>
+
+namespace cb::compression {
+
+InflateValidateResult inflateAndValidateJson(
+        folly::io::CodecType type,
+        std::string_view input,
+        Buffer& output,
+        size_t max_inflated_size,
+        JSON_checker::Validator& validator) {
+    validator.begin();
+    const auto callback = [&validator](std::string_view block) {
+        validator.feed(block);
+    };
+
+    bool inflated;
+    switch (type) {
+    case folly::io::CodecType::ZLIB:
+        inflated = Context::getThreadLocal().inflateZlib(
+                input,
+                output,
+                max_inflated_size,
+                JsonValidationBlockSize,
+                callback);
+        break;
+    case folly::io::CodecType::ZSTD:
+        inflated = Context::getThreadLocal().inflateZstd(
+                input, output, max_inflated_size, callback);
+        break;
+    case folly::io::CodecType::SNAPPY:
+    case folly::io::CodecType::LZ4:
+        if (!inflate(type, input, output, max_inflated_size)) {
+            return InflateValidateResult::InflateFailed;
+        }
+        return validator.validate(output) ? InflateValidateResult::Json
+                                          : InflateValidateResult::NotJson;
+    default:
+        throw std::invalid_argument(
+                "cb::compression::inflateAndValidateJson(): type must be "
+                "SNAPPY, ZLIB, ZSTD or LZ4");
+    }
+
+    if (!inflated) {
+        return InflateValidateResult::InflateFailed;
+    }
+    return validator.finish() ? InflateValidateResult::Json
+                              : InflateValidateResult::NotJson;
+}
+
+} // namespace cb::compression
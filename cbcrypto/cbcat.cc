@@ -16,8 +16,10 @@
 #include <platform/dirutils.h>
 #include <platform/getpass.h>
 #include <cstdlib>
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <thread>
 
 #ifdef WIN32
 #define INSTALL_ROOT "C:/Program Files/Couchbase/Server"
@@ -35,6 +37,7 @@ static std::unique_ptr<DumpKeysRunner> dump_keys_runner;
 static KeyStore keyStore;
 bool printHeader = false;
 bool dumpEncryptionHeader = false;
+bool verifyOnly = false;
 
 /// The key lookup callback gets called from the FileReader whenever it
 /// encounters an encrypted file. It'll keep the keys around in a key store
@@ -160,6 +163,29 @@ void print_header(std::string_view filename,
     std::cout << std::string(70, '=') << std::endl;
 }
 
+/// Verify the provided files and print the result for each file
+static int verifyFiles(const std::vector<std::string_view>& files) {
+    const auto threads = std::max(1U, std::thread::hardware_concurrency());
+    int ret = EXIT_SUCCESS;
+    for (const auto& file : files) {
+        try {
+            const auto result =
+                    FileReader::verify(file, key_lookup_callback, threads);
+            fmt::println("{}: OK ({} chunks, {} bytes)",
+                         file,
+                         result.chunks,
+                         result.bytes);
+        } catch (const cb::crypto::dump_keys::IncorrectPasswordError& e) {
+            std::cerr << e.what() << std::endl;
+            std::exit(EXIT_INCORRECT_PASSWORD);
+        } catch (const std::exception& e) {
+            fmt::println("{}: FAILED: {}", file, e.what());
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
+}
+
 int main(int argc, char** argv) {
     using cb::getopt::Argument;
     cb::getopt::CommandLineOptionsParser parser;
@@ -254,6 +280,10 @@ int main(int argc, char** argv) {
              "dump-encryption-header",
              "Print the information from the encryption header if the file is "
              "encrypted"});
+    parser.addOption({[](auto value) { verifyOnly = true; },
+                      "verify",
+                      "Verify the integrity of the encrypted file(s) instead "
+                      "of printing the content"});
     parser.addOption({[](auto) {
                           std::cout << "Couchbase Server " << PRODUCT_VERSION
                                     << std::endl;
@@ -273,6 +303,10 @@ int main(int argc, char** argv) {
                 DumpKeysRunner::create(password, dumpKeysExecutable, gosecrets);
     }
 
+    if (verifyOnly) {
+        return verifyFiles(arguments);
+    }
+
     for (const auto& file : arguments) {
         bool header_printed = false;
         auto do_print_header =
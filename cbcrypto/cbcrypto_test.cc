@@ -17,16 +17,22 @@
 #include "platform/dirutils.h"
 #include "platform/string_hex.h"
 
+#include <cbcrypto/derived_key_cache.h>
 #include <cbcrypto/digest.h>
+#include <cbcrypto/encrypted_file_header.h>
 #include <cbcrypto/key_derivation.h>
 #include <cbcrypto/random_gen.h>
 #include <cbcrypto/symmetric.h>
 
+#include <fmt/format.h>
 #include <folly/portability/GTest.h>
 #include <nlohmann/json.hpp>
 #include <platform/base64.h>
+#include <atomic>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 std::vector<uint8_t> string2vector(const std::string& str) {
     std::vector<uint8_t> ret(str.size());
@@ -299,14 +305,13 @@ TEST(Crypt, ns_server_password_encoding) {
                                                   pwent.size()}));
 }
 
-// https://csrc.nist.gov/projects/cryptographic-algorithm-validation-program/
-// cavp-testing-block-cipher-modes
-static void testAes256Gcm(std::string_view key64,
-                          std::string_view nonce64,
-                          std::string_view ct64,
-                          std::string_view mac64,
-                          std::string_view msg64,
-                          std::string_view ad64) {
+static void testAead(cb::crypto::Cipher type,
+                     std::string_view key64,
+                     std::string_view nonce64,
+                     std::string_view ct64,
+                     std::string_view mac64,
+                     std::string_view msg64,
+                     std::string_view ad64) {
     const auto key = cb::base64::decode(key64);
     const auto nonce = cb::base64::decode(nonce64);
     const auto ct = cb::base64::decode(ct64);
@@ -314,8 +319,7 @@ static void testAes256Gcm(std::string_view key64,
     const auto msg = cb::base64::decode(msg64);
     const auto ad = cb::base64::decode(ad64);
 
-    auto cipher = cb::crypto::SymmetricCipher::create(
-            cb::crypto::Cipher::AES_256_GCM, key);
+    auto cipher = cb::crypto::SymmetricCipher::create(type, key);
 
     std::string buf = ct;
     cipher->decrypt(nonce, buf, mac, buf, ad);
@@ -334,6 +338,23 @@ static void testAes256Gcm(std::string_view key64,
             cb::base64::encode(cipher->decrypt(cipher->encrypt(msg, ad), ad)));
 }
 
+// https://csrc.nist.gov/projects/cryptographic-algorithm-validation-program/
+// cavp-testing-block-cipher-modes
+static void testAes256Gcm(std::string_view key64,
+                          std::string_view nonce64,
+                          std::string_view ct64,
+                          std::string_view mac64,
+                          std::string_view msg64,
+                          std::string_view ad64) {
+    testAead(cb::crypto::Cipher::AES_256_GCM,
+             key64,
+             nonce64,
+             ct64,
+             mac64,
+             msg64,
+             ad64);
+}
+
 TEST(Aes256Gcm, Empty) {
     testAes256Gcm("9aKyfHQ1WHLrPvbF/q+qdA5q6ZDZ1Iw72buCNeWJ8BA=",
                   "WNIkD1gKMcHSSUjp",
@@ -414,6 +435,109 @@ TEST(Aes256Gcm, IntegerNonce) {
     EXPECT_EQ(msg, decrypted);
 }
 
+/// The cipher contexts are reused between messages; verify that the state
+/// from one message (or a failed verification) doesn't leak into the next
+TEST(Aes256Gcm, ReuseContexts) {
+    auto cipher = cb::crypto::SymmetricCipher::create(
+            cb::crypto::Cipher::AES_256_GCM, std::string(32, 'k'));
+    for (int ii = 0; ii < 10; ++ii) {
+        const auto msg = fmt::format("message {}", ii);
+        const auto ad = fmt::format("ad {}", ii);
+        auto ct = cipher->encrypt(msg, ad);
+        EXPECT_EQ(msg, cipher->decrypt(ct, ad));
+        EXPECT_THROW(cipher->decrypt(ct, "wrong ad"),
+                     cb::crypto::MacVerificationError);
+        ct.back() ^= 1;
+        EXPECT_THROW(cipher->decrypt(ct, ad),
+                     cb::crypto::MacVerificationError);
+    }
+}
+
+TEST(Aes256Gcm, ConcurrentUse) {
+    auto cipher = cb::crypto::SymmetricCipher::create(
+            cb::crypto::Cipher::AES_256_GCM, std::string(32, 'k'));
+    std::vector<std::thread> threads;
+    std::atomic<int> failures{0};
+    for (int tt = 0; tt < 4; ++tt) {
+        threads.emplace_back([&cipher, &failures, tt]() {
+            for (int ii = 0; ii < 100; ++ii) {
+                const auto msg = fmt::format("thread {} message {}", tt, ii);
+                if (cipher->decrypt(cipher->encrypt(msg)) != msg) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(0, failures);
+}
+
+// RFC 8439 section 2.8.2
+TEST(ChaCha20Poly1305, PlaintextWithAD) {
+    constexpr auto key = "gIGCg4SFhoeIiYqLjI2Oj5CRkpOUlZaXmJmam5ydnp8=";
+    constexpr auto nonce = "BwAAAEBBQkNERUZH";
+    constexpr auto ct =
+            "0xqNNGSOYNt7hq+8U+9+wqSt7VEpbgj+qeK1pzbuYtY9vqRejKlnEoL6+2naknKLGn"
+            "HeCp4GCykF1qW2fs07NpLdvX8td4uMmAOu4ygJG1j6syTk+tZ1lFWFgItIMde8P/"
+            "Te8I5Lep3ldtJlhs7GS2EW";
+    constexpr auto msg =
+            "TGFkaWVzIGFuZCBHZW50bGVtZW4gb2YgdGhlIGNsYXNzIG9mICc5OTogSWYgSSBj"
+            "b3VsZCBvZmZlciB5b3Ugb25seSBvbmUgdGlwIGZvciB0aGUgZnV0dXJlLCBzdW5z"
+            "Y3JlZW4gd291bGQgYmUgaXQu";
+    constexpr auto ad = "UFFSU8DBwsPExcbH";
+    testAead(cb::crypto::Cipher::ChaCha20_Poly1305,
+             key,
+             nonce,
+             ct,
+             "GuELWU8J4mp+kC7L0GAGkQ==",
+             msg,
+             ad);
+    EXPECT_THROW(testAead(cb::crypto::Cipher::ChaCha20_Poly1305,
+                          key,
+                          nonce,
+                          ct,
+                          "GuELWU8J4mp+kC7L0GAGkA==",
+                          msg,
+                          ad),
+                 cb::crypto::MacVerificationError);
+}
+
+TEST(ChaCha20Poly1305, ReuseContexts) {
+    using cb::crypto::Cipher;
+    using cb::crypto::SymmetricCipher;
+    EXPECT_EQ(Cipher::ChaCha20_Poly1305,
+              cb::crypto::to_cipher("ChaCha20-Poly1305"));
+    EXPECT_EQ("ChaCha20-Poly1305", format_as(Cipher::ChaCha20_Poly1305));
+    EXPECT_EQ(32U, SymmetricCipher::getKeySize(Cipher::ChaCha20_Poly1305));
+    EXPECT_EQ(12U, SymmetricCipher::getNonceSize(Cipher::ChaCha20_Poly1305));
+    EXPECT_EQ(16U, SymmetricCipher::getMacSize(Cipher::ChaCha20_Poly1305));
+
+    auto cipher = SymmetricCipher::create(
+            Cipher::ChaCha20_Poly1305,
+            SymmetricCipher::generateKey(Cipher::ChaCha20_Poly1305));
+    for (int ii = 0; ii < 10; ++ii) {
+        const auto msg = fmt::format("message {}", ii);
+        const auto ad = fmt::format("ad {}", ii);
+        auto ct = cipher->encrypt(msg, ad);
+        EXPECT_EQ(msg, cipher->decrypt(ct, ad));
+        EXPECT_THROW(cipher->decrypt(ct, "wrong ad"),
+                     cb::crypto::MacVerificationError);
+        ct.back() ^= 1;
+        EXPECT_THROW(cipher->decrypt(ct, ad),
+                     cb::crypto::MacVerificationError);
+    }
+}
+
+TEST(SymmetricCipher, PreferredCipher) {
+    using cb::crypto::SymmetricCipher;
+    const auto preferred = SymmetricCipher::getPreferredCipher();
+    EXPECT_NE(cb::crypto::Cipher::None, preferred);
+    // The result is cached
+    EXPECT_EQ(preferred, SymmetricCipher::getPreferredCipher());
+}
+
 // https://csrc.nist.gov/Projects/Cryptographic-Algorithm-Validation-Program/
 // Key-Derivation
 static void testKeyDerivationNIST(std::string_view derived64,
@@ -483,6 +607,71 @@ TEST(KeyDerivation, LabelAndContext) {
                       "context/1");
 }
 
+TEST(DerivedKeyCache, Get) {
+    cb::crypto::DerivedKeyCache cache(2);
+    const auto kdk = cb::crypto::KeyDerivationKey::generate();
+    const cb::crypto::EncryptedFileHeader header(
+            kdk->id,
+            cb::crypto::KeyDerivationMethod::KeyBased,
+            cb::crypto::Compression::None);
+    int calls = 0;
+    auto derive = [&calls]() {
+        ++calls;
+        return fmt::format("key {}", calls);
+    };
+
+    EXPECT_EQ("key 1", cache.get(header, *kdk, derive));
+    EXPECT_EQ("key 1", cache.get(header, *kdk, derive));
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(1, cache.get_hits());
+    EXPECT_EQ(1, cache.get_misses());
+
+    // Another file (salt) uses another key
+    const cb::crypto::EncryptedFileHeader other(
+            kdk->id,
+            cb::crypto::KeyDerivationMethod::KeyBased,
+            cb::crypto::Compression::None);
+    EXPECT_EQ("key 2", cache.get(other, *kdk, derive));
+
+    // The same id with different key material (e.g. password based keys
+    // which all use the same id) must not share keys
+    auto copy = std::make_unique<cb::crypto::KeyDerivationKey>(*kdk);
+    copy->derivationKey.back() ^= 1;
+    EXPECT_EQ("key 3", cache.get(header, *copy, derive));
+
+    // The capacity is 2 so the first key was evicted
+    EXPECT_EQ(2, cache.size());
+    EXPECT_EQ("key 4", cache.get(header, *kdk, derive));
+
+    cache.invalidate(kdk->id);
+    EXPECT_EQ(0, cache.size());
+    EXPECT_EQ("key 5", cache.get(header, *kdk, derive));
+
+    cache.set_capacity(0);
+    EXPECT_EQ(0, cache.size());
+    EXPECT_EQ("key 6", cache.get(header, *kdk, derive));
+    EXPECT_EQ(0, cache.size());
+}
+
+TEST(DerivedKeyCache, DeriveKey) {
+    auto kdk = cb::crypto::KeyDerivationKey::generate();
+    kdk->derivationMethod = cb::crypto::KeyDerivationMethod::PasswordBased;
+    cb::crypto::EncryptedFileHeader header(
+            kdk->id,
+            cb::crypto::KeyDerivationMethod::PasswordBased,
+            cb::crypto::Compression::None);
+    header.set_pbkdf_iterations(128 * 1024);
+
+    auto& cache = cb::crypto::DerivedKeyCache::instance();
+    const auto hits = cache.get_hits();
+    const auto key = header.derive_key(*kdk);
+    EXPECT_EQ(key, header.derive_key(*kdk));
+    EXPECT_EQ(hits + 1, cache.get_hits());
+
+    cache.clear();
+    EXPECT_EQ(key, header.derive_key(*kdk));
+}
+
 TEST(RandomBitGenerator, Generate) {
     auto drbg = cb::crypto::RandomBitGenerator::create();
     std::string initial(40, 'x');
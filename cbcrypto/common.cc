@@ -41,6 +41,8 @@ std::string format_as(const KeyDerivationMethod& keyDerivationMethod) {
         return "None";
     case Cipher::AES_256_GCM:
         return "AES-256-GCM";
+    case Cipher::ChaCha20_Poly1305:
+        return "ChaCha20-Poly1305";
     }
     throw std::invalid_argument(
             fmt::format("format_as(const Cipher& cipher): unknown cipher: {}",
@@ -51,6 +53,9 @@ std::string format_as(const KeyDerivationMethod& keyDerivationMethod) {
     if (name == "AES-256-GCM") {
         return Cipher::AES_256_GCM;
     }
+    if (name == "ChaCha20-Poly1305") {
+        return Cipher::ChaCha20_Poly1305;
+    }
     if (name == "None") {
         return Cipher::None;
     }
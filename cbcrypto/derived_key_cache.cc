@@ -0,0 +1,127 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <cbcrypto/derived_key_cache.h>
+
+#include <cbcrypto/digest.h>
+#include <cbcrypto/encrypted_file_header.h>
+
+namespace cb::crypto {
+
+static std::string generateFingerprintKey() {
+    std::string ret(SHA256_DIGEST_SIZE, '\0');
+    randomBytes(ret);
+    return ret;
+}
+
+DerivedKeyCache& DerivedKeyCache::instance() {
+    static DerivedKeyCache cache;
+    return cache;
+}
+
+DerivedKeyCache::DerivedKeyCache(std::size_t capacity)
+    : fingerprint_key(generateFingerprintKey()), capacity(capacity) {
+}
+
+std::string DerivedKeyCache::make_key(const EncryptedFileHeader& header,
+                                      const KeyDerivationKey& kdk) const {
+    const auto method = header.get_key_derivation();
+    const auto iterations = method == KeyDerivationMethod::PasswordBased
+                                    ? header.get_pbkdf_iterations()
+                                    : 0U;
+    const auto salt = header.get_salt();
+
+    std::string ret{kdk.id};
+    ret.push_back('\0');
+    ret.push_back(static_cast<char>(header.get_cipher()));
+    ret.push_back(static_cast<char>(method));
+    ret.append(reinterpret_cast<const char*>(&iterations), sizeof(iterations));
+    ret.append(reinterpret_cast<const char*>(salt.data()), salt.size());
+    // Don't keep (a plain hash of) the key material around
+    ret.append(HMAC(Algorithm::SHA256, fingerprint_key, kdk.derivationKey));
+    return ret;
+}
+
+std::string DerivedKeyCache::get(const EncryptedFileHeader& header,
+                                 const KeyDerivationKey& kdk,
+                                 const std::function<std::string()>& derive) {
+    auto key = make_key(header, kdk);
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto iter = index.find(key);
+        if (iter != index.end()) {
+            ++hits;
+            // Move the entry to the front
+            entries.splice(entries.begin(), entries, iter->second);
+            return std::string{std::string_view{iter->second->derived}};
+        }
+        ++misses;
+    }
+
+    // Derive the key without holding the lock (it may be slow)
+    auto derived = derive();
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (capacity == 0 || index.count(key)) {
+        // Caching is disabled, or another thread derived the key
+        return derived;
+    }
+    entries.push_front({std::move(key), kdk.id, SecretString{derived}});
+    index[entries.front().key] = entries.begin();
+    prune();
+    return derived;
+}
+
+void DerivedKeyCache::invalidate(std::string_view id) {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto iter = entries.begin(); iter != entries.end();) {
+        if (iter->id == id) {
+            index.erase(iter->key);
+            iter = entries.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void DerivedKeyCache::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    index.clear();
+    entries.clear();
+}
+
+void DerivedKeyCache::set_capacity(std::size_t value) {
+    std::lock_guard<std::mutex> guard(mutex);
+    capacity = value;
+    prune();
+}
+
+std::size_t DerivedKeyCache::size() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return entries.size();
+}
+
+std::size_t DerivedKeyCache::get_hits() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return hits;
+}
+
+std::size_t DerivedKeyCache::get_misses() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return misses;
+}
+
+void DerivedKeyCache::prune() {
+    while (entries.size() > capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+} // namespace cb::crypto
@@ -9,6 +9,7 @@
  */
 #include <cbcrypto/encrypted_file_header.h>
 
+#include <cbcrypto/derived_key_cache.h>
 #include <cbcrypto/digest.h>
 #include <cbcrypto/key_derivation.h>
 #include <cbcrypto/symmetric.h>
@@ -23,6 +24,9 @@ constexpr auto CEF_KDF_LABEL = "Couchbase File Encryption";
 constexpr auto CEF_KDF_CONTEXT = "Couchbase Encrypted File/";
 /// Multiplier for calculating the number of PBKDF2 iterations
 constexpr unsigned int CEF_ITERATION_MULTIPLIER = 1024;
+/// The values for the cipher in the header (version 2)
+constexpr uint8_t CEF_CIPHER_AES_256_GCM = 0;
+constexpr uint8_t CEF_CIPHER_CHACHA20_POLY1305 = 1;
 
 std::string format_as(Compression compression) {
     switch (compression) {
@@ -66,13 +70,51 @@ bool EncryptedFileHeader::is_encrypted() const {
 }
 
 bool EncryptedFileHeader::is_supported() const {
-    return version <= 1 && is_encrypted();
+    if (version == 2 && cipher != CEF_CIPHER_AES_256_GCM &&
+        cipher != CEF_CIPHER_CHACHA20_POLY1305) {
+        return false;
+    }
+    return version <= 2 && is_encrypted();
 }
 
 Compression EncryptedFileHeader::get_compression() const {
     return static_cast<Compression>(compression);
 }
 
+Cipher EncryptedFileHeader::get_cipher() const {
+    // Files before version 2 don't store the cipher and always use
+    // AES-256-GCM
+    if (version < 2 || cipher == CEF_CIPHER_AES_256_GCM) {
+        return Cipher::AES_256_GCM;
+    }
+    if (cipher == CEF_CIPHER_CHACHA20_POLY1305) {
+        return Cipher::ChaCha20_Poly1305;
+    }
+    throw NotSupportedException(fmt::format(
+            "cb::crypto::EncryptedFileHeader::get_cipher: Unknown cipher: {}",
+            cipher));
+}
+
+void EncryptedFileHeader::set_cipher(Cipher cipher_) {
+    switch (cipher_) {
+    case Cipher::AES_256_GCM:
+        // Leave the version untouched so that the file may be read by
+        // versions which don't know about the cipher field
+        cipher = CEF_CIPHER_AES_256_GCM;
+        return;
+    case Cipher::ChaCha20_Poly1305:
+        cipher = CEF_CIPHER_CHACHA20_POLY1305;
+        version = 2;
+        return;
+    case Cipher::None:
+        break;
+    }
+    throw NotSupportedException(fmt::format(
+            "cb::crypto::EncryptedFileHeader::set_cipher: Cipher {} not "
+            "supported",
+            cipher_));
+}
+
 KeyDerivationMethod EncryptedFileHeader::get_key_derivation() const {
     return static_cast<KeyDerivationMethod>(key_derivation & 0xf);
 }
@@ -103,31 +145,41 @@ cb::uuid::uuid_t EncryptedFileHeader::get_salt() const {
     return ret;
 }
 
-std::string EncryptedFileHeader::derive_key(
-        const cb::crypto::KeyDerivationKey& kdk) const {
-    if (version == 0) {
-        return kdk.derivationKey;
-    }
-    if (version != 1) {
-        throw std::invalid_argument(
-                "cb::crypto::EncryptedFileHeader::derive_key: invalid version");
-    }
-    switch (get_key_derivation()) {
+/// Run the key derivation function for the file with the provided header
+static std::string deriveFileKey(const EncryptedFileHeader& header,
+                                 const cb::crypto::KeyDerivationKey& kdk) {
+    switch (header.get_key_derivation()) {
     case KeyDerivationMethod::NoDerivation:
         return kdk.derivationKey;
     case KeyDerivationMethod::KeyBased:
-        return deriveKey(SymmetricCipher::getKeySize(kdk.cipher),
+        return deriveKey(SymmetricCipher::getKeySize(header.get_cipher()),
                          kdk.derivationKey,
                          CEF_KDF_LABEL,
-                         CEF_KDF_CONTEXT + ::to_string(get_salt()));
+                         CEF_KDF_CONTEXT + ::to_string(header.get_salt()));
     case KeyDerivationMethod::PasswordBased:
         return PBKDF2_HMAC(Algorithm::SHA256,
                            kdk.derivationKey,
-                           CEF_KDF_CONTEXT + ::to_string(get_salt()),
-                           get_pbkdf_iterations());
+                           CEF_KDF_CONTEXT + ::to_string(header.get_salt()),
+                           header.get_pbkdf_iterations());
     }
     throw std::invalid_argument(
             "cb::crypto::EncryptedFileHeader::derive_key: invalid kdf");
 }
 
+std::string EncryptedFileHeader::derive_key(
+        const cb::crypto::KeyDerivationKey& kdk) const {
+    if (version == 0) {
+        return kdk.derivationKey;
+    }
+    if (version != 1 && version != 2) {
+        throw std::invalid_argument(
+                "cb::crypto::EncryptedFileHeader::derive_key: invalid version");
+    }
+    if (get_key_derivation() == KeyDerivationMethod::NoDerivation) {
+        return kdk.derivationKey;
+    }
+    return DerivedKeyCache::instance().get(
+            *this, kdk, [this, &kdk]() { return deriveFileKey(*this, kdk); });
+}
+
 } // namespace cb::crypto
@@ -0,0 +1,123 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#include "encrypted_file_index.h"
+#include "encrypted_file_associated_data.h"
+
+#include <cbcrypto/symmetric.h>
+#include <gsl/gsl-lite.hpp>
+#include <platform/socket.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace cb::crypto {
+
+std::filesystem::path EncryptedFileIndex::get_path(
+        const std::filesystem::path& file) {
+    return file.string() + ".idx";
+}
+
+std::optional<EncryptedFileIndex> EncryptedFileIndex::decode(
+        std::string_view data,
+        const EncryptedFileHeader& header,
+        SymmetricCipher& cipher) {
+    // The index must start with the header of the file it belongs to (the
+    // salt is unique for each file)
+    const std::string_view expected = header;
+    if (data.size() < expected.size() + sizeof(uint32_t) ||
+        data.substr(0, expected.size()) != expected) {
+        return std::nullopt;
+    }
+    data.remove_prefix(expected.size());
+
+    uint32_t size;
+    std::memcpy(&size, data.data(), sizeof(size));
+    data.remove_prefix(sizeof(size));
+    if (ntohl(size) != data.size()) {
+        return std::nullopt;
+    }
+
+    EncryptedFileAssociatedData ad(header);
+    ad.set_offset(IndexOffset);
+    const auto content = cipher.decrypt(data, ad);
+    if (content.empty() || content.size() % sizeof(Entry) != 0) {
+        return std::nullopt;
+    }
+
+    EncryptedFileIndex ret;
+    for (std::size_t ii = 0; ii < content.size(); ii += sizeof(Entry)) {
+        uint64_t content_offset;
+        uint64_t chunk_offset;
+        std::memcpy(&content_offset, content.data() + ii, sizeof(uint64_t));
+        std::memcpy(&chunk_offset,
+                    content.data() + ii + sizeof(uint64_t),
+                    sizeof(uint64_t));
+        try {
+            ret.add(ntohll(content_offset), ntohll(chunk_offset));
+        } catch (const std::invalid_argument&) {
+            return std::nullopt;
+        }
+    }
+    return ret;
+}
+
+std::string EncryptedFileIndex::encode(const EncryptedFileHeader& header,
+                                       SymmetricCipher& cipher) const {
+    std::string content;
+    content.reserve(entries.size() * sizeof(Entry));
+    for (const auto& entry : entries) {
+        const auto content_offset = htonll(entry.content_offset);
+        const auto chunk_offset = htonll(entry.chunk_offset);
+        content.append(reinterpret_cast<const char*>(&content_offset),
+                       sizeof(content_offset));
+        content.append(reinterpret_cast<const char*>(&chunk_offset),
+                       sizeof(chunk_offset));
+    }
+
+    EncryptedFileAssociatedData ad(header);
+    ad.set_offset(IndexOffset);
+    const auto encrypted = cipher.encrypt(content, ad);
+    const auto size = htonl(gsl::narrow<uint32_t>(encrypted.size()));
+
+    std::string ret{std::string_view{header}};
+    ret.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    ret.append(encrypted);
+    return ret;
+}
+
+void EncryptedFileIndex::add(uint64_t content_offset, uint64_t chunk_offset) {
+    if (!entries.empty() && (content_offset < entries.back().content_offset ||
+                             chunk_offset <= entries.back().chunk_offset)) {
+        throw std::invalid_argument(
+                "EncryptedFileIndex::add(): offsets must be increasing");
+    }
+    entries.push_back({content_offset, chunk_offset});
+}
+
+EncryptedFileIndex::Entry EncryptedFileIndex::find(
+        uint64_t content_offset) const {
+    Expects(!entries.empty());
+    if (content_offset >= entries.back().content_offset) {
+        return entries.back();
+    }
+    // The first entry with a content offset past the requested offset is
+    // the chunk after the one we want
+    auto iter = std::upper_bound(entries.begin(),
+                                 entries.end(),
+                                 content_offset,
+                                 [](uint64_t offset, const Entry& entry) {
+                                     return offset < entry.content_offset;
+                                 });
+    return *std::prev(iter);
+}
+
+} // namespace cb::crypto
@@ -0,0 +1,91 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#pragma once
+
+#include <cbcrypto/encrypted_file_header.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cb::crypto {
+
+class SymmetricCipher;
+
+/**
+ * The EncryptedFileIndex maps offsets in the (decrypted) content of an
+ * encrypted file to the offset of the chunk containing the data, allowing
+ * a reader to seek without decrypting the preceding chunks. See the Chunk
+ * index section in EncryptedFileFormat.md for the layout of the index file.
+ *
+ * The last entry is the end marker containing the total size of the
+ * content and the size of the file.
+ */
+class EncryptedFileIndex {
+public:
+    struct Entry {
+        /// The offset in the content of the first byte in the chunk
+        uint64_t content_offset;
+        /// The offset in the file of the chunk (its length field)
+        uint64_t chunk_offset;
+    };
+
+    /// The offset used in the associated data for the index
+    static constexpr uint64_t IndexOffset = UINT64_MAX;
+
+    /// Get the name of the index file for the provided file
+    static std::filesystem::path get_path(const std::filesystem::path& file);
+
+    /**
+     * Try to decode an index file
+     *
+     * @param data The content of the index file
+     * @param header The header of the file the index should belong to
+     * @param cipher The cipher to decrypt the index with
+     * @return The index or std::nullopt if the data isn't a valid index
+     *         for the file
+     */
+    static std::optional<EncryptedFileIndex> decode(
+            std::string_view data,
+            const EncryptedFileHeader& header,
+            SymmetricCipher& cipher);
+
+    /// Encode the index as an index file for the file with the header
+    [[nodiscard]] std::string encode(const EncryptedFileHeader& header,
+                                     SymmetricCipher& cipher) const;
+
+    /// Add the next entry (the offsets must be increasing)
+    void add(uint64_t content_offset, uint64_t chunk_offset);
+
+    /**
+     * Find the chunk containing the provided content offset
+     *
+     * @return The entry for the chunk, or the end marker if the offset is
+     *         at (or past) the end of the content
+     */
+    [[nodiscard]] Entry find(uint64_t content_offset) const;
+
+    /// Get the end marker
+    [[nodiscard]] const Entry& back() const {
+        return entries.back();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return entries.empty();
+    }
+
+protected:
+    std::vector<Entry> entries;
+};
+
+} // namespace cb::crypto
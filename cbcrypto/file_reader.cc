@@ -9,6 +9,7 @@
  */
 
 #include "encrypted_file_associated_data.h"
+#include "encrypted_file_index.h"
 
 #include <cbcrypto/common.h>
 #include <cbcrypto/encrypted_file_header.h>
@@ -17,12 +18,22 @@
 #include <fcntl.h>
 #include <fmt/format.h>
 #include <folly/compression/Compression.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/futures/Future.h>
+#include <folly/portability/SysStat.h>
 #include <platform/cb_time.h>
 #include <platform/compress.h>
+#include <platform/compression/snappy_stream.h>
 #include <platform/dirutils.h>
+#include <platform/io_hint.h>
 #include <platform/socket.h>
 #include <platform/string_utilities.h>
 #include <zlib.h>
+#include <deque>
+#include <vector>
 
 #ifdef WIN32
 #ifndef O_BINARY
@@ -56,6 +67,16 @@ std::string FileReader::read() {
     return ret;
 }
 
+void FileReader::seek(std::size_t) {
+    throw NotSupportedException(
+            "FileReader::seek(): Random access is not supported");
+}
+
+std::size_t FileReader::pread(std::span<uint8_t> buffer, std::size_t offset) {
+    seek(offset);
+    return read(buffer);
+}
+
 struct FileStreamDeleter {
     void operator()(FILE* fp) {
         fclose(fp);
@@ -102,6 +123,25 @@ public:
         return feof(fp.get());
     }
 
+    void seek(std::size_t offset) override {
+#ifdef WIN32
+        const auto rc = _fseeki64(fp.get(), offset, SEEK_SET);
+#else
+        const auto rc = fseeko(fp.get(), static_cast<off_t>(offset), SEEK_SET);
+#endif
+        if (rc == -1) {
+            throw std::system_error(
+                    errno,
+                    std::system_category(),
+                    fmt::format("FileStreamReader::seek({}): fseek failed",
+                                offset));
+        }
+    }
+
+    [[nodiscard]] const std::filesystem::path& get_path() const {
+        return path;
+    }
+
     [[nodiscard]] bool is_encrypted() const override {
         return false;
     }
@@ -228,16 +268,32 @@ protected:
     static constexpr std::size_t ChunkSize = 8192;
 };
 
+/**
+ * The EncryptedFileReader reads and decrypts the chunks of an encrypted
+ * file (see EncryptedFileFormat.md).
+ *
+ * By default each chunk is read and decrypted on the caller's thread when
+ * the data is needed. When read-ahead threads are requested the reader
+ * keeps up to ReadAheadPerThread chunks per thread (and at most
+ * default_read_ahead_budget bytes of encrypted data) in flight: the chunks
+ * are read from the file ahead of the consumer and verified and decrypted
+ * on a pool of worker threads, while the plaintext is handed out in file
+ * order. An error reading ahead is reported once the consumer reaches the
+ * failing chunk (just like the serial reader).
+ */
 class EncryptedFileReader : public FileReader {
 public:
     EncryptedFileReader(const KeyDerivationKey& kdk,
                         const EncryptedFileHeader& header_,
-                        std::unique_ptr<FileStreamReader> underlying)
+                        std::unique_ptr<FileStreamReader> underlying,
+                        std::size_t read_ahead_threads = 0)
         : header(header_),
           associated_data(header),
           offset(sizeof(EncryptedFileHeader)),
-          cipher(SymmetricCipher::create(kdk.cipher, header.derive_key(kdk))),
-          file(std::move(underlying)) {
+          cipher(SymmetricCipher::create(header.get_cipher(),
+                                         header.derive_key(kdk))),
+          file(std::move(underlying)),
+          max_read_ahead(read_ahead_threads * ReadAheadPerThread) {
         std::array<uint8_t, sizeof(EncryptedFileHeader)> buffer;
         const auto nr = file->read(buffer);
         if (nr != buffer.size()) {
@@ -250,6 +306,18 @@ public:
                                 file->eof()));
         }
         current_chunk = folly::IOBuf::createSeparate(1024);
+        if (read_ahead_threads) {
+            executor = std::make_unique<folly::CPUThreadPoolExecutor>(
+                    read_ahead_threads,
+                    std::make_shared<folly::NamedThreadFactory>("cb:decrypt"));
+        }
+    }
+
+    ~EncryptedFileReader() override {
+        if (executor) {
+            // The pending tasks use the cipher
+            executor->join();
+        }
     }
 
     [[nodiscard]] bool is_encrypted() const override {
@@ -266,7 +334,7 @@ public:
     }
 
     std::size_t read(std::span<uint8_t> buffer) override {
-        while (!file->eof() && (current_chunk->length() < buffer.size())) {
+        while (has_more_chunks() && (current_chunk->length() < buffer.size())) {
             do_read();
         }
         auto nbytes = std::min(current_chunk->length(), buffer.size());
@@ -276,7 +344,7 @@ public:
     }
 
     bool eof() override {
-        return file->eof() && current_chunk->length() == 0;
+        return !has_more_chunks() && current_chunk->length() == 0;
     }
 
     std::string nextChunk() override {
@@ -293,14 +361,99 @@ public:
         return ret;
     }
 
+    void seek(std::size_t content_offset) override {
+        if (!index) {
+            index = load_index();
+        }
+        const auto entry = index->find(content_offset);
+
+        // Drop the data read (ahead) from the current position. Chunks
+        // still being decrypted are finished (and ignored) by the workers
+        pending.clear();
+        pending_bytes = 0;
+        read_ahead_error = {};
+        current_chunk->clear();
+
+        file->seek(entry.chunk_offset);
+        offset = entry.chunk_offset;
+        if (content_offset > entry.content_offset) {
+            // Skip the beginning of the chunk
+            do_read();
+            current_chunk->trimStart(
+                    std::min(content_offset - entry.content_offset,
+                             uint64_t(current_chunk->length())));
+        }
+    }
+
 protected:
-    /// Get the next chunk of data and decrypt it. See the Chunk section
-    /// in EncryptedFileFormat.md for a description of the chunk layout
-    void do_read() {
+    /// Load the index file for the file (if it is valid) or build the
+    /// index by reading the length field of each chunk
+    std::unique_ptr<EncryptedFileIndex> load_index() {
+        const auto file_size = std::filesystem::file_size(file->get_path());
+        const auto index_path = EncryptedFileIndex::get_path(file->get_path());
+        try {
+            if (exists(index_path)) {
+                auto ret = EncryptedFileIndex::decode(
+                        cb::io::loadFile(index_path), header, *cipher);
+                // The index is only valid if nothing was written to the
+                // file after the index was written
+                if (ret && ret->back().chunk_offset == file_size) {
+                    return std::make_unique<EncryptedFileIndex>(
+                            std::move(*ret));
+                }
+            }
+        } catch (const std::exception&) {
+            // Ignore the index and build it from the file
+        }
+
+        auto ret = std::make_unique<EncryptedFileIndex>();
+        const auto overhead = cipher->getNonceSize() + cipher->getMacSize();
+        uint64_t chunk_offset = sizeof(EncryptedFileHeader);
+        uint64_t content_offset = 0;
+        while (chunk_offset < file_size) {
+            file->seek(chunk_offset);
+            uint32_t chunk_size;
+            if (file->read(&chunk_size, sizeof(chunk_size)) !=
+                sizeof(chunk_size)) {
+                break;
+            }
+            chunk_size = ntohl(chunk_size);
+            if (chunk_size < overhead ||
+                chunk_offset + sizeof(chunk_size) + chunk_size > file_size) {
+                // Partial (or invalid) chunk; the reader reports the error
+                // if the caller tries to read it
+                break;
+            }
+            ret->add(content_offset, chunk_offset);
+            content_offset += chunk_size - overhead;
+            chunk_offset += sizeof(chunk_size) + chunk_size;
+        }
+        ret->add(content_offset, chunk_offset);
+        return ret;
+    }
+
+    /// The number of chunks per read-ahead thread to keep in flight
+    static constexpr std::size_t ReadAheadPerThread = 2;
+
+    /// An encrypted chunk read from the file
+    struct EncryptedChunk {
+        std::string data;
+        /// The offset of the chunk in the file (used in the associated data)
+        std::size_t offset;
+    };
+
+    /// Is there more data in the file (or in flight)
+    bool has_more_chunks() {
+        return !file->eof() || !pending.empty() || read_ahead_error;
+    }
+
+    /// Read the next chunk from the file. See the Chunk section in
+    /// EncryptedFileFormat.md for a description of the chunk layout
+    std::optional<EncryptedChunk> read_chunk() {
         uint32_t chunk_size;
         auto nr = file->read(&chunk_size, sizeof(uint32_t));
         if (nr == 0) {
-            return;
+            return std::nullopt;
         }
         if (nr != sizeof(uint32_t)) {
             throw std::underflow_error(
@@ -315,16 +468,77 @@ protected:
                                 max_allowed_chunk_size));
         }
 
-        std::string buffer;
-        buffer.resize(chunk_size);
-        if (file->read(buffer) != buffer.size()) {
+        EncryptedChunk ret{{}, offset};
+        ret.data.resize(chunk_size);
+        if (file->read(ret.data) != ret.data.size()) {
             throw std::underflow_error(
                     "EncryptedFileReader: Missing Chunk data");
         }
-
-        associated_data.set_offset(offset);
-        auto decrypted = cipher->decrypt(buffer, associated_data);
         offset += chunk_size + sizeof(uint32_t);
+        return ret;
+    }
+
+    /// Verify and decrypt a chunk (may be called from any thread)
+    std::string decrypt(const EncryptedChunk& chunk) const {
+        auto ad = associated_data;
+        ad.set_offset(chunk.offset);
+        return cipher->decrypt(chunk.data, ad);
+    }
+
+    /// Read chunks and schedule them for decryption until the read-ahead
+    /// limits are reached
+    void read_ahead() {
+        while (!read_ahead_error && !file->eof() &&
+               pending.size() < max_read_ahead &&
+               pending_bytes < default_read_ahead_budget) {
+            std::optional<EncryptedChunk> chunk;
+            try {
+                chunk = read_chunk();
+            } catch (const std::exception&) {
+                // Report the error once the consumer gets here
+                read_ahead_error = std::current_exception();
+                return;
+            }
+            if (!chunk) {
+                return;
+            }
+            const auto size = chunk->data.size();
+            auto decrypted = folly::via(
+                    executor.get(),
+                    [this, encrypted = std::move(*chunk)]() {
+                        return decrypt(encrypted);
+                    });
+            pending.emplace_back(size, std::move(decrypted));
+            pending_bytes += size;
+        }
+    }
+
+    /// Get the next chunk of data and decrypt it
+    void do_read() {
+        std::string decrypted;
+        if (executor) {
+            read_ahead();
+            if (pending.empty()) {
+                if (read_ahead_error) {
+                    std::rethrow_exception(
+                            std::exchange(read_ahead_error, {}));
+                }
+                return;
+            }
+            auto [size, future] = std::move(pending.front());
+            pending.pop_front();
+            pending_bytes -= size;
+            decrypted = std::move(future).get();
+            // Keep the workers busy while the caller consumes the chunk
+            read_ahead();
+        } else {
+            auto chunk = read_chunk();
+            if (!chunk) {
+                return;
+            }
+            decrypted = decrypt(*chunk);
+        }
+
         if (current_chunk->tailroom() < decrypted.size()) {
             current_chunk->reserve(0, decrypted.size());
             Expects(current_chunk->tailroom() >= decrypted.size());
@@ -342,6 +556,19 @@ protected:
     std::unique_ptr<FileStreamReader> file;
     std::unique_ptr<folly::IOBuf> current_chunk;
     std::size_t max_allowed_chunk_size = default_max_allowed_chunk_size;
+
+    /// The maximum number of chunks to read ahead
+    const std::size_t max_read_ahead;
+    /// The encrypted size and the decrypted data of the chunks in flight
+    std::deque<std::pair<std::size_t, folly::Future<std::string>>> pending;
+    /// The total size of the encrypted chunks in flight
+    std::size_t pending_bytes = 0;
+    /// The error hit while reading ahead (reported to the consumer once
+    /// all of the preceding chunks are consumed)
+    std::exception_ptr read_ahead_error;
+    /// The chunk index (loaded on the first seek)
+    std::unique_ptr<EncryptedFileIndex> index;
+    std::unique_ptr<folly::CPUThreadPoolExecutor> executor;
 };
 
 class SnappyInflateReader : public FileReader {
@@ -506,11 +733,91 @@ protected:
     std::string current_chunk;
 };
 
+class SnappyFramedReader : public FileReader {
+public:
+    SnappyFramedReader(std::unique_ptr<FileReader> underlying)
+        : underlying(std::move(underlying)) {
+    }
+
+    [[nodiscard]] bool is_encrypted() const override {
+        return underlying->is_encrypted();
+    }
+
+    [[nodiscard]] std::optional<EncryptedFileHeader> get_encryption_header()
+            override {
+        return underlying->get_encryption_header();
+    }
+
+    void set_max_allowed_chunk_size(std::size_t limit) override {
+        underlying->set_max_allowed_chunk_size(limit);
+    }
+
+    std::string nextChunk() override {
+        if (eof()) {
+            return {};
+        }
+        std::string ret;
+
+        if (!current_chunk.empty()) {
+            ret.swap(current_chunk);
+            return ret;
+        }
+
+        do {
+            auto chunk = underlying->nextChunk();
+            if (chunk.empty()) {
+                if (!decoder.isComplete()) {
+                    throw std::underflow_error(
+                            "SnappyFramedReader: Partial chunk");
+                }
+                return {};
+            }
+            decoder.feed(chunk, [&ret](auto data) { ret.append(data); });
+        } while (ret.empty());
+        return ret;
+    }
+
+    std::size_t read(std::span<uint8_t> buffer) override {
+        std::size_t nr = 0;
+        do {
+            auto chunk = do_read(buffer);
+            nr += chunk;
+            buffer = buffer.subspan(chunk);
+        } while (!buffer.empty() && !eof());
+        return nr;
+    }
+
+    bool eof() override {
+        return current_chunk.empty() && underlying->eof();
+    }
+
+protected:
+    std::size_t do_read(std::span<uint8_t> buffer) {
+        auto data = nextChunk();
+        auto nbytes = std::min(buffer.size(), data.size());
+        std::copy_n(data.data(), nbytes, buffer.data());
+        if (nbytes < data.size()) {
+            current_chunk = data.substr(nbytes);
+        }
+        return nbytes;
+    }
+
+    std::unique_ptr<FileReader> underlying;
+    cb::compression::SnappyFramedDecoder decoder;
+    std::string current_chunk;
+};
+
+std::unique_ptr<FileReader> FileReader::wrap_with_snappy_framing(
+        std::unique_ptr<FileReader> reader) {
+    return std::make_unique<SnappyFramedReader>(std::move(reader));
+}
+
 std::unique_ptr<FileReader> FileReader::create(
         const std::filesystem::path& path,
         const std::function<SharedKeyDerivationKey(std::string_view)>&
                 key_lookup_function,
-        std::chrono::microseconds waittime) {
+        std::chrono::microseconds waittime,
+        std::size_t read_ahead_threads) {
     const auto timeout =
             cb::time::steady_clock::now() + std::chrono::microseconds(waittime);
 
@@ -582,7 +889,8 @@ std::unique_ptr<FileReader> FileReader::create(
                 *kdk,
                 *header,
                 std::make_unique<FileStreamReader>(path,
-                                                   std::move(file_stream)));
+                                                   std::move(file_stream)),
+                read_ahead_threads);
 
         switch (compression) {
         case Compression::None:
@@ -604,7 +912,263 @@ std::unique_ptr<FileReader> FileReader::create(
                 "InflateReader: Unsupported compression: {}", compression));
     }
 
+    // Plain files with the .sz extension use the Snappy framing format. The
+    // format is only used for files named as such so that the content of
+    // other files is always returned as is.
+    if (cb::tolower(path.extension().string()) == ".sz") {
+        return std::make_unique<SnappyFramedReader>(
+                std::make_unique<FileStreamReader>(path,
+                                                   std::move(file_stream)));
+    }
+
     return std::make_unique<FileStreamReader>(path, std::move(file_stream));
 }
 
+/**
+ * Verify the chunks of an encrypted file. The chunks are read with pread
+ * (one read per chunk) into buffers which are reused, and decrypted into
+ * per thread scratch buffers as we only want to check the tags.
+ */
+class EncryptedFileVerifier {
+public:
+    EncryptedFileVerifier(
+            const std::filesystem::path& path,
+            const std::function<SharedKeyDerivationKey(std::string_view)>&
+                    key_lookup_function)
+        : path(path), file(open_file(path)) {
+        struct stat st;
+        if (fstat(file.fd(), &st) == -1) {
+            throw std::system_error(
+                    errno,
+                    std::system_category(),
+                    fmt::format("FileReader::verify({}): fstat failed",
+                                path.string()));
+        }
+        file_size = static_cast<std::size_t>(st.st_size);
+
+        std::array<char, sizeof(EncryptedFileHeader)> buffer;
+        const auto& header =
+                *reinterpret_cast<const EncryptedFileHeader*>(buffer.data());
+        if (file_size >= buffer.size()) {
+            read(buffer.data(), buffer.size(), 0);
+        }
+        if (file_size < buffer.size() || !header.is_encrypted()) {
+            throw std::runtime_error(
+                    fmt::format("FileReader::verify({}): Not an encrypted file",
+                                path.string()));
+        }
+        if (!header.is_supported()) {
+            throw std::runtime_error(fmt::format(
+                    "FileReader::verify({}): File format not supported",
+                    path.string()));
+        }
+        auto kdk = key_lookup_function(header.get_id());
+        if (!kdk) {
+            throw std::runtime_error(
+                    fmt::format("FileReader::verify({}): Missing key {}",
+                                path.string(),
+                                header.get_id()));
+        }
+        cipher = SymmetricCipher::create(header.get_cipher(),
+                                         header.derive_key(*kdk));
+        associated_data = std::make_unique<EncryptedFileAssociatedData>(header);
+        min_chunk_size = cipher->getNonceSize() + cipher->getMacSize();
+    }
+
+    FileReader::VerifyResult verify(std::size_t threads) {
+        std::error_code ec;
+        cb::io::giveKernelIoAdvise(file.fd(), cb::io::IoHint::Sequential, ec);
+
+        FileReader::VerifyResult ret;
+        std::size_t offset = sizeof(EncryptedFileHeader);
+        // The offset up to which the pages have been dropped from the cache
+        std::size_t dropped = 0;
+        auto drop_pages = [this, &dropped](std::size_t verified, bool force) {
+            if (verified - dropped >= DropPagesInterval ||
+                (force && verified > dropped)) {
+                std::error_code error;
+                cb::io::giveKernelIoAdvise(file.fd(),
+                                           off_t(dropped),
+                                           off_t(verified - dropped),
+                                           cb::io::IoHint::DontNeed,
+                                           error);
+                dropped = verified;
+            }
+        };
+
+        if (threads == 0) {
+            std::string chunk;
+            std::string scratch;
+            while (offset < file_size) {
+                offset = read_chunk(chunk, offset);
+                verify_chunk(chunk, offset - chunk.size(), scratch);
+                ++ret.chunks;
+                drop_pages(offset, false);
+            }
+            drop_pages(offset, true);
+            ret.bytes = file_size;
+            return ret;
+        }
+
+        struct Job {
+            std::string chunk;
+            std::size_t end;
+        };
+        folly::CPUThreadPoolExecutor executor(
+                threads,
+                std::make_shared<folly::NamedThreadFactory>("cb:verify"));
+        std::deque<folly::Future<Job>> pending;
+        std::vector<std::string> spare;
+        const auto max_pending = threads * 2;
+
+        auto drain_one = [&]() {
+            auto job = std::move(pending.front()).get();
+            pending.pop_front();
+            ++ret.chunks;
+            drop_pages(job.end, false);
+            spare.emplace_back(std::move(job.chunk));
+        };
+
+        while (offset < file_size) {
+            std::string chunk;
+            if (!spare.empty()) {
+                chunk = std::move(spare.back());
+                spare.pop_back();
+            }
+            offset = read_chunk(chunk, offset);
+            pending.emplace_back(folly::via(
+                    &executor,
+                    [this, job = Job{std::move(chunk), offset}]() mutable {
+                        thread_local std::string scratch;
+                        verify_chunk(job.chunk,
+                                     job.end - job.chunk.size(),
+                                     scratch);
+                        return std::move(job);
+                    }));
+            if (pending.size() >= max_pending) {
+                drain_one();
+            }
+        }
+        while (!pending.empty()) {
+            drain_one();
+        }
+        drop_pages(offset, true);
+        ret.bytes = file_size;
+        return ret;
+    }
+
+protected:
+    /// Drop the verified pages from the page cache every 1MiB
+    static constexpr std::size_t DropPagesInterval = 1024 * 1024;
+
+    static folly::File open_file(const std::filesystem::path& path) {
+        const int fd = ::open(path.string().c_str(), O_RDONLY | O_BINARY);
+        if (fd == -1) {
+            throw std::system_error(
+                    errno,
+                    std::system_category(),
+                    fmt::format("Failed to open {}", path.string()));
+        }
+        return folly::File(fd, true);
+    }
+
+    /// Read exactly size bytes at the provided offset
+    void read(void* buffer, std::size_t size, std::size_t offset) {
+        if (offset + size > file_size) {
+            throw std::underflow_error(fmt::format(
+                    "FileReader::verify({}): Partial chunk at offset {}",
+                    path.string(),
+                    offset));
+        }
+        const auto nr =
+                folly::preadFull(file.fd(), buffer, size, off_t(offset));
+        if (nr == -1) {
+            throw std::system_error(
+                    errno,
+                    std::system_category(),
+                    fmt::format("FileReader::verify({}): pread failed",
+                                path.string()));
+        }
+        if (static_cast<std::size_t>(nr) != size) {
+            throw std::underflow_error(fmt::format(
+                    "FileReader::verify({}): Partial chunk at offset {}",
+                    path.string(),
+                    offset));
+        }
+    }
+
+    /**
+     * Read the chunk starting at the provided offset (see the Chunk section
+     * in EncryptedFileFormat.md) into the buffer
+     *
+     * @return the offset of the next chunk
+     */
+    std::size_t read_chunk(std::string& chunk, std::size_t offset) {
+        uint32_t chunk_size;
+        read(&chunk_size, sizeof(chunk_size), offset);
+        chunk_size = ntohl(chunk_size);
+        if (chunk_size < min_chunk_size) {
+            throw std::runtime_error(fmt::format(
+                    "FileReader::verify({}): Invalid chunk size {} at "
+                    "offset {}",
+                    path.string(),
+                    chunk_size,
+                    offset));
+        }
+        // Check that the chunk is within the file before we allocate
+        // memory for it
+        if (offset + sizeof(chunk_size) + chunk_size > file_size) {
+            throw std::underflow_error(fmt::format(
+                    "FileReader::verify({}): Partial chunk at offset {}",
+                    path.string(),
+                    offset));
+        }
+        offset += sizeof(chunk_size);
+        chunk.resize(chunk_size);
+        read(chunk.data(), chunk.size(), offset);
+        return offset + chunk_size;
+    }
+
+    /// Verify the chunk stored at the provided offset (the offset of the
+    /// data, not the length field)
+    void verify_chunk(std::string_view chunk,
+                      std::size_t data_offset,
+                      std::string& scratch) const {
+        const auto offset = data_offset - sizeof(uint32_t);
+        const auto nonce_size = cipher->getNonceSize();
+        const auto mac_size = cipher->getMacSize();
+        scratch.resize(chunk.size() - nonce_size - mac_size);
+        auto ad = *associated_data;
+        ad.set_offset(offset);
+        try {
+            cipher->decrypt(chunk.substr(0, nonce_size),
+                            chunk.substr(nonce_size, scratch.size()),
+                            chunk.substr(nonce_size + scratch.size()),
+                            scratch,
+                            ad);
+        } catch (const MacVerificationError&) {
+            throw MacVerificationError(fmt::format(
+                    "FileReader::verify({}): MAC verification failed for "
+                    "chunk at offset {}",
+                    path.string(),
+                    offset));
+        }
+    }
+
+    const std::filesystem::path path;
+    folly::File file;
+    std::size_t file_size = 0;
+    std::size_t min_chunk_size = 0;
+    std::unique_ptr<SymmetricCipher> cipher;
+    std::unique_ptr<EncryptedFileAssociatedData> associated_data;
+};
+
+FileReader::VerifyResult FileReader::verify(
+        const std::filesystem::path& path,
+        const std::function<SharedKeyDerivationKey(std::string_view)>&
+                key_lookup_function,
+        std::size_t threads) {
+    return EncryptedFileVerifier(path, key_lookup_function).verify(threads);
+}
+
 } // namespace cb::crypto
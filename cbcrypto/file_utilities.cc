@@ -8,42 +8,210 @@
  *   the file licenses/APL2.txt.
  */
 
+#include "encrypted_file_index.h"
+
 #include <cbcrypto/encrypted_file_header.h>
 #include <cbcrypto/file_reader.h>
 #include <cbcrypto/file_utilities.h>
 #include <cbcrypto/file_writer.h>
 #include <fmt/format.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/portability/SysStat.h>
 #include <nlohmann/json.hpp>
 #include <platform/dirutils.h>
+#include <platform/token_bucket_rate_limiter.h>
 
-#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <system_error>
 
 namespace cb::crypto {
 
-static std::string getEncryptionKey(const std::filesystem::path& path) {
-    std::array<char, sizeof(EncryptedFileHeader)> buffer;
-    auto size = file_size(path);
-    if (size < buffer.size()) {
-        // No header present
+std::optional<std::string> DekScanCache::lookup(
+        const std::filesystem::path& path, const FileVersion& version) {
+    std::lock_guard<std::mutex> guard(mutex);
+    const auto iter = entries.find(path.string());
+    if (iter == entries.end() || iter->second.version != version) {
+        ++misses;
         return {};
     }
+    ++hits;
+    return iter->second.key;
+}
+
+void DekScanCache::insert(const std::filesystem::path& path,
+                          const FileVersion& version,
+                          std::string key) {
+    std::lock_guard<std::mutex> guard(mutex);
+    entries[path.string()] = {version, std::move(key)};
+}
 
-    std::ifstream input;
-    input.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    input.open(path, std::ios::binary);
-    input.read(buffer.data(), buffer.size());
-    input.close();
+/// @return the directory without "." and ".." elements or a trailing
+///         separator, so that "dir/" and "dir" compare equal
+static std::filesystem::path normalizeDirectory(
+        const std::filesystem::path& directory) {
+    auto ret = directory.lexically_normal();
+    if (!ret.has_filename() && ret.has_relative_path()) {
+        ret = ret.parent_path();
+    }
+    return ret;
+}
 
-    auto* header = reinterpret_cast<EncryptedFileHeader*>(buffer.data());
-    if (!header->is_encrypted()) {
-        throw std::logic_error(
-                "File with .cef extension does not have correct magic");
+void DekScanCache::prune(const std::filesystem::path& directory,
+                         const std::vector<std::filesystem::path>& keep) {
+    std::unordered_set<std::string> names;
+    for (const auto& path : keep) {
+        names.insert(path.string());
+    }
+    const auto normalized = normalizeDirectory(directory);
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto iter = entries.begin(); iter != entries.end();) {
+        const auto parent = normalizeDirectory(
+                std::filesystem::path(iter->first).parent_path());
+        if (parent == normalized && !names.contains(iter->first)) {
+            iter = entries.erase(iter);
+        } else {
+            ++iter;
+        }
     }
+}
+
+void DekScanCache::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    entries.clear();
+}
+
+std::size_t DekScanCache::size() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return entries.size();
+}
+
+std::size_t DekScanCache::get_hits() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return hits;
+}
+
+std::size_t DekScanCache::get_misses() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return misses;
+}
 
-    if (!header->is_supported()) {
-        throw std::logic_error("File with .cef extension is not supported");
+/// Get the inode, modification time and size of the file
+static DekScanCache::FileVersion getFileVersion(
+        const std::filesystem::path& path) {
+    struct stat st;
+    if (stat(path.string().c_str(), &st) == -1) {
+        throw std::system_error(
+                errno,
+                std::system_category(),
+                fmt::format("Failed to stat {}", path.string()));
     }
-    return std::string{header->get_id()};
+    DekScanCache::FileVersion ret;
+    ret.inode = static_cast<uint64_t>(st.st_ino);
+#if defined(__linux__)
+    ret.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    ret.mtime = int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+                st.st_mtimespec.tv_nsec;
+#else
+    ret.mtime = int64_t(st.st_mtime) * 1000000000;
+#endif
+    ret.size = static_cast<uint64_t>(st.st_size);
+    return ret;
+}
+
+/**
+ * Get the id of the key used to encrypt the file by reading just the file
+ * header with a single pread (and look it up in the cache if provided)
+ *
+ * @return the key id or an empty string if the file is too small to have
+ *         a header
+ */
+static std::string getEncryptionKey(const std::filesystem::path& path,
+                                    DekScanCache* cache = nullptr) {
+    const auto version = getFileVersion(path);
+    if (cache) {
+        auto cached = cache->lookup(path, version);
+        if (cached) {
+            return std::move(*cached);
+        }
+    }
+
+    std::string key;
+    std::array<char, sizeof(EncryptedFileHeader)> buffer;
+    if (version.size >= buffer.size()) {
+        folly::File file(path.string());
+        const auto nr = folly::preadFull(
+                file.fd(), buffer.data(), buffer.size(), 0);
+        if (nr == -1) {
+            throw std::system_error(
+                    errno,
+                    std::system_category(),
+                    fmt::format("Failed to read {}", path.string()));
+        }
+        // The file may have been truncated since we called stat
+        if (static_cast<std::size_t>(nr) == buffer.size()) {
+            const auto* header =
+                    reinterpret_cast<EncryptedFileHeader*>(buffer.data());
+            if (!header->is_encrypted()) {
+                throw std::logic_error(
+                        "File with .cef extension does not have correct "
+                        "magic");
+            }
+
+            if (!header->is_supported()) {
+                throw std::logic_error(
+                        "File with .cef extension is not supported");
+            }
+            key = header->get_id();
+        }
+    }
+
+    if (cache) {
+        cache->insert(path, version, key);
+    }
+    return key;
+}
+
+/**
+ * Call the function for each index in [0, count), using up to concurrency
+ * threads. The function must not throw.
+ */
+static void forEachParallel(std::size_t count,
+                            std::size_t concurrency,
+                            const char* name,
+                            const std::function<void(std::size_t)>& function) {
+    std::atomic<std::size_t> next{0};
+    auto worker = [&next, count, &function]() {
+        for (auto ii = next++; ii < count; ii = next++) {
+            function(ii);
+        }
+    };
+
+    const auto threads = std::min(concurrency, count);
+    if (threads <= 1) {
+        worker();
+        return;
+    }
+    folly::CPUThreadPoolExecutor executor(
+            threads, std::make_shared<folly::NamedThreadFactory>(name));
+    for (std::size_t ii = 0; ii < threads; ++ii) {
+        executor.add(worker);
+    }
+    executor.join();
+}
+
+/**
+ * Is the path the chunk index of an encrypted file? The index starts with a
+ * copy of the header of the data file, so it must be skipped when scanning
+ * for encrypted files (it's rewritten along with the data file).
+ */
+static bool isChunkIndex(const std::filesystem::path& path) {
+    return path.extension() == ".idx";
 }
 
 std::unordered_set<std::string> findDeksInUse(
@@ -51,77 +219,125 @@ std::unordered_set<std::string> findDeksInUse(
         const std::function<bool(const std::filesystem::path&)>& filefilter,
         const std::function<void(std::string_view, const nlohmann::json&)>&
                 error) {
-    std::unordered_set<std::string> deks;
+    return findDeksInUse(directory, filefilter, error, FindDeksOptions{});
+}
+
+std::unordered_set<std::string> findDeksInUse(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&)>& filefilter,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error,
+        const FindDeksOptions& options) {
+    std::vector<std::filesystem::path> paths;
     std::error_code ec;
     for (const auto& p : std::filesystem::directory_iterator(directory, ec)) {
         auto path = p.path();
-        if (!filefilter(path)) {
-            continue;
+        if (!isChunkIndex(path) && filefilter(path)) {
+            paths.emplace_back(std::move(path));
         }
+    }
 
-        try {
-            auto key = getEncryptionKey(path);
-            if (!key.empty()) {
-                deks.insert(key);
-            }
-        } catch (const std::exception& e) {
+    // Read the headers in parallel, but report the result (and errors)
+    // from the calling thread
+    std::vector<std::string> keys(paths.size());
+    std::vector<std::optional<std::string>> failures(paths.size());
+    forEachParallel(
+            paths.size(), options.concurrency, "cb:dekscan", [&](auto ii) {
+                try {
+                    keys[ii] = getEncryptionKey(paths[ii], options.cache);
+                } catch (const std::exception& e) {
+                    failures[ii] = e.what();
+                }
+            });
+
+    std::unordered_set<std::string> deks;
+    for (std::size_t ii = 0; ii < paths.size(); ++ii) {
+        if (failures[ii]) {
             error("Failed to get deks from",
-                  {{"path", path.string()}, {"error", e.what()}});
+                  {{"path", paths[ii].string()}, {"error", *failures[ii]}});
+        } else if (!keys[ii].empty()) {
+            deks.insert(std::move(keys[ii]));
         }
     }
 
     if (ec) {
         error("Error occurred while traversing directory",
               {{"path", directory.string()}, {"error", ec.message()}});
+    } else if (options.cache) {
+        // Forget the files which no longer exist
+        options.cache->prune(directory, paths);
     }
 
     return deks;
 }
 
-void maybeRewriteFiles(
-        const std::filesystem::path& directory,
-        const std::function<bool(const std::filesystem::path&,
-                                 std::string_view)>& filefilter,
-        SharedKeyDerivationKey derivation_key,
+namespace {
+/// Thrown by rewriteFile() when the rewrite was cancelled
+class RewriteCancelled : public std::exception {};
+
+/// State shared by the threads rewriting files
+struct RewriteContext {
+    const RewriteOptions& options;
+    cb::TokenBucketRateLimiter<std::chrono::seconds> limiter;
+};
+} // namespace
+
+/**
+ * Rewrite a single file with the provided key (or unencrypted).
+ *
+ * @param context If present, the rewrite is throttled and may be cancelled
+ * @return The number of bytes read from the original file
+ */
+static std::size_t rewriteFile(
+        const std::filesystem::path& path,
+        const SharedKeyDerivationKey& derivation_key,
         const std::function<SharedKeyDerivationKey(std::string_view)>&
                 key_lookup_function,
         const std::function<void(std::string_view, const nlohmann::json&)>&
                 error,
         std::string_view unencrypted_extension,
-        bool compression) {
+        bool compression,
+        RewriteContext* context) {
+    auto reader = FileReader::create(path, key_lookup_function);
+    std::filesystem::path tmpfile = cb::io::mktemp(path.string());
+    if (compression && !derivation_key) {
+        tmpfile.replace_extension(".gz");
+    }
+    // Keep the chunk index of files which had one (an index is only
+    // supported for uncompressed encrypted files)
+    const auto index = EncryptedFileIndex::get_path(path);
     std::error_code ec;
-    for (const auto& p : std::filesystem::directory_iterator(directory, ec)) {
-        auto path = p.path();
-        std::string key;
-        if (path.extension() == ".cef") {
-            try {
-                key = getEncryptionKey(path);
-            } catch (const std::exception& e) {
-                error("Failed to get deks from",
-                      {{"path", path.string()}, {"error", e.what()}});
-                continue;
-            }
-        }
-
-        if (!filefilter(path, key)) {
-            continue;
-        }
-
-        auto reader = FileReader::create(path, key_lookup_function);
-        std::filesystem::path tmpfile = cb::io::mktemp(path.string());
-        if (compression && !derivation_key) {
-            tmpfile.replace_extension(".gz");
-        }
+    const bool chunk_index =
+            derivation_key && !compression && exists(index, ec);
+    std::size_t total = 0;
+    try {
         auto writer = FileWriter::create(
                 derivation_key,
                 tmpfile,
                 64 * 1024,
-                compression ? Compression::GZIP : Compression::None);
+                compression ? Compression::GZIP : Compression::None,
+                0,
+                chunk_index);
         std::vector<uint8_t> data(8 * 1024);
 
         while (!reader->eof()) {
+            if (context &&
+                context->options.cancellation.isCancellationRequested()) {
+                throw RewriteCancelled();
+            }
             try {
                 auto nr = reader->read(data);
+                if (context && context->options.bytes_per_second) {
+                    // acquire() doesn't throttle requests larger than the
+                    // bucket so split large blocks
+                    const auto rate = context->options.bytes_per_second;
+                    for (auto left = nr; left;) {
+                        const auto bytes = std::min(left, rate);
+                        context->limiter.acquire(bytes, rate);
+                        left -= bytes;
+                    }
+                }
+                total += nr;
                 writer->write({reinterpret_cast<const char*>(data.data()), nr});
             } catch (const std::underflow_error&) {
                 error("Partial chunk detected", {{"path", path.string()}});
@@ -129,24 +345,165 @@ void maybeRewriteFiles(
         }
         writer->flush();
         writer->close();
-        reader.reset();
-        if (derivation_key && path.extension() != ".cef") {
-            auto next = path;
-            next.replace_extension(".cef");
-            rename(tmpfile, next);
-            remove(path);
-        } else if (!derivation_key && path.extension() == ".cef") {
-            auto next = path;
-            next.replace_extension(unencrypted_extension);
-            if (compression) {
-                next.append(".gz");
+    } catch (...) {
+        remove(tmpfile, ec);
+        remove(EncryptedFileIndex::get_path(tmpfile), ec);
+        throw;
+    }
+    reader.reset();
+    auto next = path;
+    if (derivation_key && path.extension() != ".cef") {
+        next.replace_extension(".cef");
+    } else if (!derivation_key && path.extension() == ".cef") {
+        next.replace_extension(unencrypted_extension);
+        if (compression) {
+            next.append(".gz");
+        }
+    }
+    rename(tmpfile, next);
+    if (next != path) {
+        remove(path);
+    }
+    // The old index belongs to the old content (and names the old key)
+    remove(index, ec);
+    if (chunk_index) {
+        rename(EncryptedFileIndex::get_path(tmpfile),
+               EncryptedFileIndex::get_path(next));
+    }
+    return total;
+}
+
+/**
+ * Get the files in the directory which should be rewritten (and the id of
+ * the key they're encrypted with)
+ */
+static std::vector<std::pair<std::filesystem::path, std::string>>
+getFilesToRewrite(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&,
+                                 std::string_view)>& filefilter,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error) {
+    std::vector<std::pair<std::filesystem::path, std::string>> ret;
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(directory, ec)) {
+        auto path = p.path();
+        if (isChunkIndex(path)) {
+            continue;
+        }
+        std::string key;
+        if (path.extension() == ".cef") {
+            try {
+                key = getEncryptionKey(path);
+            } catch (const std::exception& e) {
+                error("Failed to get deks from",
+                      {{"path", path.string()}, {"error", e.what()}});
+                continue;
             }
-            rename(tmpfile, next);
-            remove(path);
-        } else {
-            rename(tmpfile, path);
         }
+
+        if (filefilter(path, key)) {
+            ret.emplace_back(std::move(path), std::move(key));
+        }
+    }
+    return ret;
+}
+
+void maybeRewriteFiles(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&,
+                                 std::string_view)>& filefilter,
+        SharedKeyDerivationKey derivation_key,
+        const std::function<SharedKeyDerivationKey(std::string_view)>&
+                key_lookup_function,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error,
+        std::string_view unencrypted_extension,
+        bool compression) {
+    for (const auto& [path, key] :
+         getFilesToRewrite(directory, filefilter, error)) {
+        rewriteFile(path,
+                    derivation_key,
+                    key_lookup_function,
+                    error,
+                    unencrypted_extension,
+                    compression,
+                    nullptr);
     }
 }
 
+RewriteProgress maybeRewriteFiles(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&,
+                                 std::string_view)>& filefilter,
+        SharedKeyDerivationKey derivation_key,
+        const std::function<SharedKeyDerivationKey(std::string_view)>&
+                key_lookup_function,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error,
+        const RewriteOptions& options,
+        std::string_view unencrypted_extension,
+        bool compression) {
+    const auto files = getFilesToRewrite(directory, filefilter, error);
+    RewriteContext context{options, {}};
+
+    // The work is spread over multiple threads, but the callbacks are
+    // serialized so the caller doesn't need to deal with that
+    std::mutex mutex;
+    RewriteProgress progress;
+    progress.files_total = files.size();
+    auto lookup = [&mutex, &key_lookup_function](std::string_view id) {
+        std::lock_guard<std::mutex> guard(mutex);
+        return key_lookup_function(id);
+    };
+    auto report = [&mutex, &error](std::string_view message,
+                                   const nlohmann::json& json) {
+        std::lock_guard<std::mutex> guard(mutex);
+        error(message, json);
+    };
+
+    forEachParallel(
+            files.size(), options.concurrency, "cb:rewrite", [&](auto ii) {
+                const auto& path = files[ii].first;
+                bool cancelled =
+                        options.cancellation.isCancellationRequested();
+                std::size_t nbytes = 0;
+                bool failed = false;
+                if (!cancelled) {
+                    try {
+                        nbytes = rewriteFile(path,
+                                             derivation_key,
+                                             lookup,
+                                             report,
+                                             unencrypted_extension,
+                                             compression,
+                                             &context);
+                    } catch (const RewriteCancelled&) {
+                        cancelled = true;
+                    } catch (const std::exception& e) {
+                        failed = true;
+                        report("Failed to rewrite file",
+                               {{"path", path.string()},
+                                {"error", e.what()}});
+                    }
+                }
+
+                std::lock_guard<std::mutex> guard(mutex);
+                if (cancelled) {
+                    progress.cancelled = true;
+                    return;
+                }
+                progress.bytes_read += nbytes;
+                if (failed) {
+                    ++progress.files_failed;
+                } else {
+                    ++progress.files_rewritten;
+                }
+                if (options.progress) {
+                    options.progress(progress);
+                }
+            });
+    return progress;
+}
+
 } // namespace cb::crypto
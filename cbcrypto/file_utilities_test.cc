@@ -12,8 +12,10 @@
 #include "cbcrypto/key_store.h"
 
 #include <cbcrypto/common.h>
+#include <cbcrypto/encrypted_file_header.h>
 #include <cbcrypto/file_reader.h>
 #include <cbcrypto/file_writer.h>
+#include <fmt/format.h>
 #include <folly/portability/GTest.h>
 #include <nlohmann/json.hpp>
 #include <platform/dirutils.h>
@@ -111,6 +113,60 @@ TEST_F(FileUtilitiesTest, findDeksInUse) {
     EXPECT_TRUE(keys.empty());
 }
 
+TEST_F(FileUtilitiesTest, findDeksInUseCached) {
+    for (const auto& name : {"file1.cef", "file2.cef", "file3.cef"}) {
+        create_file(name, "This is the content");
+    }
+    create_file("file4.txt", "This is the content", false);
+
+    DekScanCache cache;
+    FindDeksOptions options;
+    options.concurrency = 4;
+    options.cache = &cache;
+    auto scan = [this, &options](const std::filesystem::path& directory = {}) {
+        return findDeksInUse(
+                directory.empty() ? dir : directory,
+                [](const auto&) { return true; },
+                [](std::string_view message, const nlohmann::json& json) {
+                    ADD_FAILURE() << message << " " << json.dump();
+                },
+                options);
+    };
+
+    auto keys = scan();
+    EXPECT_EQ(3, keys.size());
+    EXPECT_EQ(0, cache.get_hits());
+    EXPECT_EQ(4, cache.get_misses());
+    EXPECT_EQ(4, cache.size());
+
+    // Nothing changed so all of the files should be served from the cache
+    EXPECT_EQ(keys, scan());
+    EXPECT_EQ(4, cache.get_hits());
+    EXPECT_EQ(4, cache.get_misses());
+
+    // Rewrite one of the files with another key (and size) and remove
+    // another one
+    const auto old = files["file1.cef"];
+    create_file("file1.cef", "This is the new content");
+    remove(dir / "file2.cef");
+    keys = scan();
+    EXPECT_EQ(2, keys.size());
+    EXPECT_EQ(0, keys.count(old));
+    EXPECT_EQ(1, keys.count(files["file1.cef"]));
+    EXPECT_EQ(1, keys.count(files["file3.cef"]));
+    EXPECT_EQ(6, cache.get_hits());
+    EXPECT_EQ(5, cache.get_misses());
+    EXPECT_EQ(3, cache.size());
+
+    // The entries of removed files are pruned even if the directory is
+    // given with a trailing separator
+    remove(dir / "file3.cef");
+    keys = scan(dir / "");
+    EXPECT_EQ(1, keys.size());
+    EXPECT_EQ(1, keys.count(files["file1.cef"]));
+    EXPECT_EQ(2, cache.size());
+}
+
 TEST_F(FileUtilitiesTest, rewriteUnencryptedToEncrypted) {
     create_file("file.txt", "This is the content", false);
 
@@ -156,6 +212,50 @@ TEST_F(FileUtilitiesTest, rewriteEncryptedToUnencrypted) {
     EXPECT_EQ("This is the content", reader->read());
 }
 
+/// The chunk index is rewritten along with the file (and never reported as
+/// an encrypted file of its own)
+TEST_F(FileUtilitiesTest, rewriteWithChunkIndex) {
+    auto key = KeyDerivationKey::generate();
+    keystore.add(key);
+    const auto file = dir / "file.cef";
+    const auto index = dir / "file.cef.idx";
+    auto writer = FileWriter::create(key, file, 0, Compression::None, 0, true);
+    writer->write("This is the content");
+    writer->close();
+    writer.reset();
+    ASSERT_TRUE(std::filesystem::exists(index));
+
+    auto lookup = [this](auto id) { return keystore.lookup(id); };
+    auto errors = [](std::string_view, const nlohmann::json&) {};
+    auto everything = [](const auto&) { return true; };
+    EXPECT_EQ(std::unordered_set<std::string>{key->id},
+              findDeksInUse(dir, everything, errors));
+
+    // Rewrite with the active key
+    maybeRewriteFiles(
+            dir,
+            [](const auto&, auto) { return true; },
+            keystore.getActiveKey(),
+            lookup,
+            errors);
+    EXPECT_EQ(std::unordered_set<std::string>{keystore.getActiveKey()->id},
+              findDeksInUse(dir, everything, errors));
+    // The new index belongs to the new file
+    ASSERT_TRUE(std::filesystem::exists(index));
+    const auto header = sizeof(EncryptedFileHeader);
+    EXPECT_EQ(cb::io::loadFile(file).substr(0, header),
+              cb::io::loadFile(index).substr(0, header));
+    EXPECT_EQ("This is the content", FileReader::create(file, lookup)->read());
+
+    // Decrypting the file removes the index
+    maybeRewriteFiles(
+            dir, [](const auto&, auto) { return true; }, {}, lookup, errors);
+    EXPECT_FALSE(std::filesystem::exists(index));
+    EXPECT_TRUE(findDeksInUse(dir, everything, errors).empty());
+    EXPECT_EQ("This is the content",
+              FileReader::create(dir / "file.txt", lookup)->read());
+}
+
 TEST_F(FileUtilitiesTest, rewriteUsingCertainKey) {
     create_file("file1.cef", "This is the content");
     const auto key_id = files["file1.cef"];
@@ -211,3 +311,124 @@ TEST_F(FileUtilitiesTest, rewriteTruncatedFile) {
     EXPECT_EQ(data, content);
     EXPECT_EQ(requested, keystore.getActiveKey()->id);
 }
+
+TEST_F(FileUtilitiesTest, rewriteInParallel) {
+    const std::string content(100 * 1024, 'a');
+    for (int ii = 0; ii < 10; ++ii) {
+        create_file(fmt::format("file{}.cef", ii), content);
+    }
+
+    RewriteOptions options;
+    options.concurrency = 4;
+    options.bytes_per_second = 10 * 1024 * 1024;
+    std::size_t callbacks = 0;
+    options.progress = [&callbacks](const RewriteProgress& progress) {
+        ++callbacks;
+        EXPECT_EQ(callbacks, progress.files_rewritten + progress.files_failed);
+    };
+    const auto progress = maybeRewriteFiles(
+            dir,
+            [](const auto&, auto) { return true; },
+            keystore.getActiveKey(),
+            [this](auto id) { return keystore.lookup(id); },
+            [](std::string_view message, const nlohmann::json& json) {
+                ADD_FAILURE() << message << " " << json.dump();
+            },
+            options);
+
+    EXPECT_EQ(10, progress.files_total);
+    EXPECT_EQ(10, progress.files_rewritten);
+    EXPECT_EQ(0, progress.files_failed);
+    EXPECT_EQ(10 * content.size(), progress.bytes_read);
+    EXPECT_FALSE(progress.cancelled);
+    EXPECT_EQ(10, callbacks);
+
+    for (const auto& [name, key] : files) {
+        std::string requested;
+        const auto reader =
+                FileReader::create(dir / name, [this, &requested](auto id) {
+                    requested = id;
+                    return keystore.lookup(id);
+                });
+        EXPECT_EQ(content, reader->read());
+        EXPECT_EQ(keystore.getActiveKey()->id, requested);
+    }
+}
+
+TEST_F(FileUtilitiesTest, rewriteCancel) {
+    for (int ii = 0; ii < 5; ++ii) {
+        create_file(
+                fmt::format("file{}.txt", ii), "This is the content", false);
+    }
+
+    folly::CancellationSource source;
+    RewriteOptions options;
+    options.cancellation = source.getToken();
+    options.progress = [&source](const RewriteProgress&) {
+        source.requestCancellation();
+    };
+    const auto progress = maybeRewriteFiles(
+            dir,
+            [](const auto&, auto) { return true; },
+            keystore.getActiveKey(),
+            [this](auto id) { return keystore.lookup(id); },
+            [](std::string_view, const nlohmann::json&) {},
+            options);
+
+    EXPECT_EQ(5, progress.files_total);
+    EXPECT_EQ(1, progress.files_rewritten);
+    EXPECT_TRUE(progress.cancelled);
+
+    // Only one file was rewritten (and the others are left untouched)
+    std::size_t encrypted = 0;
+    std::size_t plain = 0;
+    for (const auto& p : std::filesystem::directory_iterator(dir)) {
+        if (p.path().extension() == ".cef") {
+            ++encrypted;
+        } else {
+            EXPECT_EQ(".txt", p.path().extension().string());
+            ++plain;
+        }
+    }
+    EXPECT_EQ(1, encrypted);
+    EXPECT_EQ(4, plain);
+}
+
+TEST_F(FileUtilitiesTest, rewriteReportsFailures) {
+    create_file("file1.cef", "This is the content");
+    create_file("file2.cef", "This is the content");
+    const auto missing = files["file1.cef"];
+
+    std::vector<std::string> errors;
+    RewriteOptions options;
+    options.concurrency = 2;
+    const auto progress = maybeRewriteFiles(
+            dir,
+            [](const auto&, auto) { return true; },
+            keystore.getActiveKey(),
+            // Make the key for one of the files unavailable
+            [this, &missing](auto id) -> SharedKeyDerivationKey {
+                if (id == missing) {
+                    return {};
+                }
+                return keystore.lookup(id);
+            },
+            [&errors](std::string_view message, const nlohmann::json&) {
+                errors.emplace_back(message);
+            },
+            options);
+    EXPECT_EQ(2, progress.files_total);
+    EXPECT_EQ(1, progress.files_rewritten);
+    EXPECT_EQ(1, progress.files_failed);
+    ASSERT_EQ(1, errors.size());
+    EXPECT_EQ("Failed to rewrite file", errors.front());
+
+    // The file which failed is left untouched
+    const auto keys = findDeksInUse(
+            dir,
+            [](const auto&) { return true; },
+            [](std::string_view, const nlohmann::json&) {});
+    EXPECT_EQ(2, keys.size());
+    EXPECT_EQ(1, keys.count(missing));
+    EXPECT_EQ(1, keys.count(keystore.getActiveKey()->id));
+}
@@ -8,6 +8,7 @@
  *   the file licenses/APL2.txt.
  */
 #include "encrypted_file_associated_data.h"
+#include "encrypted_file_index.h"
 
 #include <cbcrypto/common.h>
 #include <cbcrypto/encrypted_file_header.h>
@@ -15,12 +16,16 @@
 #include <cbcrypto/symmetric.h>
 #include <fmt/format.h>
 #include <folly/compression/Compression.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <folly/futures/Future.h>
 #include <folly/io/IOBuf.h>
 #include <gsl/gsl-lite.hpp>
 #include <platform/compress.h>
 #include <platform/dirutils.h>
 #include <platform/socket.h>
 #include <zlib.h>
+#include <deque>
 #include <fstream>
 
 namespace cb::crypto {
@@ -374,38 +379,220 @@ protected:
 
 class EncryptedWriter : public StackedWriter {
 public:
+    /**
+     * @param kdk The key to derive the file key from
+     * @param header The file header (already written to underlying)
+     * @param underlying Where to write the encrypted chunks
+     * @param index_path Where to write the chunk index when the writer is
+     *                   closed (empty to not write an index)
+     */
     EncryptedWriter(const SharedKeyDerivationKey& kdk,
                     const EncryptedFileHeader& header,
-                    std::unique_ptr<FileWriter> underlying)
+                    std::unique_ptr<FileWriter> underlying,
+                    std::filesystem::path index_path = {})
         : StackedWriter(std::move(underlying)),
+          header(header),
           associatedData(std::make_unique<EncryptedFileAssociatedData>(header)),
-          cipher(SymmetricCipher::create(kdk->cipher,
-                                         header.derive_key(*kdk))) {
+          cipher(SymmetricCipher::create(header.get_cipher(),
+                                         header.derive_key(*kdk))),
+          index_path(std::move(index_path)) {
     }
 
     bool is_encrypted() const override {
         return true;
     }
 
+    void close() override {
+        flush();
+        if (!index_path.empty()) {
+            write_index();
+        }
+        underlying->close();
+    }
+
 protected:
     void do_write(std::string_view data) override {
-        associatedData->set_offset(underlying->size());
-        const auto encrypted = cipher->encrypt(data, *associatedData);
-        uint32_t size = htonl(gsl::narrow<uint32_t>(encrypted.size()));
-        this->underlying->write(std::string_view{
-                reinterpret_cast<const char*>(&size), sizeof(size)});
-        this->underlying->write(encrypted);
+        const auto offset = underlying->size();
+        record_chunk(offset, data.size());
+        associatedData->set_offset(offset);
+        encrypt_chunk(chunk, data, *associatedData);
+        this->underlying->write(chunk);
+    }
+
+    /**
+     * Encrypt the data into the provided buffer using the layout of a
+     * chunk in the file (length, nonce, ciphertext and tag) so that it
+     * may be written with a single write. The buffer is resized to fit the
+     * chunk (and doesn't need to allocate memory if it is reused for
+     * chunks of the same size).
+     */
+    void encrypt_chunk(std::string& buffer,
+                       std::string_view data,
+                       std::string_view ad) const {
+        const auto nonceSize = cipher->getNonceSize();
+        const auto macSize = cipher->getMacSize();
+        buffer.resize(sizeof(uint32_t) + nonceSize + data.size() + macSize);
+        const uint32_t size = htonl(
+                gsl::narrow<uint32_t>(buffer.size() - sizeof(uint32_t)));
+        std::memcpy(buffer.data(), &size, sizeof(size));
+        gsl::span span(buffer);
+        auto nonce = span.subspan(sizeof(size), nonceSize);
+        randomBytes(nonce);
+        const auto ct = sizeof(size) + nonceSize;
+        cipher->encrypt({nonce.data(), nonce.size()},
+                        span.subspan(ct, data.size()),
+                        span.subspan(ct + data.size(), macSize),
+                        data,
+                        ad);
+    }
+
+    /// Record a chunk (of the provided plain size) written at the offset
+    void record_chunk(std::size_t offset, std::size_t size) {
+        if (!index_path.empty()) {
+            index.add(content_size, offset);
+        }
+        content_size += size;
     }
 
+    /// Write the index file (all chunks must be written to underlying)
+    void write_index() {
+        index.add(content_size, underlying->size());
+        auto file = FileWriter::create({}, index_path);
+        file->write(index.encode(header, *cipher));
+        file->close();
+    }
+
+    const EncryptedFileHeader header;
     std::unique_ptr<EncryptedFileAssociatedData> associatedData;
     std::unique_ptr<SymmetricCipher> cipher;
+    const std::filesystem::path index_path;
+    EncryptedFileIndex index;
+    /// The number of bytes of (plain) data written
+    std::size_t content_size = 0;
+    /// The buffer used to build the next chunk
+    std::string chunk;
+};
+
+/**
+ * The ParallelEncryptedWriter writes the same format as the EncryptedWriter,
+ * but encrypts the chunks on a pool of worker threads.
+ *
+ * The offset used in the associated data for a chunk is the size of the
+ * file when the chunk is written, which only depends on the size of the
+ * preceding chunks (the encrypted size is nonce + data + mac). The offset
+ * of each chunk is therefore known when it is submitted, and the workers
+ * may encrypt multiple chunks at the same time. The encrypted chunks are
+ * written to the underlying writer in the order they were submitted, from
+ * the caller's thread.
+ *
+ * At most MaxPendingPerThread chunks per thread are in flight; write()
+ * blocks (writing the oldest chunk) when the limit is reached.
+ */
+class ParallelEncryptedWriter : public EncryptedWriter {
+public:
+    ParallelEncryptedWriter(const SharedKeyDerivationKey& kdk,
+                            const EncryptedFileHeader& header,
+                            std::unique_ptr<FileWriter> underlying,
+                            std::filesystem::path index_path,
+                            size_t threads)
+        : EncryptedWriter(
+                  kdk, header, std::move(underlying), std::move(index_path)),
+          overhead(sizeof(uint32_t) + cipher->getNonceSize() +
+                   cipher->getMacSize()),
+          max_pending(threads * MaxPendingPerThread),
+          next_offset(this->underlying->size()),
+          executor(std::make_unique<folly::CPUThreadPoolExecutor>(
+                  threads,
+                  std::make_shared<folly::NamedThreadFactory>(
+                          "cb:encrypt"))) {
+    }
+
+    ~ParallelEncryptedWriter() override {
+        // Write the chunks still in flight (as they would have been
+        // written by the serial writer). Catch exceptions as a destructor
+        // shouldn't throw.
+        try {
+            drain(0);
+        } catch (const std::exception&) {
+        }
+        executor->join();
+    }
+
+    void flush() override {
+        drain(0);
+        underlying->flush();
+    }
+
+    [[nodiscard]] size_t size() const override {
+        // The size of the file once all of the pending chunks are written
+        return next_offset;
+    }
+
+protected:
+    /// The number of chunks per thread which may be queued for encryption
+    static constexpr size_t MaxPendingPerThread = 2;
+
+    /// The buffers used to encrypt a chunk on a worker thread
+    struct Job {
+        /// A copy of the data to encrypt
+        std::string data;
+        /// The encrypted chunk (as it is written to the file)
+        std::string encrypted;
+    };
+
+    void do_write(std::string_view data) override {
+        drain(max_pending - 1);
+
+        record_chunk(next_offset, data.size());
+        auto ad = *associatedData;
+        ad.set_offset(next_offset);
+        next_offset += overhead + data.size();
+        // Reuse the buffers from a completed job to avoid allocating
+        // memory for each chunk
+        Job job;
+        if (!spare.empty()) {
+            job = std::move(spare.back());
+            spare.pop_back();
+        }
+        job.data.assign(data);
+        pending.emplace_back(folly::via(
+                executor.get(), [this, ad, job = std::move(job)]() mutable {
+                    encrypt_chunk(job.encrypted, job.data, ad);
+                    return std::move(job);
+                }));
+    }
+
+    /// Write completed chunks until no more than max chunks are pending
+    void drain(size_t max) {
+        while (pending.size() > max) {
+            // Take the future off the queue first, so that a failed job
+            // doesn't leave an invalid future behind for the next call
+            auto future = std::move(pending.front());
+            pending.pop_front();
+            auto job = std::move(future).get();
+            underlying->write(job.encrypted);
+            spare.emplace_back(std::move(job));
+        }
+    }
+
+    /// The number of bytes added to each chunk (length, nonce and mac)
+    const size_t overhead;
+    const size_t max_pending;
+    /// The offset of the next chunk submitted
+    size_t next_offset;
+    std::deque<folly::Future<Job>> pending;
+    /// The buffers from completed jobs (at most max_pending)
+    std::vector<Job> spare;
+    std::unique_ptr<folly::CPUThreadPoolExecutor> executor;
 };
 
 std::unique_ptr<FileWriter> FileWriter::create(
         const SharedKeyDerivationKey& kdk,
         std::filesystem::path path,
         size_t buffer_size,
-        Compression compression) {
+        Compression compression,
+        size_t encryption_threads,
+        bool chunk_index) {
     if (!kdk && compression == Compression::GZIP) {
         // use a specialized GZip writer which uses the gzip file format
         std::unique_ptr<FileWriter> ret =
@@ -425,14 +612,23 @@ std::unique_ptr<FileWriter> FileWriter::create(
     if (!kdk) {
         return ret;
     }
-    return wrap_with_encryption(kdk, std::move(ret), buffer_size, compression);
+    return wrap_with_encryption(
+            kdk,
+            std::move(ret),
+            buffer_size,
+            compression,
+            encryption_threads,
+            chunk_index ? EncryptedFileIndex::get_path(path)
+                        : std::filesystem::path{});
 }
 
 std::unique_ptr<FileWriter> FileWriter::wrap_with_encryption(
         const SharedKeyDerivationKey& kdk,
         std::unique_ptr<FileWriter> ret,
         size_t buffer_size,
-        Compression compression) {
+        Compression compression,
+        size_t encryption_threads,
+        std::filesystem::path index_path) {
     Expects(kdk);
 
     // GZIP is not supported in encrypted files, map to ZLIB
@@ -440,7 +636,16 @@ std::unique_ptr<FileWriter> FileWriter::wrap_with_encryption(
         compression = Compression::ZLIB;
     }
 
+    if (!index_path.empty() && compression != Compression::None) {
+        // The index maps offsets in the data passed to the encryption
+        // layer, which is the compressed data
+        throw std::invalid_argument(
+                "FileWriter::wrap_with_encryption(): A chunk index is only "
+                "supported for uncompressed files");
+    }
+
     EncryptedFileHeader header(kdk->id, kdk->derivationMethod, compression);
+    header.set_cipher(kdk->cipher);
     if (kdk->derivationMethod == KeyDerivationMethod::PasswordBased) {
         // set a default number of iterations
         header.set_pbkdf_iterations(128 * 1024);
@@ -449,7 +654,16 @@ std::unique_ptr<FileWriter> FileWriter::wrap_with_encryption(
 
     // time to build up the stack of writers
 
-    ret = std::make_unique<EncryptedWriter>(kdk, header, std::move(ret));
+    if (encryption_threads == 0) {
+        ret = std::make_unique<EncryptedWriter>(
+                kdk, header, std::move(ret), std::move(index_path));
+    } else {
+        ret = std::make_unique<ParallelEncryptedWriter>(kdk,
+                                                        header,
+                                                        std::move(ret),
+                                                        std::move(index_path),
+                                                        encryption_threads);
+    }
 
     switch (compression) {
     case Compression::None:
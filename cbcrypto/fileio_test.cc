@@ -11,10 +11,14 @@
 #include <cbcrypto/encrypted_file_header.h>
 #include <cbcrypto/file_reader.h>
 #include <cbcrypto/file_writer.h>
+#include <cbcrypto/symmetric.h>
+#include <fmt/format.h>
 #include <folly/ScopeGuard.h>
 #include <folly/portability/GTest.h>
 #include <nlohmann/json.hpp>
+#include <platform/compression/snappy_stream.h>
 #include <platform/dirutils.h>
+#include <platform/file_sink.h>
 #include <filesystem>
 
 using namespace cb::crypto;
@@ -34,6 +38,19 @@ TEST(EncryptedFileHeaderTest, Iterations) {
     }
 }
 
+TEST(EncryptedFileHeaderTest, Cipher) {
+    EncryptedFileHeader header(
+            "id", KeyDerivationMethod::KeyBased, Compression::None);
+    EXPECT_EQ(Cipher::AES_256_GCM, header.get_cipher());
+    EXPECT_TRUE(header.is_supported());
+    header.set_cipher(Cipher::ChaCha20_Poly1305);
+    EXPECT_EQ(Cipher::ChaCha20_Poly1305, header.get_cipher());
+    EXPECT_TRUE(header.is_supported());
+    header.set_cipher(Cipher::AES_256_GCM);
+    EXPECT_EQ(Cipher::AES_256_GCM, header.get_cipher());
+    EXPECT_THROW(header.set_cipher(Cipher::None), NotSupportedException);
+}
+
 class FileIoTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -74,6 +91,26 @@ TEST_F(FileIoTest, FileWriterTestEncrypted) {
     EXPECT_EQ(key->id, header->get_id());
 }
 
+TEST_F(FileIoTest, FileWriterTestEncryptedChaCha20Poly1305) {
+    const std::string content(100000, 'a');
+    SharedKeyDerivationKey key =
+            KeyDerivationKey::generate(Cipher::ChaCha20_Poly1305);
+    auto writer = FileWriter::create(key, file, 8192);
+    writer->write(content);
+    writer->close();
+    writer.reset();
+    auto data = cb::io::loadFile(file);
+    ASSERT_GE(data.size(), sizeof(EncryptedFileHeader));
+    auto header = reinterpret_cast<const EncryptedFileHeader*>(data.data());
+    EXPECT_TRUE(header->is_supported());
+    EXPECT_EQ(Cipher::ChaCha20_Poly1305, header->get_cipher());
+
+    auto reader = FileReader::create(
+            file, [&key](auto) -> SharedKeyDerivationKey { return key; });
+    EXPECT_TRUE(reader->is_encrypted());
+    EXPECT_EQ(content, reader->read());
+}
+
 /**
  * Try to write a text which compress very well in multiple chunks to
  * the file and read the entire file back as one chunk (which internally
@@ -119,6 +156,233 @@ TEST_F(FileIoTest, FileWriterTestEncryptedCompressedZlib) {
     testEncryptedAndCompressed(file, Compression::ZLIB);
 }
 
+/**
+ * Write the same data with the serial and the parallel encrypted writer,
+ * and verify that the files use the same layout (the nonces are random so
+ * the bytes differ) and that the parallel file reads back correctly (the
+ * associated data includes the chunk offset so the chunks must be written
+ * in order with the correct offsets).
+ */
+static void testParallelEncryptedWriter(const std::filesystem::path& file,
+                                        Compression compression) {
+    SharedKeyDerivationKey key = KeyDerivationKey::generate();
+    const std::filesystem::path parallelFile = file.string() + ".parallel";
+    auto guard = folly::makeGuard([&]() { remove(parallelFile); });
+    std::string content;
+    {
+        auto serial = FileWriter::create(key, file, 0, compression);
+        auto parallel =
+                FileWriter::create(key, parallelFile, 0, compression, 4);
+        EXPECT_TRUE(parallel->is_encrypted());
+        for (int ii = 0; ii < 100; ++ii) {
+            const auto chunk = fmt::format("{}:{}", ii, std::string(ii, 'x'));
+            serial->write(chunk);
+            parallel->write(chunk);
+            content.append(chunk);
+            if (ii % 10 == 0) {
+                parallel->flush();
+            }
+        }
+        EXPECT_EQ(serial->size(), parallel->size());
+        serial->close();
+        parallel->close();
+    }
+    EXPECT_EQ(std::filesystem::file_size(file),
+              std::filesystem::file_size(parallelFile));
+
+    auto reader = FileReader::create(
+            parallelFile,
+            [&key](auto) -> SharedKeyDerivationKey { return key; });
+    EXPECT_TRUE(reader->is_encrypted());
+    EXPECT_EQ(content, reader->read());
+}
+
+TEST_F(FileIoTest, ParallelEncryptedWriter) {
+    testParallelEncryptedWriter(file, Compression::None);
+}
+
+TEST_F(FileIoTest, ParallelEncryptedWriterCompressed) {
+    testParallelEncryptedWriter(file, Compression::Snappy);
+}
+
+TEST_F(FileIoTest, ReadAheadEncrypted) {
+    SharedKeyDerivationKey key = KeyDerivationKey::generate();
+    auto lookup = [&key](auto) -> SharedKeyDerivationKey { return key; };
+    std::string content;
+    auto writer = FileWriter::create(key, file);
+    for (int ii = 0; ii < 200; ++ii) {
+        const auto chunk = fmt::format("{}:{}", ii, std::string(ii * 7, 'x'));
+        writer->write(chunk);
+        content.append(chunk);
+    }
+    writer->close();
+    writer.reset();
+
+    auto reader = FileReader::create(file, lookup, {}, 4);
+    EXPECT_TRUE(reader->is_encrypted());
+    EXPECT_EQ(content, reader->read());
+    EXPECT_TRUE(reader->eof());
+
+    // Read the data back through read() with a buffer which doesn't match
+    // the chunk sizes
+    reader = FileReader::create(file, lookup, {}, 4);
+    std::string data;
+    std::array<uint8_t, 333> buffer;
+    while (!reader->eof()) {
+        const auto nr = reader->read(buffer);
+        data.append(reinterpret_cast<const char*>(buffer.data()), nr);
+    }
+    EXPECT_EQ(content, data);
+
+    // A partial chunk is reported once all of the preceding data is read
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) - 1);
+    reader = FileReader::create(file, lookup, {}, 4);
+    data.clear();
+    try {
+        std::string chunk;
+        while (!(chunk = reader->nextChunk()).empty()) {
+            data.append(chunk);
+        }
+        FAIL() << "Expected the partial chunk to be detected";
+    } catch (const std::underflow_error&) {
+    }
+    EXPECT_LT(data.size(), content.size());
+    EXPECT_EQ(content.substr(0, data.size()), data);
+    EXPECT_GT(data.size(), content.size() - 200 * 7);
+}
+
+TEST_F(FileIoTest, VerifyEncrypted) {
+    SharedKeyDerivationKey key = KeyDerivationKey::generate();
+    auto lookup = [&key](auto) -> SharedKeyDerivationKey { return key; };
+    auto writer = FileWriter::create(key, file);
+    for (int ii = 0; ii < 200; ++ii) {
+        writer->write(fmt::format("{}:{}", ii, std::string(ii * 7, 'x')));
+    }
+    writer->close();
+    writer.reset();
+
+    const auto size = std::filesystem::file_size(file);
+    const auto serial = FileReader::verify(file, lookup);
+    EXPECT_LT(1, serial.chunks);
+    EXPECT_EQ(size, serial.bytes);
+    const auto parallel = FileReader::verify(file, lookup, 4);
+    EXPECT_EQ(serial.chunks, parallel.chunks);
+    EXPECT_EQ(serial.bytes, parallel.bytes);
+
+    // Flip a bit in the tag of the last chunk
+    auto data = cb::io::loadFile(file);
+    data.back() ^= 1;
+    cb::io::saveFile(file, data);
+    EXPECT_THROW(FileReader::verify(file, lookup), MacVerificationError);
+    EXPECT_THROW(FileReader::verify(file, lookup, 4), MacVerificationError);
+
+    // A partial chunk at the end of the file
+    data.pop_back();
+    cb::io::saveFile(file, data);
+    EXPECT_THROW(FileReader::verify(file, lookup), std::underflow_error);
+    EXPECT_THROW(FileReader::verify(file, lookup, 4), std::underflow_error);
+
+    // Plain files can't be verified
+    cb::io::saveFile(file, "This is not an encrypted file");
+    EXPECT_THROW(FileReader::verify(file, lookup), std::runtime_error);
+}
+
+/// Verify that pread() and seek() return the expected data
+static void testRandomAccess(FileReader& reader, const std::string& content) {
+    std::array<uint8_t, 100> buffer;
+    for (std::size_t offset = 0; offset <= content.size() + 10;
+         offset += 97) {
+        const auto nr = reader.pread(buffer, offset);
+        EXPECT_EQ(content.substr(std::min(offset, content.size()),
+                                 buffer.size()),
+                  std::string_view(
+                          reinterpret_cast<const char*>(buffer.data()), nr))
+                << "offset: " << offset;
+    }
+    // Read the rest of the file after a seek
+    reader.seek(content.size() / 2);
+    EXPECT_EQ(content.substr(content.size() / 2), reader.read());
+}
+
+TEST_F(FileIoTest, SeekPlain) {
+    std::string content;
+    auto writer = FileWriter::create({}, file);
+    for (int ii = 0; ii < 100; ++ii) {
+        content.append(fmt::format("{}:{}", ii, std::string(ii, 'x')));
+    }
+    writer->write(content);
+    writer->close();
+    writer.reset();
+    testRandomAccess(*FileReader::create(file, {}), content);
+}
+
+TEST_F(FileIoTest, SeekEncrypted) {
+    SharedKeyDerivationKey key = KeyDerivationKey::generate();
+    auto lookup = [&key](auto) -> SharedKeyDerivationKey { return key; };
+    const auto index = std::filesystem::path(file.string() + ".idx");
+    auto guard = folly::makeGuard([&]() { remove(index); });
+
+    std::string content;
+    auto writer = FileWriter::create(key, file, 0, Compression::None, 2, true);
+    for (int ii = 0; ii < 100; ++ii) {
+        const auto chunk = fmt::format("{}:{}", ii, std::string(ii, 'x'));
+        writer->write(chunk);
+        content.append(chunk);
+    }
+    writer->close();
+    writer.reset();
+    ASSERT_TRUE(exists(index));
+
+    auto reader = FileReader::create(file, lookup);
+    EXPECT_EQ(content, reader->read());
+
+    // With the index
+    auto testSeek = [&](std::size_t threads) {
+        SCOPED_TRACE(threads);
+        testRandomAccess(*FileReader::create(file, lookup, {}, threads),
+                         content);
+    };
+    testSeek(0);
+    testSeek(4);
+
+    // An index for another file is ignored (and the index is built from
+    // the chunk headers)
+    const auto other = std::filesystem::path(file.string() + ".other");
+    auto otherGuard = folly::makeGuard([&]() {
+        remove(other);
+        remove(std::filesystem::path(other.string() + ".idx"));
+    });
+    writer = FileWriter::create(key, other, 0, Compression::None, 0, true);
+    writer->write(content.substr(0, 1000));
+    writer->close();
+    writer.reset();
+    std::filesystem::copy_file(
+            other.string() + ".idx",
+            index,
+            std::filesystem::copy_options::overwrite_existing);
+    testSeek(0);
+
+    // Without the index
+    remove(index);
+    testSeek(0);
+    testSeek(4);
+}
+
+TEST_F(FileIoTest, SeekCompressedNotSupported) {
+    SharedKeyDerivationKey key = KeyDerivationKey::generate();
+    EXPECT_THROW(FileWriter::create(
+                         key, file, 0, Compression::Snappy, 0, true),
+                 std::invalid_argument);
+
+    auto writer = FileWriter::create(key, file, 0, Compression::Snappy);
+    writer->write("This is the content"sv);
+    writer->close();
+    writer.reset();
+    auto reader = FileReader::create(
+            file, [&key](auto) -> SharedKeyDerivationKey { return key; });
+    EXPECT_THROW(reader->seek(1), NotSupportedException);
+}
+
 TEST_F(FileIoTest, ReadFile) {
     const std::string_view content = "This is the content"sv;
     auto writer = FileWriter::create({}, file);
@@ -233,3 +497,29 @@ TEST_F(FileIoTest, TestReadWriteGzipFile) {
     reader.reset();
     EXPECT_EQ(content, data);
 }
+
+TEST_F(FileIoTest, FileReaderSnappyFramed) {
+    std::string content;
+    for (int ii = 0; ii < 20000; ++ii) {
+        content.append(fmt::format("This is line number {}\n", ii));
+    }
+    std::filesystem::path szfile = file.string() + ".sz";
+    auto guard = folly::makeGuard([&]() { remove(szfile); });
+    cb::compression::SnappyFramedSink sink(
+            std::make_unique<cb::io::FileSink>(szfile));
+    sink.sink(content);
+    sink.close();
+    const auto compressed = cb::io::loadFile(szfile);
+    EXPECT_LT(compressed.size(), content.size());
+
+    auto lookup = [](auto) -> SharedKeyDerivationKey { return {}; };
+    auto reader = FileReader::create(szfile, lookup);
+    EXPECT_FALSE(reader->is_encrypted());
+    EXPECT_EQ(content, reader->read());
+
+    // Without the extension the content is returned as is
+    std::filesystem::copy_file(
+            szfile, file, std::filesystem::copy_options::overwrite_existing);
+    reader = FileReader::create(file, lookup);
+    EXPECT_EQ(compressed, reader->read());
+}
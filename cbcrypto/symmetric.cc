@@ -11,10 +11,14 @@
 #include "cbcrypto/symmetric.h"
 
 #include <fmt/format.h>
+#include <folly/Synchronized.h>
 #include <openssl/core_names.h>
 #include <openssl/evp.h>
 
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 using namespace std::string_view_literals;
 
@@ -37,9 +41,84 @@ struct EvpCipherCtxDeleter {
 using EvpCipherCtxUniquePtr =
         std::unique_ptr<EVP_CIPHER_CTX, EvpCipherCtxDeleter>;
 
-class Aes256Gcm final : public SymmetricCipher {
+/**
+ * Initializing a cipher context runs the key schedule (and allocates
+ * memory), so instead of creating a new context for every message we keep
+ * a pool of contexts which are initialized with the key once. Each message
+ * only needs to set the nonce in a context from the pool.
+ *
+ * A context is only used by a single thread at a time: it is removed
+ * from the pool while in use (a new context is created if the pool is
+ * empty) and returned to the pool when the operation completes. A context
+ * is not returned to the pool if the operation fails.
+ */
+class CipherContextPool {
 public:
-    Aes256Gcm(std::string_view key, const char* properties);
+    CipherContextPool(const EVP_CIPHER* cipher,
+                      std::string_view key,
+                      bool encrypt)
+        : cipher(cipher), key(key), encrypt(encrypt) {
+    }
+
+    /// Get a context initialized with the key (but without a nonce)
+    EvpCipherCtxUniquePtr acquire() {
+        {
+            auto locked = contexts.lock();
+            if (!locked->empty()) {
+                auto ret = std::move(locked->back());
+                locked->pop_back();
+                return ret;
+            }
+        }
+
+        EvpCipherCtxUniquePtr ctx(EVP_CIPHER_CTX_new());
+        if (!ctx) {
+            throw OpenSslError::get("cb::crypto::CipherContextPool::acquire",
+                                    "EVP_CIPHER_CTX_new");
+        }
+        const auto* k = reinterpret_cast<const unsigned char*>(key.data());
+        if (EVP_CipherInit_ex2(ctx.get(),
+                               cipher,
+                               k,
+                               nullptr,
+                               encrypt ? 1 : 0,
+                               nullptr) != 1) {
+            throw OpenSslError::get("cb::crypto::CipherContextPool::acquire",
+                                    "EVP_CipherInit_ex2");
+        }
+        return ctx;
+    }
+
+    /// Return a context (after a successful operation) to the pool
+    void release(EvpCipherCtxUniquePtr ctx) {
+        auto locked = contexts.lock();
+        if (locked->size() < MaxPooledContexts) {
+            locked->emplace_back(std::move(ctx));
+        }
+    }
+
+protected:
+    /// The maximum number of idle contexts to keep around
+    static constexpr std::size_t MaxPooledContexts = 16;
+
+    const EVP_CIPHER* cipher;
+    const std::string_view key;
+    const bool encrypt;
+    folly::Synchronized<std::vector<EvpCipherCtxUniquePtr>, std::mutex>
+            contexts;
+};
+
+/**
+ * An AEAD cipher provided by OpenSSL with a 256 bit key, a 96 bit nonce
+ * and a 128 bit tag. AES-256-GCM and ChaCha20-Poly1305 share these
+ * parameters (and the EVP API used to set the nonce and tag) so they use
+ * the same implementation.
+ */
+class EvpAeadCipher final : public SymmetricCipher {
+public:
+    EvpAeadCipher(const char* algorithm,
+                  std::string_view key,
+                  const char* properties);
 
     void encrypt(std::string_view nonce,
                  gsl::span<char> ct,
@@ -69,40 +148,48 @@ protected:
     const std::unique_ptr<EVP_CIPHER, EvpCipherDeleter> cipher;
 
     std::array<char, KeySize> key;
+
+    CipherContextPool encryptContexts;
+    CipherContextPool decryptContexts;
 };
 
-Aes256Gcm::Aes256Gcm(std::string_view key, const char* properties)
-    : cipher(EVP_CIPHER_fetch(nullptr, "AES-256-GCM", properties)) {
+EvpAeadCipher::EvpAeadCipher(const char* algorithm,
+                             std::string_view key,
+                             const char* properties)
+    : cipher(EVP_CIPHER_fetch(nullptr, algorithm, properties)),
+      encryptContexts(cipher.get(), {this->key.data(), KeySize}, true),
+      decryptContexts(cipher.get(), {this->key.data(), KeySize}, false) {
     Expects(key.size() == KeySize);
     if (!cipher) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::Aes256Gcm",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::EvpAeadCipher",
                                 "EVP_CIPHER_fetch");
     }
+    Expects(static_cast<std::size_t>(EVP_CIPHER_get_key_length(
+                    cipher.get())) == KeySize);
+    Expects(static_cast<std::size_t>(EVP_CIPHER_get_iv_length(
+                    cipher.get())) == NonceSize);
     std::copy(key.begin(), key.end(), this->key.begin());
 }
 
-void Aes256Gcm::encrypt(std::string_view nonce,
-                        gsl::span<char> ct,
-                        gsl::span<char> mac,
-                        std::string_view msg,
-                        std::string_view ad) {
+void EvpAeadCipher::encrypt(std::string_view nonce,
+                            gsl::span<char> ct,
+                            gsl::span<char> mac,
+                            std::string_view msg,
+                            std::string_view ad) {
     Expects(nonce.size() == NonceSize);
     Expects(mac.size() == MacSize);
     Expects(ct.size() == msg.size());
     int outlen = 0;
-    EvpCipherCtxUniquePtr ctx(EVP_CIPHER_CTX_new());
-    if (!ctx) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
-                                "EVP_CIPHER_CTX_new");
-    }
+    auto ctx = encryptContexts.acquire();
     std::array<OSSL_PARAM, 2> params{{OSSL_PARAM_END, OSSL_PARAM_END}};
+    // The context is already keyed; only set the nonce
     if (EVP_EncryptInit_ex2(
                 ctx.get(),
-                cipher.get(),
-                reinterpret_cast<const unsigned char*>(key.data()),
+                nullptr,
+                nullptr,
                 reinterpret_cast<const unsigned char*>(nonce.data()),
                 params.data()) != 1) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::encrypt",
                                 "EVP_EncryptInit_ex2");
     }
     if (!ad.empty()) {
@@ -111,7 +198,7 @@ void Aes256Gcm::encrypt(std::string_view nonce,
                               &outlen,
                               reinterpret_cast<const unsigned char*>(ad.data()),
                               gsl::narrow_cast<int>(ad.size())) != 1) {
-            throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
+            throw OpenSslError::get("cb::crypto::EvpAeadCipher::encrypt",
                                     "EVP_EncryptUpdate(ad)");
         }
     }
@@ -121,49 +208,47 @@ void Aes256Gcm::encrypt(std::string_view nonce,
                           reinterpret_cast<const unsigned char*>(msg.data()),
                           gsl::narrow_cast<int>(msg.size())) != 1 ||
         static_cast<std::size_t>(outlen) != ct.size()) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::encrypt",
                                 "EVP_EncryptUpdate(msg)");
     }
     unsigned char dummyBuffer; // No output expected
     if (EVP_EncryptFinal_ex(ctx.get(), &dummyBuffer, &outlen) != 1) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::encrypt",
                                 "EVP_EncryptFinal_ex");
     }
     params[0] = OSSL_PARAM_construct_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG,
                                                   const_cast<char*>(mac.data()),
                                                   mac.size());
     if (EVP_CIPHER_CTX_get_params(ctx.get(), params.data()) != 1) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::encrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::encrypt",
                                 "EVP_CIPHER_CTX_get_params");
     }
+    encryptContexts.release(std::move(ctx));
 }
 
-void Aes256Gcm::decrypt(std::string_view nonce,
-                        std::string_view ct,
-                        std::string_view mac,
-                        gsl::span<char> msg,
-                        std::string_view ad) {
+void EvpAeadCipher::decrypt(std::string_view nonce,
+                            std::string_view ct,
+                            std::string_view mac,
+                            gsl::span<char> msg,
+                            std::string_view ad) {
     Expects(nonce.size() == NonceSize);
     Expects(mac.size() == MacSize);
     Expects(ct.size() == msg.size());
     int outlen = 0;
-    EvpCipherCtxUniquePtr ctx(EVP_CIPHER_CTX_new());
-    if (!ctx) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::decrypt",
-                                "EVP_CIPHER_CTX_new");
-    }
+    auto ctx = decryptContexts.acquire();
     std::array<OSSL_PARAM, 2> params{
             {OSSL_PARAM_construct_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG,
                                                const_cast<char*>(mac.data()),
                                                mac.size()),
              OSSL_PARAM_END}};
+    // The context is already keyed; only set the nonce (and the tag)
     if (EVP_DecryptInit_ex2(
                 ctx.get(),
-                cipher.get(),
-                reinterpret_cast<const unsigned char*>(key.data()),
+                nullptr,
+                nullptr,
                 reinterpret_cast<const unsigned char*>(nonce.data()),
                 params.data()) != 1) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::decrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::decrypt",
                                 "EVP_DecryptInit_ex2");
     }
     if (!ad.empty()) {
@@ -172,7 +257,7 @@ void Aes256Gcm::decrypt(std::string_view nonce,
                               &outlen,
                               reinterpret_cast<const unsigned char*>(ad.data()),
                               gsl::narrow_cast<int>(ad.size())) != 1) {
-            throw OpenSslError::get("cb::crypto::Aes256Gcm::decrypt",
+            throw OpenSslError::get("cb::crypto::EvpAeadCipher::decrypt",
                                     "EVP_DecryptUpdate(ad)");
         }
     }
@@ -182,15 +267,16 @@ void Aes256Gcm::decrypt(std::string_view nonce,
                           reinterpret_cast<const unsigned char*>(ct.data()),
                           gsl::narrow_cast<int>(ct.size())) != 1 ||
         static_cast<std::size_t>(outlen) != msg.size()) {
-        throw OpenSslError::get("cb::crypto::Aes256Gcm::decrypt",
+        throw OpenSslError::get("cb::crypto::EvpAeadCipher::decrypt",
                                 "EVP_DecryptUpdate(msg)");
     }
     unsigned char dummyBuffer; // No output expected
     if (EVP_DecryptFinal_ex(ctx.get(), &dummyBuffer, &outlen) != 1) {
         throw MacVerificationError(
-                "cb::crypto::Aes256Gcm::decrypt: "
+                "cb::crypto::EvpAeadCipher::decrypt: "
                 "MAC verification failed");
     }
+    decryptContexts.release(std::move(ctx));
 }
 
 /**
@@ -238,6 +324,58 @@ protected:
     unsigned char len;
 };
 
+/// Get the OpenSSL name of the cipher (nullptr if it isn't an EVP cipher)
+static const char* getAlgorithmName(Cipher cipher) {
+    switch (cipher) {
+    case Cipher::None:
+        return nullptr;
+    case Cipher::AES_256_GCM:
+        return "AES-256-GCM";
+    case Cipher::ChaCha20_Poly1305:
+        return "ChaCha20-Poly1305";
+    }
+    return nullptr;
+}
+
+/**
+ * Time how long it takes to encrypt a few blocks with each of the ciphers
+ * on this host and return the fastest one. AES-256-GCM is the fastest on
+ * CPUs with AES and carry-less multiplication instructions, whereas
+ * ChaCha20-Poly1305 is typically faster on CPUs without them. A cipher
+ * which can't be used (e.g. ChaCha20-Poly1305 with the FIPS provider) is
+ * ignored.
+ */
+static Cipher measurePreferredCipher() {
+    constexpr std::size_t BlockSize = 16 * 1024;
+    constexpr int Iterations = 64;
+    constexpr int Runs = 3;
+
+    std::string block(BlockSize, 'x');
+    std::array<char, EvpAeadCipher::MacSize> mac{};
+    auto preferred = Cipher::AES_256_GCM;
+    auto fastest = std::chrono::steady_clock::duration::max();
+    for (const auto cipher : {Cipher::AES_256_GCM, Cipher::ChaCha20_Poly1305}) {
+        try {
+            auto instance = SymmetricCipher::create(
+                    cipher, SymmetricCipher::generateKey(cipher));
+            for (int run = 0; run < Runs; ++run) {
+                const auto start = std::chrono::steady_clock::now();
+                for (int ii = 0; ii < Iterations; ++ii) {
+                    instance->encrypt(ii, block, mac, block);
+                }
+                const auto duration = std::chrono::steady_clock::now() - start;
+                if (duration < fastest) {
+                    fastest = duration;
+                    preferred = cipher;
+                }
+            }
+        } catch (const std::exception&) {
+            // The cipher isn't available
+        }
+    }
+    return preferred;
+}
+
 } // namespace internal
 
 void SymmetricCipher::encrypt(std::uint64_t nonce,
@@ -301,10 +439,11 @@ std::string SymmetricCipher::decrypt(std::string_view ct, std::string_view ad) {
 }
 
 std::string SymmetricCipher::generateKey(Cipher cipher) {
-    if (cipher == Cipher::AES_256_GCM) {
+    const auto* algorithm = internal::getAlgorithmName(cipher);
+    if (algorithm) {
         using namespace cb::crypto::internal;
         EvpCipherUniquePtr evp_cipher(
-                EVP_CIPHER_fetch(nullptr, "AES-256-GCM", ""));
+                EVP_CIPHER_fetch(nullptr, algorithm, ""));
         if (!evp_cipher) {
             throw OpenSslError::get("cb::crypto::SymmetricCipher::generateKey",
                                     "EVP_CIPHER_fetch");
@@ -312,7 +451,7 @@ std::string SymmetricCipher::generateKey(Cipher cipher) {
 
         std::string ret;
         ret.resize(EVP_CIPHER_get_key_length(evp_cipher.get()));
-        Expects(ret.size() == internal::Aes256Gcm::KeySize);
+        Expects(ret.size() == internal::EvpAeadCipher::KeySize);
         randomBytes(ret);
         return ret;
     }
@@ -329,20 +468,28 @@ std::unique_ptr<SymmetricCipher> SymmetricCipher::create(
     case Cipher::None:
         break;
     case Cipher::AES_256_GCM:
-        Expects(key.size() == internal::Aes256Gcm::KeySize);
-        return std::make_unique<internal::Aes256Gcm>(key, properties);
+    case Cipher::ChaCha20_Poly1305:
+        Expects(key.size() == internal::EvpAeadCipher::KeySize);
+        return std::make_unique<internal::EvpAeadCipher>(
+                internal::getAlgorithmName(cipher), key, properties);
     }
     throw NotSupportedException(fmt::format(
             "cb::crypto::SymmetricCipher::create: Cipher {} not supported",
             cipher));
 }
 
+Cipher SymmetricCipher::getPreferredCipher() {
+    static const Cipher preferred = internal::measurePreferredCipher();
+    return preferred;
+}
+
 std::size_t SymmetricCipher::getKeySize(Cipher cipher) {
     switch (cipher) {
     case Cipher::None:
         return 0;
     case Cipher::AES_256_GCM:
-        return internal::Aes256Gcm::KeySize;
+    case Cipher::ChaCha20_Poly1305:
+        return internal::EvpAeadCipher::KeySize;
     }
     throw std::invalid_argument(fmt::format(
             "SymmetricCipher::getKeySize(Cipher cipher): Unknown cipher: {}",
@@ -354,7 +501,8 @@ std::size_t SymmetricCipher::getNonceSize(Cipher cipher) {
     case Cipher::None:
         return 0;
     case Cipher::AES_256_GCM:
-        return internal::Aes256Gcm::NonceSize;
+    case Cipher::ChaCha20_Poly1305:
+        return internal::EvpAeadCipher::NonceSize;
     }
     throw std::invalid_argument(fmt::format(
             "SymmetricCipher::getNonceSize(Cipher cipher): Unknown cipher: {}",
@@ -366,7 +514,8 @@ std::size_t SymmetricCipher::getMacSize(Cipher cipher) {
     case Cipher::None:
         return 0;
     case Cipher::AES_256_GCM:
-        return internal::Aes256Gcm::MacSize;
+    case Cipher::ChaCha20_Poly1305:
+        return internal::EvpAeadCipher::MacSize;
     }
     throw std::invalid_argument(fmt::format(
             "SymmetricCipher::getMacSize(Cipher cipher): Unknown cipher: {}",
@@ -0,0 +1,157 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#include <benchmark/benchmark.h>
+#include <cbcrypto/symmetric.h>
+#include <folly/portability/GTest.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+
+#include <array>
+#include <memory>
+#include <string>
+
+using namespace cb::crypto;
+
+static std::string nonceFor(uint64_t counter) {
+    std::string nonce(SymmetricCipher::getNonceSize(Cipher::AES_256_GCM), 0);
+    for (size_t ii = 0; ii < sizeof(counter); ++ii) {
+        nonce[nonce.size() - 1 - ii] = static_cast<char>(counter >> (ii * 8));
+    }
+    return nonce;
+}
+
+/**
+ * Encrypt chunks with a SymmetricCipher which is reused for all chunks.
+ * Compare AES-256-GCM and ChaCha20-Poly1305 to see which cipher is the
+ * fastest on the host (which is what SymmetricCipher::getPreferredCipher()
+ * measures at runtime)
+ */
+static void BM_Encrypt(benchmark::State& state, Cipher type) {
+    const auto key = SymmetricCipher::generateKey(type);
+    auto cipher = SymmetricCipher::create(type, key);
+    const std::string msg(state.range(0), 'a');
+    std::string ct(msg.size(), 0);
+    std::string mac(cipher->getMacSize(), 0);
+    uint64_t counter = 0;
+    while (state.KeepRunning()) {
+        cipher->encrypt(++counter, ct, mac, msg);
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK_CAPTURE(BM_Encrypt, AES_256_GCM, Cipher::AES_256_GCM)
+        ->RangeMultiplier(4)
+        ->Range(4096, 1 << 20);
+BENCHMARK_CAPTURE(BM_Encrypt, ChaCha20_Poly1305, Cipher::ChaCha20_Poly1305)
+        ->RangeMultiplier(4)
+        ->Range(4096, 1 << 20);
+
+/// Decrypt chunks with a SymmetricCipher which is reused for all chunks
+static void BM_Decrypt(benchmark::State& state, Cipher type) {
+    const auto key = SymmetricCipher::generateKey(type);
+    auto cipher = SymmetricCipher::create(type, key);
+    const std::string msg(state.range(0), 'a');
+    std::string ct(msg.size(), 0);
+    std::string mac(cipher->getMacSize(), 0);
+    cipher->encrypt(1, ct, mac, msg);
+    std::string plain(msg.size(), 0);
+    while (state.KeepRunning()) {
+        cipher->decrypt(1, ct, mac, plain);
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK_CAPTURE(BM_Decrypt, AES_256_GCM, Cipher::AES_256_GCM)
+        ->RangeMultiplier(4)
+        ->Range(4096, 1 << 20);
+BENCHMARK_CAPTURE(BM_Decrypt, ChaCha20_Poly1305, Cipher::ChaCha20_Poly1305)
+        ->RangeMultiplier(4)
+        ->Range(4096, 1 << 20);
+
+struct EvpCipherDeleter {
+    void operator()(EVP_CIPHER* ptr) {
+        EVP_CIPHER_free(ptr);
+    }
+};
+
+struct EvpCipherCtxDeleter {
+    void operator()(EVP_CIPHER_CTX* ptr) {
+        EVP_CIPHER_CTX_free(ptr);
+    }
+};
+
+/**
+ * The baseline: create and key a new cipher context for every chunk (which
+ * is what SymmetricCipher used to do)
+ */
+static void BM_Aes256Gcm_EncryptNewContext(benchmark::State& state) {
+    const auto key = SymmetricCipher::generateKey(Cipher::AES_256_GCM);
+    std::unique_ptr<EVP_CIPHER, EvpCipherDeleter> cipher(
+            EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr));
+    ASSERT_TRUE(cipher);
+    const std::string msg(state.range(0), 'a');
+    std::string ct(msg.size(), 0);
+    std::string mac(SymmetricCipher::getMacSize(Cipher::AES_256_GCM), 0);
+    uint64_t counter = 0;
+    while (state.KeepRunning()) {
+        const auto nonce = nonceFor(++counter);
+        std::unique_ptr<EVP_CIPHER_CTX, EvpCipherCtxDeleter> ctx(
+                EVP_CIPHER_CTX_new());
+        int outlen = 0;
+        auto* out = reinterpret_cast<unsigned char*>(ct.data());
+        ASSERT_EQ(1,
+                  EVP_EncryptInit_ex2(
+                          ctx.get(),
+                          cipher.get(),
+                          reinterpret_cast<const unsigned char*>(key.data()),
+                          reinterpret_cast<const unsigned char*>(nonce.data()),
+                          nullptr));
+        ASSERT_EQ(1,
+                  EVP_EncryptUpdate(
+                          ctx.get(),
+                          out,
+                          &outlen,
+                          reinterpret_cast<const unsigned char*>(msg.data()),
+                          int(msg.size())));
+        ASSERT_EQ(1, EVP_EncryptFinal_ex(ctx.get(), out + outlen, &outlen));
+        std::array<OSSL_PARAM, 2> params{
+                {OSSL_PARAM_construct_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG,
+                                                   mac.data(),
+                                                   mac.size()),
+                 OSSL_PARAM_END}};
+        ASSERT_EQ(1, EVP_CIPHER_CTX_get_params(ctx.get(), params.data()));
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_Aes256Gcm_EncryptNewContext)
+        ->RangeMultiplier(4)
+        ->Range(4096, 1 << 20);
+
+/// Encrypt chunks from multiple threads sharing the same SymmetricCipher
+static void BM_Aes256Gcm_EncryptShared(benchmark::State& state) {
+    static std::unique_ptr<SymmetricCipher> cipher;
+    if (state.thread_index() == 0) {
+        cipher = SymmetricCipher::create(
+                Cipher::AES_256_GCM,
+                SymmetricCipher::generateKey(Cipher::AES_256_GCM));
+    }
+    const std::string msg(state.range(0), 'a');
+    std::string ct(msg.size(), 0);
+    std::string mac(SymmetricCipher::getMacSize(Cipher::AES_256_GCM), 0);
+    uint64_t counter = uint64_t(state.thread_index()) << 32;
+    while (state.KeepRunning()) {
+        cipher->encrypt(++counter, ct, mac, msg);
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+    if (state.thread_index() == 0) {
+        cipher.reset();
+    }
+}
+BENCHMARK(BM_Aes256Gcm_EncryptShared)
+        ->Arg(64 * 1024)
+        ->ThreadRange(1, 8);
@@ -110,9 +110,42 @@ namespace JSON_checker {
          */
         bool validate(std::string_view data);
 
+        /**
+         * Start validating a document which is passed to the validator
+         * in pieces by using feed() (for instance as it is being inflated).
+         * The scalar implementation is always used for such documents.
+         */
+        void begin();
+
+        /**
+         * Parse the next piece of the document started with begin()
+         *
+         * @param data pointer to the data to check
+         * @param size the number of bytes to check
+         * @return false if the document is known to be invalid, true
+         *         otherwise
+         * @throws std::bad_alloc for memory allocation problems related to
+         *         the internal state array
+         */
+        bool feed(const uint8_t* data, size_t size);
+
+        bool feed(std::string_view data);
+
+        /**
+         * Complete the validation of the document started with begin()
+         *
+         * @return true if the entire document is valid json, false otherwise
+         */
+        bool finish();
+
     private:
         Instance instance;
         const bool preferVectorized;
+        /// The number of bytes the current UTF-8 code point extends into
+        /// the next piece of the document (see feed())
+        int expect = 0;
+        /// If the document fed to the validator is valid so far
+        bool valid = true;
     };
 }
 
@@ -19,7 +19,8 @@ namespace cb::crypto {
 enum class Cipher {
     /// Special value indicating no cipher
     None,
-    AES_256_GCM
+    AES_256_GCM,
+    ChaCha20_Poly1305
 };
 
 [[nodiscard]] std::string format_as(const Cipher& cipher);
@@ -0,0 +1,123 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <cbcrypto/common.h>
+#include <cbcrypto/secret.h>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace cb::crypto {
+
+class EncryptedFileHeader;
+
+/**
+ * The DerivedKeyCache keeps the keys derived for encrypted files (see
+ * EncryptedFileHeader::derive_key()) so that opening the same file again
+ * doesn't have to run the key derivation function (which for password
+ * based derivation may be hundreds of thousands of PBKDF2 iterations).
+ *
+ * The entries are keyed by the key derivation key (its id and a keyed
+ * fingerprint of the key material, as the id alone isn't unique for
+ * password based keys), the derivation method and parameters, and the
+ * salt of the file. The cache is bounded (the least recently used entry
+ * is evicted) and the derived keys are wiped from memory when they are
+ * evicted or the cache is cleared.
+ *
+ * The cache doesn't know when a key is dropped (the key stores are owned by
+ * the callers), so the keys derived from a dropped key stay in memory until
+ * they are evicted unless the owner calls invalidate().
+ *
+ * The cache is thread safe.
+ */
+class DerivedKeyCache {
+public:
+    /// The default maximum number of keys in the cache
+    static constexpr std::size_t DefaultCapacity = 1024;
+
+    /// Get the cache used by EncryptedFileHeader::derive_key()
+    static DerivedKeyCache& instance();
+
+    explicit DerivedKeyCache(std::size_t capacity = DefaultCapacity);
+    DerivedKeyCache(const DerivedKeyCache&) = delete;
+    DerivedKeyCache& operator=(const DerivedKeyCache&) = delete;
+
+    /**
+     * Get the key derived from the key derivation key for the file with
+     * the provided header
+     *
+     * @param header The header of the file
+     * @param kdk The key derivation key
+     * @param derive The function to derive the key if it isn't cached
+     * @return The derived key
+     */
+    std::string get(const EncryptedFileHeader& header,
+                    const KeyDerivationKey& kdk,
+                    const std::function<std::string()>& derive);
+
+    /**
+     * Remove (and wipe) all of the keys derived from the named key. Must be
+     * called on instance() by the owner of the key store whenever it drops
+     * a key (for instance once findDeksInUse() no longer reports a retired
+     * key and it is removed from the KeyStore), so that no key material
+     * derived from it outlives the key.
+     */
+    void invalidate(std::string_view id);
+
+    /// Remove (and wipe) all of the keys
+    void clear();
+
+    /// Set the maximum number of keys in the cache (0 disables the cache)
+    void set_capacity(std::size_t value);
+
+    /// Get the number of keys in the cache
+    [[nodiscard]] std::size_t size() const;
+
+    /// Get the number of lookups which found the key in the cache
+    [[nodiscard]] std::size_t get_hits() const;
+
+    /// Get the number of lookups which had to derive the key
+    [[nodiscard]] std::size_t get_misses() const;
+
+protected:
+    struct Entry {
+        /// The lookup key (see make_key())
+        std::string key;
+        /// The id of the key derivation key
+        std::string id;
+        SecretString derived;
+    };
+
+    /// Build the lookup key for the header and key derivation key
+    [[nodiscard]] std::string make_key(const EncryptedFileHeader& header,
+                                       const KeyDerivationKey& kdk) const;
+
+    /// Evict the least recently used entries until the size is within
+    /// the capacity (must be called with the mutex held)
+    void prune();
+
+    /// Random key used to fingerprint the key material in the lookup key
+    const std::string fingerprint_key;
+
+    mutable std::mutex mutex;
+    /// The entries ordered by use (most recently used first)
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    std::size_t capacity;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+};
+
+} // namespace cb::crypto
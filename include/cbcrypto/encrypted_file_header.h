@@ -44,6 +44,10 @@ public:
     [[nodiscard]] bool is_supported() const;
     /// Get the compression type used in the file
     [[nodiscard]] Compression get_compression() const;
+    /// Get the cipher used to encrypt the chunks in the file
+    [[nodiscard]] Cipher get_cipher() const;
+    /// Set the cipher used to encrypt the chunks in the file
+    void set_cipher(Cipher cipher);
     /// Get the key derivation method used in the file
     [[nodiscard]] KeyDerivationMethod get_key_derivation() const;
     /// Get the number of iterations for PBKDF2
@@ -68,7 +72,8 @@ protected:
     uint8_t version{0};
     uint8_t compression{0};
     uint8_t key_derivation{0};
-    std::array<uint8_t, 3> unused{};
+    uint8_t cipher{0};
+    std::array<uint8_t, 2> unused{};
     uint8_t id_size = 0;
     std::array<char, 36> id{};
     std::array<uint8_t, 16> salt{};
@@ -31,12 +31,18 @@ public:
     /// The default maximum allowed chunk size
     static constexpr std::size_t default_max_allowed_chunk_size =
             10 * 1024 * 1024;
+    /// The maximum number of bytes of encrypted chunks to read ahead
+    static constexpr std::size_t default_read_ahead_budget = 8 * 1024 * 1024;
     /**
      * Create a new instance of the FileReader
      *
      * @param path The file to read
      * @param key_lookup_function A function to look up the named key
      * @param waittime The wait time for the file to appear (if missing)
+     * @param read_ahead_threads The number of threads used to decrypt the
+     *                           chunks of an encrypted file ahead of the
+     *                           consumer (0 decrypts each chunk on the
+     *                           calling thread when it is needed)
      * @return A new instance of the file reader
      * @throws std::runtime_error if an error occurs
      */
@@ -44,7 +50,54 @@ public:
             const std::filesystem::path& path,
             const std::function<SharedKeyDerivationKey(std::string_view)>&
                     key_lookup_function,
-            std::chrono::microseconds waittime = {});
+            std::chrono::microseconds waittime = {},
+            std::size_t read_ahead_threads = 0);
+
+    /// The result of verify()
+    struct VerifyResult {
+        /// The number of chunks verified
+        std::size_t chunks = 0;
+        /// The size of the file
+        std::size_t bytes = 0;
+    };
+
+    /**
+     * Verify the integrity of an encrypted file by checking the
+     * authentication tag of every chunk (without returning the content).
+     * The chunks are read sequentially on the calling thread and verified
+     * by up to `threads` threads. The kernel is told that the file is read
+     * sequentially and that the pages won't be needed again, so scrubbing
+     * a file doesn't evict more useful data from the page cache.
+     *
+     * @param path The file to verify
+     * @param key_lookup_function A function to look up the named key
+     *                            (only called from the calling thread)
+     * @param threads The number of threads to verify chunks (0 verifies
+     *                the chunks on the calling thread)
+     * @return The number of chunks and bytes verified
+     * @throws MacVerificationError if a chunk is corrupt (the message
+     *                              contains the offset of the chunk)
+     * @throws std::underflow_error if the file ends with a partial chunk
+     * @throws std::runtime_error if the file isn't encrypted, the key is
+     *                            missing or an error occurs
+     */
+    static VerifyResult verify(
+            const std::filesystem::path& path,
+            const std::function<SharedKeyDerivationKey(std::string_view)>&
+                    key_lookup_function,
+            std::size_t threads = 0);
+
+    /**
+     * Create a new instance of the FileReader which decodes a stream in
+     * the Snappy framing format (see cb::compression::SnappyFramedSink)
+     * read from the provided reader. Note that create() automatically
+     * decodes plain files with the .sz extension (but no other files).
+     *
+     * @param reader The reader to read the compressed stream from
+     * @return A new instance of the file reader
+     */
+    static std::unique_ptr<FileReader> wrap_with_snappy_framing(
+            std::unique_ptr<FileReader> reader);
 
     /// Is the file being read encrypted or not
     [[nodiscard]] virtual bool is_encrypted() const = 0;
@@ -97,6 +150,35 @@ public:
     /// Return true when we've hit the end of the stream
     virtual bool eof() = 0;
 
+    /**
+     * Move the read position to the provided offset in the (decrypted)
+     * content of the file.
+     *
+     * Plain files are positioned directly. Uncompressed encrypted files
+     * use the chunk index written next to the file (see
+     * FileWriter::create()) to locate the chunk containing the offset so
+     * that only that chunk needs to be decrypted. If the index is missing
+     * (or doesn't match the file) it is built by reading the length field
+     * of each chunk (without decrypting them). The index is loaded the
+     * first time seek() is called.
+     *
+     * Seeking past the end positions the reader at the end of the file.
+     *
+     * @param offset The offset to read from
+     * @throws NotSupportedException if the reader doesn't support random
+     *                               access (compressed files)
+     * @throws std::runtime_error if an error occurs
+     */
+    virtual void seek(std::size_t offset);
+
+    /**
+     * Read up to buffer.size() bytes starting at the provided offset
+     * (see seek()). The read position is left after the data read.
+     *
+     * @return The number of bytes read
+     */
+    std::size_t pread(std::span<uint8_t> buffer, std::size_t offset);
+
 protected:
     FileReader() = default;
 };
@@ -12,13 +12,87 @@
 
 #include "common.h"
 
+#include <folly/CancellationToken.h>
 #include <nlohmann/json_fwd.hpp>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace cb::crypto {
 
+/**
+ * Cache for findDeksInUse() which remembers the key id found in the header
+ * of each file together with the inode, modification time and size of the
+ * file. Repeated scans only need to read the header of the files which
+ * changed since the previous scan.
+ *
+ * The cache is thread safe.
+ */
+class DekScanCache {
+public:
+    /// The attributes used to detect that a file changed
+    struct FileVersion {
+        uint64_t inode = 0;
+        /// Modification time in nanoseconds since the epoch
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        bool operator==(const FileVersion&) const = default;
+    };
+
+    /// Get the key id for the file if the cached entry is for the same
+    /// version of the file
+    std::optional<std::string> lookup(const std::filesystem::path& path,
+                                      const FileVersion& version);
+
+    /// Insert (or replace) the key id for the file
+    void insert(const std::filesystem::path& path,
+                const FileVersion& version,
+                std::string key);
+
+    /// Remove the entries for the files in the directory which aren't in
+    /// the provided list
+    void prune(const std::filesystem::path& directory,
+               const std::vector<std::filesystem::path>& keep);
+
+    /// Remove all entries
+    void clear();
+
+    /// Get the number of files in the cache
+    [[nodiscard]] std::size_t size() const;
+
+    /// Get the number of lookups which found a current entry
+    [[nodiscard]] std::size_t get_hits() const;
+
+    /// Get the number of lookups which had to read the file
+    [[nodiscard]] std::size_t get_misses() const;
+
+protected:
+    struct Entry {
+        FileVersion version;
+        std::string key;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+};
+
+/// Options to control how findDeksInUse() scans the directory
+struct FindDeksOptions {
+    /// The number of files to read the header from in parallel (0 and 1
+    /// reads the files on the calling thread)
+    std::size_t concurrency = 1;
+    /// Cache to look up (and store) the key id for the files
+    DekScanCache* cache = nullptr;
+};
+
 /**
  * Find all the DEKs in use in the specified directory
  *
@@ -33,6 +107,19 @@ std::unordered_set<std::string> findDeksInUse(
         const std::function<void(std::string_view, const nlohmann::json&)>&
                 error);
 
+/**
+ * Find all the DEKs in use in the specified directory like the method
+ * above, but read the file headers in parallel and (optionally) use a
+ * cache to avoid reading the files which didn't change since the last
+ * scan. The callbacks are only called from the calling thread.
+ */
+std::unordered_set<std::string> findDeksInUse(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&)>& filefilter,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error,
+        const FindDeksOptions& options);
+
 /**
  * Iterate over all files in the specified directory and potentially
  * rewrite all files.
@@ -61,4 +148,58 @@ void maybeRewriteFiles(
         std::string_view unencrypted_extension = ".txt",
         bool compression = false);
 
+/// The progress of a maybeRewriteFiles() call
+struct RewriteProgress {
+    /// The number of files selected to be rewritten
+    std::size_t files_total = 0;
+    /// The number of files successfully rewritten
+    std::size_t files_rewritten = 0;
+    /// The number of files which failed to be rewritten
+    std::size_t files_failed = 0;
+    /// The number of bytes read from the rewritten files
+    std::size_t bytes_read = 0;
+    /// Set if the operation was cancelled before all files were rewritten
+    bool cancelled = false;
+};
+
+/// Options to control how maybeRewriteFiles() rewrites the files
+struct RewriteOptions {
+    /// The number of files to rewrite in parallel (0 and 1 rewrites the
+    /// files on the calling thread)
+    std::size_t concurrency = 1;
+    /// The maximum number of bytes per second to read from the files
+    /// (shared between all threads). 0 means unlimited
+    std::size_t bytes_per_second = 0;
+    /// Called (serialized) every time a file is done
+    std::function<void(const RewriteProgress&)> progress;
+    /// Cancel the operation. Files already rewritten stay rewritten, and
+    /// files being rewritten are left untouched
+    folly::CancellationToken cancellation;
+};
+
+/**
+ * Iterate over all files in the specified directory and potentially
+ * rewrite all files like the method above, but rewrite multiple files
+ * in parallel and throttle the rate the files are read (to avoid starving
+ * other I/O on the system).
+ *
+ * Unlike the method above a failure to rewrite a file is reported through
+ * the error callback and the next file is rewritten. The callbacks are
+ * never called in parallel.
+ *
+ * @return the progress when the operation completed (or was cancelled)
+ */
+RewriteProgress maybeRewriteFiles(
+        const std::filesystem::path& directory,
+        const std::function<bool(const std::filesystem::path&,
+                                 std::string_view)>& filefilter,
+        SharedKeyDerivationKey derivation_key,
+        const std::function<SharedKeyDerivationKey(std::string_view)>&
+                key_lookup_function,
+        const std::function<void(std::string_view, const nlohmann::json&)>&
+                error,
+        const RewriteOptions& options,
+        std::string_view unencrypted_extension = ".txt",
+        bool compression = false);
+
 } // namespace cb::crypto
@@ -33,13 +33,26 @@ public:
      * @param buffer_size An optional buffer size to buffer data before
      *                    encrypting and writing to disk - useful for encrypted
      *                    logfiles to avoid writing small chunks
+     * @param compression The compression to use
+     * @param encryption_threads The number of threads to encrypt chunks on
+     *                           in parallel (0 encrypts the chunks on the
+     *                           calling thread). The file format is the
+     *                           same in both modes
+     * @param chunk_index Set to true to write an index of the chunks in an
+     *                    uncompressed encrypted file to path + ".idx" when
+     *                    the writer is closed, allowing FileReader::seek()
+     *                    without scanning the file
      * @return A new FileWriter instance
+     * @throws std::invalid_argument if a chunk index is requested for a
+     *                               compressed file
      */
     static std::unique_ptr<FileWriter> create(
             const SharedKeyDerivationKey& kdk,
             std::filesystem::path path,
             size_t buffer_size = 0,
-            Compression compression = Compression::None);
+            Compression compression = Compression::None,
+            size_t encryption_threads = 0,
+            bool chunk_index = false);
 
     /**
      * Create a new instance of the FileWriter which encrypts data and wraps an
@@ -50,13 +63,23 @@ public:
      * @param buffer_size An optional buffer size to buffer data before
      *                    encrypting and writing to disk - useful for encrypted
      *                    logfiles to avoid writing small chunks
+     * @param compression The compression to use
+     * @param encryption_threads The number of threads to encrypt chunks on
+     *                           in parallel (0 encrypts the chunks on the
+     *                           calling thread)
+     * @param index_path Where to write the chunk index when the writer is
+     *                   closed (empty for no index)
      * @return A new FileWriter instance
+     * @throws std::invalid_argument if a chunk index is requested for a
+     *                               compressed file
      */
     static std::unique_ptr<FileWriter> wrap_with_encryption(
             const SharedKeyDerivationKey& kdk,
             std::unique_ptr<FileWriter> writer,
             size_t buffer_size = 0,
-            Compression compression = Compression::None);
+            Compression compression = Compression::None,
+            size_t encryption_threads = 0,
+            std::filesystem::path index_path = {});
 
     /// Is the file being read encrypted or not
     [[nodiscard]] virtual bool is_encrypted() const = 0;
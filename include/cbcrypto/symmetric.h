@@ -26,6 +26,11 @@ public:
  *
  * Intended for ciphers/modes that verify data integrity and
  * don't require padding.
+ *
+ * The key schedule is only set up once per instance (and reused for each
+ * message), so an instance should be kept around and reused for all
+ * messages using the same key. The methods may be called from multiple
+ * threads at the same time.
  */
 class SymmetricCipher {
 public:
@@ -155,6 +160,14 @@ public:
 
     virtual ~SymmetricCipher() = default;
 
+    /**
+     * Get the cipher which is the fastest on this host (AES-256-GCM or
+     * ChaCha20-Poly1305). The ciphers are timed the first time the method
+     * is called (which takes a few milliseconds), and the result is reused
+     * for the lifetime of the process.
+     */
+    static Cipher getPreferredCipher();
+
     /// Request the key size for the provided cipher
     static std::size_t getKeySize(Cipher cipher);
 
@@ -56,4 +56,22 @@ void initialize();
  * @return a string containing the backtrace
  */
 [[nodiscard]] std::string current();
+
+/**
+ * Capture the return addresses of the current thread's stack without
+ * resolving them, which is cheap enough to be done on a (sampled) hot path.
+ *
+ * @param frames the array to populate, innermost frame first
+ * @param size the number of entries in frames
+ * @param skip the number of innermost frames to omit, 0 starts at the caller
+ *             of capture
+ * @return the number of frames stored
+ */
+size_t capture(void** frames, size_t size, size_t skip = 0);
+
+/**
+ * Get the (demangled) name of the function containing the given address,
+ * or the address in hex if no symbol can be found.
+ */
+[[nodiscard]] std::string symbolize(const void* address);
 }
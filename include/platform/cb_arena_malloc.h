@@ -67,6 +67,7 @@
 
 #include <platform/cb_arena_malloc_client.h>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 
 #if defined(HAVE_JEMALLOC)
@@ -82,6 +83,12 @@ namespace cb {
 template <class t>
 class RelaxedAtomic;
 
+/// @see ArenaMalloc::getClientGeneration
+uint32_t getArenaClientGeneration(uint8_t index);
+
+/// Advance the generation of the client index (on unregister)
+void arenaClientUnregistered(uint8_t index);
+
 template <class Impl>
 class _ArenaMalloc {
 public:
@@ -101,9 +108,21 @@ public:
      * @param client The client to unregister.
      */
     static void unregisterClient(const ArenaMallocClient& client) {
+        // Before the index can be handed to a new client
+        arenaClientUnregistered(client.index);
         Impl::unregisterClient(client);
     }
 
+    /**
+     * Returns the generation of the client index, which changes every time
+     * a client using the index is unregistered. Lets anything caching memory
+     * per client index detect that the client is gone, as the index may since
+     * have been given to a new client.
+     */
+    static uint32_t getClientGeneration(uint8_t index) {
+        return getArenaClientGeneration(index);
+    }
+
     /**
      * Returns the index of the current client. Primarily for diagnostics,
      * the client index alone otherwise isn't very useful.
@@ -395,6 +414,66 @@ public:
         return Impl::getDetailedStats();
     }
 
+    /**
+     * Enable or disable the histogram of the client's requested allocation
+     * sizes (bucketed by jemalloc size class) and allocation / free counts.
+     * The histogram uses per-core counters and is cheap enough to leave
+     * enabled. Re-enabling clears the counts. Only JEArenaMalloc implements
+     * this, other implementations ignore the call.
+     *
+     * @param client The client to enable or disable the histogram of
+     * @param enabled true to enable, false to disable
+     */
+    static void setSizeHistogramEnabled(const ArenaMallocClient& client,
+                                        bool enabled) {
+        Impl::setSizeHistogramEnabled(client, enabled);
+    }
+
+    /**
+     * Return the size histogram of the client as JSON, an object with
+     * "allocations", "frees", "duration_s" (since it was enabled), the
+     * "allocation_rate" and "free_rate" per second over that duration, and
+     * "size_classes", an array of {"max_size", "count"} for each non-empty
+     * size class. Returns "null" if the histogram isn't enabled.
+     */
+    static std::string getSizeHistogramJson(const ArenaMallocClient& client) {
+        return Impl::getSizeHistogramJson(client);
+    }
+
+    /**
+     * Enable or disable transparent huge page backing of the client's memory.
+     * When enabled, new extents of the client's arenas which are at least a
+     * huge page in size are huge page aligned and advised MADV_HUGEPAGE;
+     * smaller extents are advised MADV_NOHUGEPAGE. Intended for clients with
+     * large hash tables / values where TLB misses are significant. Existing
+     * extents are unaffected. The bytes advised are reported by getStats as
+     * "huge_pages_advised", the process' actual huge page usage by
+     * getAnonHugePageBytes. Unregistering the client disables huge pages and
+     * withdraws the advice, so the next client of its arenas starts without.
+     * Only JEArenaMalloc on Linux implements this.
+     *
+     * @param client The client to enable or disable huge pages for
+     * @param enabled true to enable, false to disable
+     * @return false if huge pages aren't supported (and the call was ignored)
+     */
+    static bool setHugePagesEnabled(const ArenaMallocClient& client,
+                                    bool enabled) {
+        return Impl::setHugePagesEnabled(client, enabled);
+    }
+
+    /**
+     * Return the bytes of anonymous memory of the whole process which the
+     * kernel backs with transparent huge pages. This reads
+     * /proc/self/smaps_rollup, which walks every mapping of the process, so
+     * it is not part of getGlobalStats and should be called sparingly.
+     *
+     * @return the bytes, or no value if unknown (not JEArenaMalloc on Linux
+     *         4.14 or later)
+     */
+    static std::optional<size_t> getAnonHugePageBytes() {
+        return Impl::getAnonHugePageBytes();
+    }
+
     /**
      * Returns FragmentationStats describing the arena's level of fragmentation.
      * This uses the following two stats (and wraps them in FragmentationStats)
@@ -84,6 +84,17 @@ struct ArenaMallocClient {
     /// estimated memory is update.
     cb::RelaxedAtomic<uint32_t> estimateUpdateThreshold{100 * 1024};
 
+    /// When true each thread batches its alloc and dealloc deltas in plain
+    /// thread-local counters and only pushes them to the per core counters
+    /// when they exceed half of estimateUpdateThreshold, or when the thread
+    /// switches away from the client. The per core threshold becomes the
+    /// other half. At most one thread per core batches at once (others update
+    /// the per core counters directly), so the estimate stays within
+    /// estimateUpdateThreshold * cores of the precise value, as without
+    /// thread-local deltas. Takes effect on the next setAllocatedThreshold
+    /// and is only used by JEArenaCoreLocalTracker.
+    cb::RelaxedAtomic<bool> threadLocalDeltas{false};
+
     // Map each domain to arena to use for that domain.
     // The same arena may be used for multiple domains (production), or
     // one arena per domain (debug) depending on the build setting.
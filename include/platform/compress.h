@@ -20,10 +20,12 @@ class IOBuf;
 
 namespace cb::compression {
 
+class ZstdDictionary;
+
 /**
  * Inflate the data in the buffer into the output buffer
  *
- * @param type The codec to use (currently ignored)
+ * @param type The codec to use (SNAPPY, ZLIB, ZSTD or LZ4)
  * @param input buffer pointing to the input data
  * @param output Where to store the result
  * @param max_inflated_size The maximum size for the inflated object (the
@@ -44,7 +46,7 @@ namespace cb::compression {
  * Inflate the data and return a std::unique_ptr to a folly IOBuf
  * containing the inflated data
  *
- * @param type The codec to use (currently ignored)
+ * @param type The codec to use (SNAPPY, ZLIB, ZSTD or LZ4)
  * @param input The data to inflate
  * @param max_inflated_size The maximum size for the inflated object (the
  *                          library needs to allocate buffers this big, which
@@ -64,7 +66,8 @@ namespace cb::compression {
 /**
  * Deflate the data in the buffer into the output buffer
  *
- * @param type The codec type to use
+ * @param type The codec type to use (SNAPPY, ZLIB, ZSTD or LZ4). ZSTD
+ *             uses DefaultZstdCompressionLevel
  * @param input_buffer buffer pointing to the input data
  * @param output Where to store the result
  * @return true if success, false otherwise
@@ -79,7 +82,7 @@ namespace cb::compression {
  * Deflate the data and return a std::unique_ptr to a folly IOBuf
  * containing the deflated data
  *
- * @param type The codec to use (currently ignored)
+ * @param type The codec to use (SNAPPY, ZLIB, ZSTD or LZ4)
  * @param input The data to deflate
  * @return The deflated data
  * @throws std::invalid_argument for unsupported CodecTypes
@@ -92,7 +95,7 @@ namespace cb::compression {
 /**
  * Get the uncompressed length from the given compressed input buffer
  *
- * @param type The codec type to use
+ * @param type The codec type to use (SNAPPY, ZSTD or LZ4)
  * @param input buffer pointing to the input buffer
  * @return the uncompressed length if success, false otherwise
  * @throws std::invalid_argument if the algorithm provided is an
@@ -101,6 +104,17 @@ namespace cb::compression {
 [[nodiscard]] size_t get_uncompressed_length(folly::io::CodecType type,
                                              std::string_view input);
 
+/**
+ * Get the maximum size of the deflated data for an input of the given size
+ *
+ * @param type The codec type to use (SNAPPY, ZLIB, ZSTD or LZ4)
+ * @param size The size of the input
+ * @return the worst case size of the deflated data
+ * @throws std::invalid_argument for unsupported codec types (or input sizes)
+ */
+[[nodiscard]] size_t getMaxCompressedLength(folly::io::CodecType type,
+                                            size_t size);
+
 /**
  * All data inside kv-engine (and on the wire) use Snappy compression.
  * This is a wrapper method used to save some typing ;)
@@ -129,4 +143,127 @@ namespace cb::compression {
  */
 [[nodiscard]] size_t getUncompressedLengthSnappy(std::string_view input);
 
+/// The compression level used for ZSTD unless explicitly specified
+constexpr int DefaultZstdCompressionLevel = 3;
+
+/**
+ * Inflate a single ZSTD frame. The frame must contain the content size
+ * (which is always the case for data produced by deflateZstd())
+ */
+[[nodiscard]] bool inflateZstd(std::string_view input,
+                               Buffer& output,
+                               size_t max_inflated_size);
+
+[[nodiscard]] std::unique_ptr<folly::IOBuf> inflateZstd(
+        std::string_view input, size_t max_inflated_size);
+
+/**
+ * Deflate the data into a single ZSTD frame by using the provided
+ * compression level (1 - 22, or negative values for the "fast" levels).
+ * Higher levels trade CPU for a better compression ratio.
+ */
+[[nodiscard]] bool deflateZstd(std::string_view input,
+                               Buffer& output,
+                               int level = DefaultZstdCompressionLevel);
+
+[[nodiscard]] std::unique_ptr<folly::IOBuf> deflateZstd(
+        std::string_view input, int level = DefaultZstdCompressionLevel);
+
+/**
+ * Deflate the data into a single ZSTD frame by using the provided
+ * dictionary (and the compression level the dictionary was created with).
+ * See platform/compression/dictionary.h
+ */
+[[nodiscard]] bool deflateZstd(std::string_view input,
+                               Buffer& output,
+                               const ZstdDictionary& dictionary);
+
+/**
+ * Inflate a single ZSTD frame which was compressed by using the provided
+ * dictionary. ZstdDictionary::getFrameDictionaryId() may be used to look up
+ * the dictionary to use.
+ */
+[[nodiscard]] bool inflateZstd(std::string_view input,
+                               Buffer& output,
+                               size_t max_inflated_size,
+                               const ZstdDictionary& dictionary);
+
+/**
+ * Get the uncompressed length stored in the ZSTD frame header
+ *
+ * @param input buffer pointing to the input buffer
+ * @return the uncompressed length if success, 0 otherwise
+ */
+[[nodiscard]] size_t getUncompressedLengthZstd(std::string_view input);
+
+/**
+ * Inflate LZ4 data. The LZ4 encoding used by cb::compression is a varint
+ * encoded uncompressed length followed by a raw LZ4 block (the same layout
+ * as folly::io::CodecType::LZ4_VARINT_SIZE) so that the uncompressed
+ * length is available before the data is inflated (as with Snappy).
+ */
+[[nodiscard]] bool inflateLZ4(std::string_view input,
+                              Buffer& output,
+                              size_t max_inflated_size);
+
+[[nodiscard]] std::unique_ptr<folly::IOBuf> inflateLZ4(
+        std::string_view input, size_t max_inflated_size);
+
+/// Deflate the data by using LZ4 (see inflateLZ4() for the encoding)
+[[nodiscard]] bool deflateLZ4(std::string_view input, Buffer& output);
+
+[[nodiscard]] std::unique_ptr<folly::IOBuf> deflateLZ4(std::string_view input);
+
+/**
+ * Get the uncompressed length from the given LZ4 compressed input buffer
+ *
+ * @param input buffer pointing to the input buffer
+ * @return the uncompressed length if success, 0 otherwise
+ */
+[[nodiscard]] size_t getUncompressedLengthLZ4(std::string_view input);
+
+/**
+ * The default threshold for deflateIfCompressible(). An estimate of 0.95
+ * means ~7.6 bits of entropy per byte, which is typical for random data
+ * and data which is already compressed (JPEG, zip etc).
+ */
+constexpr double DefaultCompressibilityThreshold = 0.95;
+
+/**
+ * Estimate how compressible the input is by sampling a few strided
+ * windows of the input and calculating the (order-0) Shannon entropy of
+ * the sampled bytes. The cost is bounded by the size of the sample (a few
+ * KiB) and not by the size of the input.
+ *
+ * @param input The data to examine
+ * @return The estimated entropy in the range [0, 1] where 0 means that
+ *         the data is highly repetitive and 1 means that the data looks
+ *         random (and won't compress). Small inputs are sampled in full
+ *         and tend to be underestimated (and hence be compressed)
+ */
+[[nodiscard]] double estimateCompressibility(std::string_view input);
+
+/**
+ * Deflate the input unless the compressibility estimate says it isn't
+ * worth trying, and only keep the result if it is smaller than the input.
+ *
+ * @param type The codec type to use (see deflate())
+ * @param input The data to deflate
+ * @param output Where to store the result
+ * @param threshold Skip compression if estimateCompressibility() is at or
+ *                  above this value
+ * @return true if output contains the deflated data (which is smaller than
+ *         the input), false if the caller should keep the input as is (the
+ *         data wasn't considered compressible, compression failed or the
+ *         result wasn't smaller than the input)
+ * @throws std::invalid_argument for unsupported codec types
+ * @throws std::bad_alloc if we fail to allocate memory for the
+ *                        destination buffer
+ */
+[[nodiscard]] bool deflateIfCompressible(
+        folly::io::CodecType type,
+        std::string_view input,
+        Buffer& output,
+        double threshold = DefaultCompressibilityThreshold);
+
 } // namespace cb::compression
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <platform/cb_malloc.h>
+#include <platform/compression/buffer_pool.h>
 
 #include <new>
 #include <stdexcept>
@@ -34,12 +35,28 @@ struct Allocator {
          * Use cb_malloc to allocate backing space. The memory must
          * be freed with cb_free if the memory is released from the buffer
          */
-        Malloc
+        Malloc,
+        /**
+         * Use the thread local BufferPool to allocate backing space (the
+         * memory is allocated with cb_malloc and rounded up to the pool's
+         * size classes). The memory should be returned with
+         * BufferPool::deallocate (or freed with cb_free) if the memory is
+         * released from the buffer
+         */
+        Pool
     };
 
     explicit Allocator(Mode mode_ = Mode::New) : mode(mode_) {
     }
 
+    /// Get the number of bytes allocate() would allocate for nbytes
+    size_t getAllocationSize(size_t nbytes) const {
+        if (mode == Mode::Pool) {
+            return BufferPool::getAllocationSize(nbytes);
+        }
+        return nbytes;
+    }
+
     char* allocate(size_t nbytes) {
         char* ret;
 
@@ -52,6 +69,8 @@ struct Allocator {
                 throw std::bad_alloc();
             }
             return ret;
+        case Mode::Pool:
+            return BufferPool::getThreadLocal().allocate(nbytes);
         }
         throw std::runtime_error("Allocator::allocate: Unknown mode");
     }
@@ -64,6 +83,9 @@ struct Allocator {
         case Mode::Malloc:
             cb_free(static_cast<void*>(ptr));
             return;
+        case Mode::Pool:
+            BufferPool::getThreadLocal().deallocate(ptr);
+            return;
         }
         throw std::runtime_error("Allocator::deallocate: Unknown mode");
     }
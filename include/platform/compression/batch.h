@@ -0,0 +1,79 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <folly/compression/Compression.h>
+#include <platform/compression/buffer.h>
+#include <memory>
+#include <span>
+#include <string_view>
+
+namespace folly {
+class CPUThreadPoolExecutor;
+}
+
+namespace cb::compression {
+
+/**
+ * The BatchCompressor deflates a batch of independent values (for instance
+ * during compaction or bulk load) in parallel on a pool of worker threads.
+ *
+ * The batch is split into contiguous ranges which are deflated by the
+ * workers. All of the deflated values are stored in a single arena buffer
+ * provided by the caller (sized for the worst case of all of the values)
+ * so there is no allocation per value, and the arena may be reused for
+ * the next batch.
+ *
+ * The BatchCompressor is thread safe, but each batch is processed by all
+ * of the workers so there is little point in running multiple batches in
+ * parallel.
+ */
+class BatchCompressor {
+public:
+    /**
+     * Create a new BatchCompressor
+     *
+     * @param threads The number of worker threads to use (0 means use
+     *                cb::get_available_cpu_count())
+     */
+    explicit BatchCompressor(size_t threads = 0);
+    ~BatchCompressor();
+
+    /// Get the number of worker threads
+    [[nodiscard]] size_t getThreadCount() const {
+        return threads;
+    }
+
+    /**
+     * Deflate all of the inputs
+     *
+     * @param type The codec type to use (see cb::compression::deflate())
+     * @param inputs The values to deflate
+     * @param outputs Where to store the deflated values (must be the same
+     *                size as inputs). Each output refers to memory within
+     *                arena
+     * @param arena The buffer to store all of the deflated values in. It is
+     *              resized to fit the worst case for all values
+     * @return true if all of the values were deflated, false otherwise
+     * @throws std::invalid_argument for unsupported codec types or if the
+     *                               number of inputs and outputs differ
+     * @throws std::bad_alloc if we fail to allocate memory for the arena
+     */
+    [[nodiscard]] bool deflate(folly::io::CodecType type,
+                               std::span<const std::string_view> inputs,
+                               std::span<std::string_view> outputs,
+                               Buffer& arena);
+
+protected:
+    const size_t threads;
+    std::unique_ptr<folly::CPUThreadPoolExecutor> executor;
+};
+
+} // namespace cb::compression
@@ -11,6 +11,7 @@
 
 #include <platform/compression/allocator.h>
 #include <platform/sized_buffer.h>
+#include <cstring>
 #include <memory>
 
 namespace cb::compression {
@@ -45,8 +46,31 @@ public:
      */
     void resize(size_t sz) {
         if (sz > capacity_) {
-            memory.reset(allocator.allocate(sz));
-            capacity_ = sz;
+            const auto capacity = allocator.getAllocationSize(sz);
+            memory.reset(allocator.allocate(capacity));
+            capacity_ = capacity;
+        }
+        size_ = sz;
+    }
+
+    /**
+     * Grow the underlying buffer to the requested size while preserving
+     * the current content (unlike resize()). The content of the new
+     * bytes is undefined.
+     *
+     * @param sz The new size for the buffer (must not be less than size())
+     * @throws std::bad_alloc if we failed to allocate memory
+     */
+    void grow(size_t sz) {
+        if (sz > capacity_) {
+            const auto capacity = allocator.getAllocationSize(sz);
+            std::unique_ptr<char, FreeDeleter> next(
+                    allocator.allocate(capacity), FreeDeleter(allocator));
+            if (size_) {
+                std::memcpy(next.get(), memory.get(), size_);
+            }
+            memory.swap(next);
+            capacity_ = capacity;
         }
         size_ = sz;
     }
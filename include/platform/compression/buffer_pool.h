@@ -0,0 +1,144 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <platform/cb_arena_malloc_client.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cb::compression {
+
+/**
+ * The BufferPool keeps a bounded number of previously used memory blocks
+ * around (in power of two size classes) so that a Buffer using
+ * Allocator::Mode::Pool may reuse the memory instead of calling malloc and
+ * free for every operation.
+ *
+ * The blocks are allocated with cb_malloc and stay accounted to the
+ * cb::ArenaMalloc client (and memory domain) which was current when they were
+ * returned to the pool. The free lists are kept per client index and domain,
+ * and a block is only handed out again while its client and domain are
+ * current, so a thread may move between clients without releasing the
+ * blocks of the others.
+ *
+ * A client should call purge() before it is unregistered (and once it no
+ * longer uses pooled Buffers), which frees its blocks from the pools of all
+ * threads. Blocks of a client unregistered without purge() are detected by
+ * the client generation (ArenaMalloc::getClientGeneration): they are never
+ * handed to a new client using the index, and are freed without a client
+ * when the pool next touches them. The bookkeeping of the pool isn't
+ * accounted to any client.
+ *
+ * The pool should only be used by one thread at a time; use
+ * getThreadLocal() to get the pool for the calling thread. purge() may be
+ * called from any thread.
+ */
+class BufferPool {
+public:
+    /// The smallest size class (smaller allocations are rounded up)
+    static constexpr size_t MinSizeClass = 4096;
+    /// The largest size class (larger allocations bypass the pool)
+    static constexpr size_t MaxSizeClass = 1024 * 1024;
+    /// The default limit for the total size of the pooled blocks
+    static constexpr size_t DefaultMaxPooledBytes = 4 * 1024 * 1024;
+
+    explicit BufferPool(size_t max_pooled_bytes = DefaultMaxPooledBytes);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /// Get the pool bound to the calling thread
+    static BufferPool& getThreadLocal();
+
+    /**
+     * Get the number of bytes allocate() returns for a request of
+     * nbytes (the size class for nbytes)
+     */
+    static size_t getAllocationSize(size_t nbytes);
+
+    /**
+     * Allocate a block of getAllocationSize(nbytes) bytes (from the pool
+     * if possible)
+     *
+     * @throws std::bad_alloc if we failed to allocate memory
+     */
+    char* allocate(size_t nbytes);
+
+    /// Return a block allocated by allocate() to the pool (or free it)
+    void deallocate(char* ptr);
+
+    /// Free all of the pooled blocks
+    void clear();
+
+    /**
+     * Free the blocks pooled for the client by all pools (of all threads).
+     * Must be called while the client is registered; blocks returned to a
+     * pool for the client after the call are leaked once the client is
+     * unregistered.
+     */
+    static void purge(const ArenaMallocClient& client);
+
+    /// Set the limit for the total size of the pooled blocks
+    void setMaxPooledBytes(size_t limit);
+
+    /// Get the total size of the blocks currently in the pool
+    [[nodiscard]] size_t getPooledBytes() const {
+        return pooled_bytes;
+    }
+
+    /// Get the number of allocations served from the pool
+    [[nodiscard]] size_t getHits() const {
+        return hits;
+    }
+
+    /// Get the number of allocations which had to allocate memory
+    [[nodiscard]] size_t getMisses() const {
+        return misses;
+    }
+
+protected:
+    static constexpr size_t NumSizeClasses = 9; // 4KiB, 8KiB ... 1MiB
+
+    /// Get the size class index for a block of the given size
+    static size_t getSizeClassIndex(size_t size);
+
+    /// The blocks pooled for one client index
+    struct ClientBlocks;
+
+    /// Get the free list of the size class for the current client and
+    /// domain (with mutex held)
+    std::vector<char*>& getFreeList(size_t size_class);
+
+    /**
+     * Free the pooled blocks of the client at index (with mutex held)
+     *
+     * @param client The registered client to free the blocks under, or
+     *               nullptr to use the client which was current when the
+     *               blocks were pooled. Blocks of an unregistered client are
+     *               always freed without a client.
+     */
+    void freeBlocks(uint8_t index, const ArenaMallocClient* client);
+
+    /// Protects the free lists against purge() from other threads
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ClientBlocks>> clients;
+    size_t max_pooled_bytes;
+    cb::RelaxedAtomic<size_t> pooled_bytes{0};
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+} // namespace cb::compression
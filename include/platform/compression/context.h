@@ -0,0 +1,125 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <platform/compression/buffer.h>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace cb::compression {
+
+class ZstdDictionary;
+
+/**
+ * The Context holds the codec state used by the stateful codecs (the
+ * zlib streams and the ZSTD compression / decompression contexts).
+ *
+ * Setting up a zlib stream costs about the same as compressing a small
+ * document, so instead of initializing (and tearing down) the codec
+ * state in every call the Context keeps it around and resets it between
+ * the calls. The codec state is lazily created the first time it is used.
+ *
+ * A Context is not thread safe. The free functions in compress.h use
+ * the context returned from getThreadLocal(), so most callers don't need
+ * to use this class directly.
+ */
+class Context {
+public:
+    Context();
+    ~Context();
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    /// Callback receiving the inflated data block by block (the data is
+    /// only valid for the duration of the call)
+    using BlockCallback = std::function<void(std::string_view)>;
+
+    /// Get the context bound to the calling thread
+    static Context& getThreadLocal();
+
+    /// Release all of the codec state held by this context
+    void reset();
+
+    /**
+     * Deflate the data into the zlib format (identical to zlib's
+     * compress())
+     */
+    [[nodiscard]] bool deflateZlib(std::string_view input, Buffer& output);
+
+    [[nodiscard]] std::unique_ptr<folly::IOBuf> deflateZlib(
+            std::string_view input);
+
+    /// Inflate data in the zlib format
+    [[nodiscard]] bool inflateZlib(std::string_view input,
+                                   Buffer& output,
+                                   size_t max_inflated_size);
+
+    [[nodiscard]] std::unique_ptr<folly::IOBuf> inflateZlib(
+            std::string_view input, size_t max_inflated_size);
+
+    /**
+     * Inflate data in the zlib format into the output buffer in blocks of
+     * (at most) block_size bytes, and call the callback with each block as
+     * soon as it is inflated (while it is still in the CPU cache)
+     */
+    [[nodiscard]] bool inflateZlib(std::string_view input,
+                                   Buffer& output,
+                                   size_t max_inflated_size,
+                                   size_t block_size,
+                                   const BlockCallback& callback);
+
+    /// Deflate the data into a single ZSTD frame with the provided level
+    [[nodiscard]] bool deflateZstd(std::string_view input,
+                                   Buffer& output,
+                                   int level);
+
+    [[nodiscard]] std::unique_ptr<folly::IOBuf> deflateZstd(
+            std::string_view input, int level);
+
+    /// Inflate a single ZSTD frame (which must contain the content size)
+    [[nodiscard]] bool inflateZstd(std::string_view input,
+                                   Buffer& output,
+                                   size_t max_inflated_size);
+
+    [[nodiscard]] std::unique_ptr<folly::IOBuf> inflateZstd(
+            std::string_view input, size_t max_inflated_size);
+
+    /**
+     * Inflate a single ZSTD frame (which must contain the content size)
+     * into the output buffer one ZSTD block (up to 128KiB) at a time, and
+     * call the callback with each block as soon as it is inflated
+     */
+    [[nodiscard]] bool inflateZstd(std::string_view input,
+                                   Buffer& output,
+                                   size_t max_inflated_size,
+                                   const BlockCallback& callback);
+
+    /// Deflate the data into a single ZSTD frame by using the dictionary
+    [[nodiscard]] bool deflateZstd(std::string_view input,
+                                   Buffer& output,
+                                   const ZstdDictionary& dictionary);
+
+    /// Inflate a single ZSTD frame compressed with the dictionary
+    [[nodiscard]] bool inflateZstd(std::string_view input,
+                                   Buffer& output,
+                                   size_t max_inflated_size,
+                                   const ZstdDictionary& dictionary);
+
+protected:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace cb::compression
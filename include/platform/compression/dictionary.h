@@ -0,0 +1,115 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <platform/compress.h>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace cb::compression {
+
+/**
+ * A ZstdDictionary holds a ZSTD dictionary which may be used to compress
+ * (and decompress) small documents which share a lot of content (for
+ * instance JSON documents with the same keys) far better than compressing
+ * each document on its own.
+ *
+ * The dictionary is identified by the id stored in the dictionary (which
+ * is derived from the dictionary content, so the same content always
+ * gets the same id). The id is also stored in each frame compressed with
+ * the dictionary so that the reader may locate the dictionary to use
+ * (see getFrameDictionaryId()).
+ *
+ * The dictionary is immutable once created and may be shared between
+ * threads.
+ */
+class ZstdDictionary {
+public:
+    /**
+     * Train a new dictionary from the provided samples
+     *
+     * @param samples The documents to train the dictionary from (the
+     *                samples should be representative for the data to
+     *                compress, and zstd recommends ~100x as much sample data
+     *                as the dictionary size)
+     * @param max_size The maximum size of the dictionary
+     * @param level The compression level to use with the dictionary
+     * @return The trained dictionary
+     * @throws std::runtime_error if training fails (for instance too few
+     *                            samples)
+     */
+    static std::shared_ptr<ZstdDictionary> train(
+            std::span<const std::string_view> samples,
+            size_t max_size = 110 * 1024,
+            int level = DefaultZstdCompressionLevel);
+
+    /**
+     * Create a dictionary from a previously trained dictionary (see
+     * getContent())
+     *
+     * @param content The dictionary content
+     * @param level The compression level to use with the dictionary
+     * @throws std::invalid_argument if the content isn't a valid dictionary
+     */
+    explicit ZstdDictionary(std::string content,
+                            int level = DefaultZstdCompressionLevel);
+    ~ZstdDictionary();
+    ZstdDictionary(const ZstdDictionary&) = delete;
+    ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+    /// Get the id of the dictionary
+    [[nodiscard]] uint32_t getId() const {
+        return id;
+    }
+
+    /// Get the raw dictionary (to be persisted and loaded later)
+    [[nodiscard]] std::string_view getContent() const {
+        return content;
+    }
+
+    /// Get the compression level used by this dictionary
+    [[nodiscard]] int getLevel() const {
+        return level;
+    }
+
+    /**
+     * Get the id of the dictionary used to compress the provided frame
+     *
+     * @param frame The compressed data
+     * @return the dictionary id, or 0 if no dictionary was used (or the
+     *         id is unknown)
+     */
+    static uint32_t getFrameDictionaryId(std::string_view frame);
+
+    /// Get the digested dictionary to use for compression
+    [[nodiscard]] const ZSTD_CDict_s* getCompressionDictionary() const {
+        return cdict;
+    }
+
+    /// Get the digested dictionary to use for decompression
+    [[nodiscard]] const ZSTD_DDict_s* getDecompressionDictionary() const {
+        return ddict;
+    }
+
+protected:
+    const std::string content;
+    const int level;
+    uint32_t id = 0;
+    ZSTD_CDict_s* cdict = nullptr;
+    ZSTD_DDict_s* ddict = nullptr;
+};
+
+} // namespace cb::compression
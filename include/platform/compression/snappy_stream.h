@@ -0,0 +1,170 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <platform/compression/buffer.h>
+#include <platform/sink.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cb::compression {
+
+/**
+ * Support for the Snappy framing format
+ * (https://github.com/google/snappy/blob/main/framing_format.txt) which
+ * allows for compressing streams of unbounded length (the "raw" Snappy
+ * format used by inflateSnappy() / deflateSnappy() requires the entire
+ * input to be present in memory).
+ *
+ * The stream starts with a stream identifier chunk followed by a sequence
+ * of chunks each holding (up to) 64KiB of the uncompressed data, and the
+ * masked CRC32C of the uncompressed data. Streams may be concatenated.
+ */
+namespace snappy_framing {
+/// The maximum number of uncompressed bytes in a single chunk
+constexpr size_t MaxChunkSize = 64 * 1024;
+
+/// The stream identifier chunk which starts every stream
+constexpr std::string_view StreamIdentifier{"\xff\x06\x00\x00sNaPpY", 10};
+
+/// Mask the CRC32C as described in the framing format specification
+constexpr uint32_t maskChecksum(uint32_t crc) {
+    return ((crc >> 15) | (crc << 17)) + 0xa282ead8;
+}
+
+/// Does the provided data look like the start of a framed stream
+[[nodiscard]] inline bool isFramedStream(std::string_view data) {
+    return data.starts_with(StreamIdentifier);
+}
+} // namespace snappy_framing
+
+/**
+ * The SnappyFramedSink compresses all data passed to it in the Snappy
+ * framing format and writes the compressed stream to the underlying sink.
+ *
+ * Data is buffered until a full chunk (64KiB) is available (or fsync()
+ * or close() is called), so the memory usage is bounded regardless of
+ * the length of the stream. Chunks which don't compress well are stored
+ * uncompressed.
+ */
+class SnappyFramedSink : public cb::io::Sink {
+public:
+    explicit SnappyFramedSink(std::unique_ptr<cb::io::Sink> underlying);
+
+    /// Close the stream (any errors is silently ignored)
+    ~SnappyFramedSink() override;
+
+    /**
+     * Compress (and write) the provided data
+     *
+     * @param data The data to write
+     * @throws std::runtime_error if compression fails (or any exception
+     *                            thrown by the underlying sink)
+     */
+    void sink(std::string_view data) override;
+
+    /**
+     * Write a chunk with the currently buffered data and fsync the
+     * underlying sink
+     *
+     * @return The number of bytes written to the underlying sink
+     */
+    std::size_t fsync() override;
+
+    /**
+     * Write a chunk with the currently buffered data and close the
+     * underlying sink. No more data may be written after close.
+     *
+     * @return The number of bytes written to the underlying sink
+     */
+    std::size_t close() override;
+
+    /// Get the number of (compressed) bytes written to the underlying sink
+    std::size_t getBytesWritten() const override {
+        return underlying->getBytesWritten();
+    }
+
+    /// Get the number of (uncompressed) bytes passed to the sink
+    [[nodiscard]] std::size_t getBytesConsumed() const {
+        return bytes_consumed;
+    }
+
+protected:
+    /// Write a chunk containing the pending data (if any)
+    void flushChunk();
+
+    /// Compress the provided data and write it as a single chunk
+    void writeChunk(std::string_view data);
+
+    std::unique_ptr<cb::io::Sink> underlying;
+    std::string pending;
+    Buffer compressed;
+    std::string frame;
+    std::size_t bytes_consumed = 0;
+    bool stream_identifier_written = false;
+    bool closed = false;
+};
+
+/**
+ * The SnappyFramedDecoder decodes a stream in the Snappy framing format
+ * which may be fed to the decoder in arbitrary pieces. At most a single
+ * chunk is buffered internally, so the memory usage is bounded regardless
+ * of the length of the stream.
+ */
+class SnappyFramedDecoder {
+public:
+    using Callback = std::function<void(std::string_view)>;
+
+    /**
+     * Decode the provided data and call the callback for every chunk
+     * of uncompressed data found in the stream
+     *
+     * @param data The next piece of the stream
+     * @param callback The callback to receive the uncompressed data (the
+     *                 data is only valid for the duration of the call)
+     * @throws std::runtime_error if the stream is corrupt (invalid chunk
+     *                            types, checksum mismatch etc)
+     */
+    void feed(std::string_view data, const Callback& callback);
+
+    /**
+     * Check if the decoder is at a chunk boundary (and may be at the end
+     * of the stream)
+     */
+    [[nodiscard]] bool isComplete() const {
+        return pending.empty() && skip == 0;
+    }
+
+    /// Get the number of (uncompressed) bytes produced by the decoder
+    [[nodiscard]] std::size_t getBytesProduced() const {
+        return bytes_produced;
+    }
+
+protected:
+    /// Try to decode a single chunk from the provided data, and return
+    /// the number of bytes consumed (0 if more data is needed)
+    std::size_t decodeChunk(std::string_view data, const Callback& callback);
+
+    /// Decode the chunk with the given type and payload
+    void processChunk(uint8_t type,
+                      std::string_view payload,
+                      const Callback& callback);
+
+    std::string pending;
+    Buffer inflated;
+    std::size_t skip = 0;
+    std::size_t bytes_produced = 0;
+    bool stream_identifier_seen = false;
+};
+
+} // namespace cb::compression
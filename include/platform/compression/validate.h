@@ -0,0 +1,64 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+#pragma once
+
+#include <folly/compression/Compression.h>
+#include <platform/compression/buffer.h>
+#include <cstdint>
+#include <string_view>
+
+namespace JSON_checker {
+class Validator;
+}
+
+namespace cb::compression {
+
+/// The outcome of inflateAndValidateJson()
+enum class InflateValidateResult : uint8_t {
+    /// The input could not be inflated
+    InflateFailed,
+    /// The inflated data is valid JSON (and UTF-8)
+    Json,
+    /// The inflated data is not valid JSON
+    NotJson
+};
+
+/// The number of bytes inflated before the data is passed to the validator
+/// (small enough for the block to still be in the L1/L2 cache)
+constexpr size_t JsonValidationBlockSize = 16 * 1024;
+
+/**
+ * Inflate the input and check if the inflated data is JSON in a single
+ * pass over the inflated data. The data is inflated in cache sized blocks
+ * which are passed to the validator while they're still in the CPU cache,
+ * instead of inflating the entire document before reading it back from
+ * memory to validate it.
+ *
+ * ZLIB and ZSTD are inflated block by block. The raw SNAPPY and LZ4 block
+ * formats can't be inflated incrementally (with the library APIs) so they
+ * are inflated in full before the result is validated.
+ *
+ * @param type The codec type to use
+ * @param input The data to inflate
+ * @param output Where to store the inflated data
+ * @param max_inflated_size The maximum size of the inflated data
+ * @param validator The validator to use
+ * @return The outcome of the operation
+ * @throws std::invalid_argument if the algorithm provided is an unknown
+ *                               algorithm
+ */
+[[nodiscard]] InflateValidateResult inflateAndValidateJson(
+        folly::io::CodecType type,
+        std::string_view input,
+        Buffer& output,
+        size_t max_inflated_size,
+        JSON_checker::Validator& validator);
+
+} // namespace cb::compression
@@ -36,7 +36,9 @@ public:
 
     /**
      * Update the threshold at which the per thread counter will synchronise
-     * into the client total estimate.
+     * into the client total estimate. If client.threadLocalDeltas is set the
+     * threshold is split evenly between the thread-local and the core-local
+     * counters.
      */
     static void setAllocatedThreshold(const ArenaMallocClient& client);
 
@@ -55,7 +57,14 @@ public:
      * Return the estimated memory used by the client, this is an efficient read
      * of a single counter but can be ahead or behind the 'precise' value. The
      * lag should be bounded by the client's configured estimateUpdateThreshold
-     * multiplied by the number of cores returned by cb::get_cpu_count
+     * multiplied by the number of cores returned by cb::get_cpu_count.
+     *
+     * With client.threadLocalDeltas the bound is unchanged: at most
+     * cb::get_cpu_count threads hold deltas of a client at once (each below
+     * half of the threshold), any other thread updates the core counters
+     * directly. A thread gives up its deltas when it switches away from the
+     * client. getPreciseAllocated includes the calling thread's deltas but
+     * not those still held by other threads.
      */
     static size_t getEstimatedAllocated(const ArenaMallocClient& client);
 
@@ -93,5 +102,14 @@ public:
      * @param size The size of the deallocation
      */
     static void memDeallocated(uint8_t index, MemoryDomain domain, size_t size);
+
+    /**
+     * Notify that the current thread switched from one client to another,
+     * any thread-local deltas of the previous client are pushed to the core
+     * counters.
+     * @param from The index of the client switched away from
+     * @param to The index of the client now current
+     */
+    static void clientSwitched(uint8_t from, uint8_t to);
 };
 } // end namespace cb
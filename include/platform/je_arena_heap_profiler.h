@@ -0,0 +1,178 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#pragma once
+
+#include <platform/cb_arena_malloc_client.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cb {
+
+/**
+ * An opt-in sampling heap profiler for JEArenaMalloc clients.
+ *
+ * When a sample interval is set, allocations made by a client are sampled
+ * as a Poisson process with a mean of one sample every interval bytes: each
+ * thread counts down a randomly drawn number of bytes and the allocation
+ * which takes the count below zero is sampled. For every sampled allocation
+ * the call stack is captured and kept in a live-sample table of the client
+ * until the memory is freed, so the tables describe which code paths own the
+ * client's memory right now.
+ *
+ * Sampled allocations are made with SampleAlignment, which lets free skip the
+ * table lookup for any pointer which isn't aligned to it. Aligned pointers
+ * are then checked against counting filters of the live sample pages, so
+ * only (likely) sampled pointers take a table's lock. With sampling off and
+ * no live samples the cost is one thread-local subtraction per allocation
+ * and one relaxed load per free.
+ *
+ * A sample is removed from the table of the client which sampled it, even if
+ * the memory is freed under another client (or none). As the alignment of a
+ * sampled allocation may exceed what its size implies, sized frees of small
+ * aligned pointers must not trust the size while any sample is live (see
+ * maybeSampledSmall).
+ */
+class JEArenaHeapProfiler {
+public:
+    /// The alignment given to sampled allocations
+    static constexpr size_t SampleAlignment = 4096;
+
+    /// Per thread sampling state, embedded in JEArenaMalloc's thread-local
+    /// data (which is a POD, so this must be too).
+    struct ThreadState {
+        /// Bytes left to allocate before the next sample is taken
+        int64_t bytesUntilSample;
+        /// State of the random number generator for the sample intervals
+        uint64_t random;
+    };
+
+    /**
+     * Set the mean number of bytes between samples, 0 disables sampling.
+     * Threads pick up the change after at most 1MiB of further allocation.
+     * Existing samples are kept until freed (or reset).
+     */
+    static void setSampleInterval(size_t bytes);
+
+    static size_t getSampleInterval();
+
+    /// @return the number of live samples of the client
+    static size_t getSampleCount(const ArenaMallocClient& client);
+
+    /**
+     * @return an estimate of the client's live memory, scaled up from the
+     *         live samples
+     */
+    static size_t getEstimatedBytes(const ArenaMallocClient& client);
+
+    /**
+     * Dump the live samples of the client in the folded stack format (one
+     * "outermost;...;innermost bytes" line per stack) used by flame graph
+     * tools. The bytes are the estimated live bytes of the stack.
+     */
+    static std::string dumpFolded(const ArenaMallocClient& client);
+
+    /**
+     * Dump the live samples of the client in the heap_v2 profile format
+     * understood by pprof and jeprof, including the mapped libraries so that
+     * the addresses can be symbolized offline.
+     */
+    static std::string dumpPprof(const ArenaMallocClient& client);
+
+    /// Drop all samples of the client
+    static void reset(const ArenaMallocClient& client);
+
+    /**
+     * Count an allocation of size bytes against the thread's sample budget.
+     * @return true if the allocation should be sampled
+     */
+    static bool shouldSample(ThreadState& state, uint8_t index, size_t size) {
+        state.bytesUntilSample -= static_cast<int64_t>(size);
+        if (state.bytesUntilSample >= 0) {
+            return false;
+        }
+        return sampleSlow(state, index);
+    }
+
+    /**
+     * Cheap check made on every free, doesn't lock.
+     * @return true if ptr could be a sampled allocation of any client
+     */
+    static bool maybeSampled(const void* ptr) {
+        const auto address = reinterpret_cast<uintptr_t>(ptr);
+        return liveSamples.load() != 0 &&
+               (address & (SampleAlignment - 1)) == 0 &&
+               globalFilter[getFilterSlot(address)].load(
+                       std::memory_order_relaxed) != 0;
+    }
+
+    /**
+     * Check made on sized free: a sampled allocation of size bytes has a
+     * larger alignment than size implies, so it must be freed by its real
+     * size. Deliberately doesn't consult the filters, any such pointer is
+     * freed by its real size while samples are live.
+     * @return true if ptr may be a sampled allocation smaller than
+     *         SampleAlignment
+     */
+    static bool maybeSampledSmall(const void* ptr, size_t size) {
+        return size < SampleAlignment && liveSamples.load() != 0 &&
+               (reinterpret_cast<uintptr_t>(ptr) & (SampleAlignment - 1)) ==
+                       0;
+    }
+
+    /**
+     * Record ptr (of the requested size) as a sample of the client. Must be
+     * called with no client selected as the tables allocate memory.
+     */
+    static void recordSample(uint8_t index, void* ptr, size_t size);
+
+    /**
+     * Remove ptr from the samples of the client which sampled it, trying the
+     * client index first. Must be called with no client selected as the
+     * tables free memory.
+     * @return true if ptr was sampled
+     */
+    static bool removeSample(uint8_t index, void* ptr);
+
+private:
+    /// Called when the thread's budget ran out, picks the next interval
+    static bool sampleSlow(ThreadState& state, uint8_t index);
+
+    /// Remove ptr (which hashes to slot) from the samples of client index
+    static bool removeClientSample(uint8_t index, size_t slot, void* ptr);
+
+    static constexpr size_t FilterBits = 12;
+
+    /// Hash the page of a sampled address to a sampleFilter slot
+    static size_t getFilterSlot(uintptr_t address) {
+        return size_t((uint64_t(address) / SampleAlignment) *
+                              0x9E3779B97F4A7C15ULL >>
+                      (64 - FilterBits));
+    }
+
+    /// The number of live samples over all clients
+    static RelaxedAtomic<size_t> liveSamples;
+
+    /// The number of live samples of each client in each hash slot, updated
+    /// with the client's sample table locked. A zero slot means no pointer
+    /// hashing to it is sampled. Plain std::atomic so that the array is zero
+    /// initialized (in bss) rather than touched by a constructor.
+    using SampleFilter = std::array<std::atomic<uint32_t>, 1 << FilterBits>;
+    static std::array<SampleFilter, ArenaMallocMaxClients> sampleFilter;
+    /// The sum of sampleFilter over all clients, checked first on free
+    static SampleFilter globalFilter;
+};
+
+} // namespace cb
@@ -12,8 +12,11 @@
 
 #include <platform/cb_arena_malloc_client.h>
 #include <platform/je_arena_corelocal_tracker.h>
+#include <platform/je_arena_heap_profiler.h>
 #include <platform/je_arena_simple_tracker.h>
+#include <platform/je_arena_size_histogram.h>
 
+#include <optional>
 #include <unordered_map>
 
 namespace cb {
@@ -27,10 +30,15 @@ public:
         CurrentClient() = default;
         CurrentClient(uint8_t index,
                       MemoryDomain domain,
-                      uint16_t arena,
+                      const DomainToArena& arenas,
                       int tcacheFlags);
 
-        MemoryDomain setDomain(MemoryDomain domain, uint16_t arena);
+        /**
+         * Change the current domain, selecting the arena cached for it.
+         * Only touches this (thread-local) object, no shared state.
+         * @return the previous domain
+         */
+        MemoryDomain setDomain(MemoryDomain domain);
 
         /**
          * The flags to be passed to all je_malloc 'x' calls, this is where the
@@ -40,6 +48,10 @@ public:
 
         int tcacheFlags{0};
 
+        /// The arena of each domain of the current client, cached here when
+        /// the client is switched to so that setDomain needs no lookup.
+        DomainToArena arenas{};
+
         /// The current arena
         uint16_t arena{0};
 
@@ -127,11 +139,20 @@ public:
     static bool getGlobalStats(
             std::unordered_map<std::string, size_t>& statsMap);
     static std::string getDetailedStats();
+    static void setSizeHistogramEnabled(const ArenaMallocClient& client,
+                                        bool enabled);
+    static std::string getSizeHistogramJson(const ArenaMallocClient& client);
+    static bool setHugePagesEnabled(const ArenaMallocClient& client,
+                                    bool enabled);
+    static std::optional<size_t> getAnonHugePageBytes();
     static FragmentationStats getFragmentationStats(
             const ArenaMallocClient& client);
     static FragmentationStats getGlobalFragmentationStats();
 
 protected:
+    /// @return the bytes of the client's arenas advised to use huge pages
+    static size_t getHugePageBytes(const ArenaMallocClient& client);
+
     static void clientRegistered(const ArenaMallocClient& client,
                                  bool arenaDebugChecksEnabled) {
         trackingImpl::clientRegistered(client, arenaDebugChecksEnabled);
@@ -173,6 +194,36 @@ protected:
                                size_t size) {
         trackingImpl::memDeallocated(index, domain, size);
     }
+
+    /**
+     * Called when the current thread switches client
+     *
+     * @param from The index of the previous client
+     * @param to The index of the new client
+     */
+    static void clientSwitched(uint8_t from, uint8_t to) {
+        trackingImpl::clientSwitched(from, to);
+    }
+
+    /**
+     * Allocate memory which the heap profiler has chosen to sample
+     *
+     * @param client The current client
+     * @param size The clients requested allocation size
+     * @param alignment Alignment required for the allocation, 0 for default
+     * @param flags Any additional je_mallocx flags
+     */
+    static void* sampledAllocate(const ClientHandle& client,
+                                 size_t size,
+                                 size_t alignment,
+                                 int flags);
+
+    /**
+     * Remove ptr from the heap profiler's samples if it is one
+     *
+     * @return true if ptr was a sampled allocation
+     */
+    static bool removeSample(const ClientHandle& client, void* ptr);
 };
 
 #ifndef NDEBUG
@@ -105,6 +105,13 @@ public:
      * @param size The size of the deallocation
      */
     static void memDeallocated(uint8_t index, MemoryDomain domain, size_t size);
+
+    /**
+     * Notify that the current thread switched from one client to another.
+     * No-op - there is no per thread state to flush.
+     */
+    static void clientSwitched(uint8_t from, uint8_t to) {
+    }
 };
 
 } // namespace cb
@@ -0,0 +1,101 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#pragma once
+
+#include <platform/cb_arena_malloc_client.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace cb {
+
+/**
+ * A histogram of the requested allocation sizes of a JEArenaMalloc client,
+ * bucketed by jemalloc size class, along with the number of allocations and
+ * frees so that rates can be derived.
+ *
+ * The counters are core-local relaxed atomics (as with Unshared), so the
+ * cost of recording is an increment on a cache line which is rarely shared.
+ * Histograms are optional and enabled per client; when disabled the cost is
+ * a single load of the client's (null) histogram pointer.
+ */
+class JEArenaSizeHistogram {
+public:
+    /**
+     * Size classes up to MaxSize are tracked individually, larger
+     * allocations share the last bucket.
+     */
+    static constexpr size_t MaxSize = size_t(1) << 36;
+
+    /**
+     * The number of buckets, jemalloc has 8, 16, 32, 48, 64, then four
+     * classes for every doubling of size.
+     */
+    static constexpr size_t NumBuckets = 5 + (36 - 6) * 4 + 1;
+
+    /**
+     * @return the bucket of the jemalloc size class size will be served
+     *         from (ignoring any alignment)
+     */
+    static size_t getBucket(size_t size);
+
+    /// @return the largest size stored in the bucket (0 for the last bucket)
+    static size_t getBucketSize(size_t bucket);
+
+    /**
+     * Enable or disable the histogram of the client. Re-enabling clears any
+     * previous counts.
+     */
+    static void setEnabled(const ArenaMallocClient& client, bool enabled);
+
+    /// @return the histogram of the client at index, or null if disabled
+    static JEArenaSizeHistogram* get(uint8_t index) {
+        // NoClientIndex has a slot too, which is always null
+        return active[index].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return the histogram of the client as a JSON document (null if the
+     *         histogram isn't enabled)
+     */
+    static std::string getJson(const ArenaMallocClient& client);
+
+    void memAllocated(size_t size);
+
+    void memDeallocated();
+
+private:
+    JEArenaSizeHistogram();
+    ~JEArenaSizeHistogram();
+
+    void reset();
+
+    std::string toJson() const;
+
+    /// The core-local counters, defined in the .cc to keep this header
+    /// (included by every user of cb_arena_malloc.h) light
+    struct Counters;
+
+    const std::unique_ptr<Counters> counters;
+    std::atomic<std::chrono::steady_clock::rep> start{};
+
+    /// The enabled histogram of each client, with a slot for NoClientIndex
+    static std::array<std::atomic<JEArenaSizeHistogram*>,
+                      ArenaMallocMaxClients + 1>
+            active;
+};
+
+} // namespace cb
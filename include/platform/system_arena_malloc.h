@@ -18,6 +18,7 @@
 #include <array>
 #include <atomic>
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 
 namespace cb {
@@ -104,6 +105,12 @@ public:
     static bool getGlobalStats(
             std::unordered_map<std::string, size_t>& statsMap);
     static std::string getDetailedStats();
+    static void setSizeHistogramEnabled(const ArenaMallocClient& client,
+                                        bool enabled);
+    static std::string getSizeHistogramJson(const ArenaMallocClient& client);
+    static bool setHugePagesEnabled(const ArenaMallocClient& client,
+                                    bool enabled);
+    static std::optional<size_t> getAnonHugePageBytes();
     static FragmentationStats getFragmentationStats(
             const ArenaMallocClient& client);
     static FragmentationStats getGlobalFragmentationStats();
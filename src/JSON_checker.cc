@@ -334,26 +334,25 @@ static bool JSON_checker_done(JSON_checker::Instance &jc)
     return (jc.state == OK) && jc.pop(JSON_checker::Modes::DONE);
 }
 
-/* Check for both UTF-8ness and JSONness in one pass */
-static bool checkUTF8JSON(JSON_checker::Instance &jc,
-                          const unsigned char* data,
-                          size_t size) {
-    int expect = 0; /* Expect UTF code point to extend this many bytes */
-    int badjson = 0;
-    int badutf = 0;
+/*
+    Check the next chunk of a document for both UTF-8ness and JSONness.
+    expect carries the number of bytes the current UTF code point extends
+    over to the next chunk.
+*/
+static bool checkUTF8JSONChunk(JSON_checker::Instance& jc,
+                               int& expect,
+                               const unsigned char* data,
+                               size_t size) {
     const unsigned char *end = data + size;
-    jc.reset();
     for(;data < end; data++) {
         if(!JSON_checker_char(jc, *data)) {
-            badjson = 1;
-            break;
+            return false;
         }
 
         if(*data <= 0x7F) {
             if(expect != 0) {
                 /* Must not be expecting >0x7F. */
-                badutf = 1;
-                break;
+                return false;
             }
             continue;
         }
@@ -361,16 +360,14 @@ static bool checkUTF8JSON(JSON_checker::Instance &jc,
         if((*data & 0xC0) == 0xC0) {
             if(expect != 0) {
                /* Beginning of UTF-8 multi-byte sequence inside of another one. */
-                badutf = 1;
-                break;
+                return false;
             }
             expect++;
             if(*data & 0x20) expect++;
             if((*data & 0x10) && expect == 2) expect++;
             /* Verify zero bit separates count bits and codepoint bits */
             if(expect == 3 && (*data & 0x8)) {
-                badutf = 1;
-                break;
+                return false;
             }
             continue;
         }
@@ -379,21 +376,30 @@ static bool checkUTF8JSON(JSON_checker::Instance &jc,
             expect--;
         } else {
            /* Got > 0x7F when not expecting it */
-            badutf = 1;
-            break;
+            return false;
         }
     }
-    if(!badjson) {
-        /* Feed fake space to the validator to force it to finish validating */
-        /* numerical values, iff it hasn't marked the current stream as valid */
-        if(jc.state != OK) {
-            badjson = !JSON_checker_char(jc, ' ');
-        }
-        if(!badjson) {
-            badjson = !JSON_checker_done(jc);
-        }
+    return true;
+}
+
+/* Complete the validation once all of the chunks are checked */
+static bool checkUTF8JSONDone(JSON_checker::Instance& jc) {
+    /* Feed fake space to the validator to force it to finish validating */
+    /* numerical values, iff it hasn't marked the current stream as valid */
+    if (jc.state != OK && !JSON_checker_char(jc, ' ')) {
+        return false;
     }
-    return (!badjson && !badutf);
+    return JSON_checker_done(jc);
+}
+
+/* Check for both UTF-8ness and JSONness in one pass */
+static bool checkUTF8JSON(JSON_checker::Instance &jc,
+                          const unsigned char* data,
+                          size_t size) {
+    int expect = 0; /* Expect UTF code point to extend this many bytes */
+    jc.reset();
+    return checkUTF8JSONChunk(jc, expect, data, size) &&
+           checkUTF8JSONDone(jc);
 }
 
 #if CB_JSON_CHECKER_VECTORIZED_SUPPORTED
@@ -514,6 +520,30 @@ bool JSON_checker::Validator::validate(const uint8_t* data, size_t size) {
     return checkUTF8JSON(instance, data, size);
 }
 
+void JSON_checker::Validator::begin() {
+    instance.reset();
+    expect = 0;
+    valid = true;
+}
+
+bool JSON_checker::Validator::feed(const uint8_t* data, size_t size) {
+    if (valid) {
+        valid = checkUTF8JSONChunk(instance, expect, data, size);
+    }
+    return valid;
+}
+
+bool JSON_checker::Validator::feed(std::string_view data) {
+    return feed(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+bool JSON_checker::Validator::finish() {
+    if (valid) {
+        valid = checkUTF8JSONDone(instance);
+    }
+    return valid;
+}
+
 bool JSON_checker::Validator::validate(const std::vector<uint8_t>& data) {
     return validate(data.data(), static_cast<size_t>(data.size()));
 }
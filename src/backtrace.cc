@@ -8,7 +8,9 @@
  *   the file licenses/APL2.txt.
  */
 #include <platform/backtrace.h>
+#include <boost/core/demangle.hpp>
 #include <boost/stacktrace/stacktrace.hpp>
+#include <algorithm>
 #include <cinttypes>
 
 #if defined(WIN32)
@@ -228,4 +230,48 @@ static void callback(void* ctx, const char* frame) {
     return result;
 }
 #endif
+
+size_t capture(void** frames, size_t size, size_t skip) {
+    // Skip our own frame as well
+    skip++;
+#if defined(WIN32)
+    return CaptureStackBackTrace(DWORD(skip),
+                                 DWORD(std::min(size, size_t(MAX_FRAMES))),
+                                 frames,
+                                 NULL);
+#else
+    void* buffer[MAX_FRAMES];
+    const auto active = size_t(::backtrace(buffer, MAX_FRAMES));
+    if (active <= skip) {
+        return 0;
+    }
+    const auto count = std::min(size, active - skip);
+    std::copy_n(buffer + skip, count, frames);
+    return count;
+#endif
+}
+
+std::string symbolize(const void* address) {
+#if defined(WIN32)
+    DWORD64 displacement = 0;
+    char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(TCHAR)];
+    PSYMBOL_INFO sym_info = (PSYMBOL_INFO)buffer;
+    sym_info->SizeOfStruct = sizeof(SYMBOL_INFO);
+    sym_info->MaxNameLen = MAX_SYM_NAME;
+    if (SymFromAddr(GetCurrentProcess(),
+                    (DWORD64)address,
+                    &displacement,
+                    sym_info)) {
+        return sym_info->Name;
+    }
+#else
+    Dl_info info;
+    if (dladdr(address, &info) != 0 && info.dli_sname) {
+        return boost::core::demangle(info.dli_sname);
+    }
+#endif
+    char msg[32];
+    snprintf(msg, sizeof(msg), "[%p]", address);
+    return msg;
+}
 } // namespace cb::backtrace
@@ -11,11 +11,30 @@
 #include <folly/lang/Assume.h>
 #include <platform/cb_arena_malloc.h>
 #include <platform/sysinfo.h>
+#include <relaxed_atomic.h>
 
+#include <array>
 #include <type_traits>
 
 namespace cb {
 
+/// The number of times each client index was unregistered
+static std::array<RelaxedAtomic<uint32_t>, ArenaMallocMaxClients>
+        clientGenerations;
+
+uint32_t getArenaClientGeneration(uint8_t index) {
+    if (index >= ArenaMallocMaxClients) {
+        return 0;
+    }
+    return clientGenerations[index];
+}
+
+void arenaClientUnregistered(uint8_t index) {
+    if (index < ArenaMallocMaxClients) {
+        clientGenerations[index]++;
+    }
+}
+
 std::ostream& operator<<(std::ostream& os, const MemoryDomain& md) {
     switch (md) {
     case MemoryDomain::Primary:
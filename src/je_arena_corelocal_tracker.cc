@@ -14,33 +14,174 @@
 #include <platform/corestore.h>
 #include <platform/je_arena_corelocal_tracker.h>
 #include <platform/non_negative_counter.h>
+#include <platform/sysinfo.h>
 #include <platform/unshared.h>
 
 #include <jemalloc/jemalloc.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
 
 namespace cb {
 
 struct ClientData {
     Unshared<MemoryDomain> allocated;
+    /// Threshold for the thread-local deltas, 0 if they are disabled
+    RelaxedAtomic<int64_t> threadThreshold{0};
+    /// Bumped when the client is (re)registered, so that thread-local deltas
+    /// of a previous registration of this index are discarded
+    RelaxedAtomic<uint32_t> generation{0};
+    /// The number of threads currently holding deltas of the client, at most
+    /// one per core so that the drift bound is kept
+    std::atomic<uint32_t> batchingThreads{0};
 };
 
 // The client counters are stored cache-aligned, with one per client.
 static std::array<folly::cacheline_aligned<ClientData>, ArenaMallocMaxClients>
         clientData;
 
+/**
+ * Per thread deltas used when a client enables threadLocalDeltas. These are
+ * plain integers only ever accessed by the owning thread, so an update is a
+ * single add to a thread-private cache line.
+ *
+ * Like ThreadLocalData in je_arena_malloc.cc this is a POD so that access
+ * doesn't require a guard variable; the flush at thread exit is attached
+ * separately on first use.
+ */
+struct ThreadDeltas {
+    /// Push all of the deltas to the core counters
+    void flush();
+
+    /// Push the deltas of one client to the core counters
+    void flush(uint8_t index);
+
+    void registerFlushAtExit();
+
+    std::array<std::array<int64_t, size_t(MemoryDomain::Count)>,
+               ArenaMallocMaxClients>
+            deltas;
+    /// The ClientData::generation which the deltas belong to
+    std::array<uint32_t, ArenaMallocMaxClients> generations;
+    /// Does the thread hold one of the client's batchingThreads slots?
+    std::array<bool, ArenaMallocMaxClients> batching;
+    /// Has the flush at thread exit been registered?
+    bool registered;
+    /// Has the thread exit flush run? Any later updates bypass the deltas
+    bool exited;
+};
+
+static thread_local ThreadDeltas threadDeltas = {};
+
+void ThreadDeltas::flush(uint8_t index) {
+    auto& client = *clientData[index];
+    if (!batching[index]) {
+        return;
+    }
+    batching[index] = false;
+    client.batchingThreads.fetch_sub(1, std::memory_order_relaxed);
+    if (generations[index] != client.generation) {
+        // Deltas of a previous registration, the counters were reset.
+        deltas[index] = {};
+        return;
+    }
+    for (size_t domain = 0; domain < deltas[index].size(); domain++) {
+        auto& delta = deltas[index][domain];
+        if (delta) {
+            client.allocated.add(delta, MemoryDomain(domain));
+            delta = 0;
+        }
+    }
+}
+
+void ThreadDeltas::flush() {
+    for (uint8_t index = 0; index < ArenaMallocMaxClients; index++) {
+        flush(index);
+    }
+}
+
+void ThreadDeltas::registerFlushAtExit() {
+    registered = true;
+    struct ThreadDeltasFlush {
+        void operator()(ThreadDeltas* ptr) {
+            ptr->flush();
+            ptr->exited = true;
+        }
+    };
+    thread_local std::unique_ptr<ThreadDeltas, ThreadDeltasFlush> flushAtExit{
+            this};
+}
+
+/**
+ * Try to take one of the client's batching slots (one per core). Threads
+ * without a slot account directly to the core counters, which keeps the
+ * total drift within threshold * cores however many threads use the client.
+ */
+static bool acquireBatchingSlot(ClientData& client) {
+    static const auto maxThreads = uint32_t(cb::get_cpu_count());
+    auto current = client.batchingThreads.load(std::memory_order_relaxed);
+    do {
+        if (current >= maxThreads) {
+            return false;
+        }
+    } while (!client.batchingThreads.compare_exchange_weak(
+            current, current + 1, std::memory_order_relaxed));
+    return true;
+}
+
+/**
+ * Account size bytes to the client, either directly to the core counters or
+ * via the thread-local deltas if the client has them enabled (and the thread
+ * got a batching slot).
+ */
+static void accountDelta(uint8_t index, MemoryDomain domain, int64_t size) {
+    auto& client = *clientData[index];
+    const auto threshold = client.threadThreshold.load();
+    auto& local = threadDeltas;
+    if (threshold == 0 || local.exited) {
+        client.allocated.add(size, domain);
+        return;
+    }
+    if (!local.batching[index]) {
+        if (!acquireBatchingSlot(client)) {
+            client.allocated.add(size, domain);
+            return;
+        }
+        if (!local.registered) {
+            local.registerFlushAtExit();
+        }
+        local.batching[index] = true;
+    }
+    const auto generation = client.generation.load();
+    auto& delta = local.deltas[index][size_t(domain)];
+    if (local.generations[index] != generation) {
+        local.deltas[index] = {};
+        local.generations[index] = generation;
+    }
+    delta += size;
+    if (std::abs(delta) > threshold) {
+        client.allocated.add(delta, domain);
+        delta = 0;
+    }
+}
+
 void JEArenaCoreLocalTracker::clientRegistered(const ArenaMallocClient& client,
                                                bool arenaDebugChecksEnabled) {
     // CoreLocalTracker doesn't support debug checks.
     (void)arenaDebugChecksEnabled;
+    clientData[client.index]->generation++;
     clientData[client.index]->allocated.reset();
     setAllocatedThreshold(client);
 }
 
 size_t JEArenaCoreLocalTracker::getPreciseAllocated(
         const ArenaMallocClient& client) {
+    // The deltas of the calling thread can be included, other threads'
+    // deltas are only pushed when they exceed the threshold or switch away.
+    threadDeltas.flush(client.index);
     return clientData[client.index]->allocated.getPreciseSum();
 }
 
@@ -51,6 +192,7 @@ size_t JEArenaCoreLocalTracker::getEstimatedAllocated(
 
 size_t JEArenaCoreLocalTracker::getPreciseAllocated(
         const ArenaMallocClient& client, MemoryDomain domain) {
+    threadDeltas.flush(client.index);
     return clientData[client.index]->allocated.getPrecise(domain);
 }
 
@@ -61,8 +203,22 @@ size_t JEArenaCoreLocalTracker::getEstimatedAllocated(
 
 void JEArenaCoreLocalTracker::setAllocatedThreshold(
         const ArenaMallocClient& client) {
-    clientData[client.index]->allocated.setCoreThreshold(
-            client.estimateUpdateThreshold);
+    const int64_t threshold = client.estimateUpdateThreshold;
+    // Split the threshold between the thread and core counters. At most one
+    // thread per core batches (see acquireBatchingSlot), so the maximum drift
+    // of the estimate stays at threshold * cores.
+    const int64_t threadThreshold =
+            client.threadLocalDeltas ? threshold / 2 : 0;
+    auto& data = *clientData[client.index];
+    data.allocated.setCoreThreshold(threshold - threadThreshold);
+    data.threadThreshold = threadThreshold;
+}
+
+void JEArenaCoreLocalTracker::clientSwitched(uint8_t from, uint8_t to) {
+    auto& local = threadDeltas;
+    if (from != to && from != NoClientIndex) {
+        local.flush(from);
+    }
 }
 
 void JEArenaCoreLocalTracker::memAllocated(uint8_t index,
@@ -74,7 +230,7 @@ void JEArenaCoreLocalTracker::memAllocated(uint8_t index,
                                   ? MALLOCX_ALIGN(alignment)
                                   : 0;
         size = je_nallocx(size, flags);
-        clientData[index]->allocated.add(size, domain);
+        accountDelta(index, domain, size);
     }
 }
 
@@ -83,7 +239,7 @@ void JEArenaCoreLocalTracker::memDeallocated(uint8_t index,
                                              void* ptr) {
     if (index != NoClientIndex) {
         auto size = je_sallocx(ptr, 0 /* flags aren't read in this call*/);
-        clientData[index]->allocated.sub(size, domain);
+        accountDelta(index, domain, -int64_t(size));
     }
 }
 
@@ -92,7 +248,7 @@ void JEArenaCoreLocalTracker::memDeallocated(uint8_t index,
                                              size_t size) {
     if (index != NoClientIndex) {
         size = je_nallocx(size, 0 /* flags aren't read in this call*/);
-        clientData[index]->allocated.sub(size, domain);
+        accountDelta(index, domain, -int64_t(size));
     }
 }
 
@@ -0,0 +1,283 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#include <platform/je_arena_heap_profiler.h>
+
+#include <fmt/format.h>
+#include <folly/Indestructible.h>
+#include <folly/Synchronized.h>
+#include <platform/backtrace.h>
+#include <platform/cb_arena_malloc.h>
+#include <platform/dirutils.h>
+#include <platform/je_arena_malloc.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cb {
+
+RelaxedAtomic<size_t> JEArenaHeapProfiler::liveSamples{0};
+std::array<JEArenaHeapProfiler::SampleFilter, ArenaMallocMaxClients>
+        JEArenaHeapProfiler::sampleFilter;
+JEArenaHeapProfiler::SampleFilter JEArenaHeapProfiler::globalFilter;
+
+/// The mean bytes between samples, 0 when sampling is off
+static RelaxedAtomic<size_t> sampleInterval{0};
+
+/// How often a thread re-reads sampleInterval while sampling is off
+static constexpr int64_t DisabledRecheckBytes = 1024 * 1024;
+
+/// The maximum number of frames kept for a sample
+static constexpr size_t MaxFrames = 32;
+
+struct Sample {
+    /// Returns the number of bytes this sample stands for. An allocation of
+    /// size bytes is sampled with probability 1 - exp(-size / interval).
+    double getEstimatedBytes() const {
+        const auto probability =
+                1.0 - std::exp(-double(size) / double(interval));
+        return double(size) / probability;
+    }
+
+    std::vector<void*> getStack() const {
+        return {frames.begin(), frames.begin() + depth};
+    }
+
+    /// The requested size of the allocation
+    size_t size;
+    /// The sample interval in force when the sample was taken
+    size_t interval;
+    size_t depth;
+    std::array<void*, MaxFrames> frames;
+};
+
+using SampleTable = folly::Synchronized<std::unordered_map<void*, Sample>,
+                                        std::mutex>;
+
+/// The live samples of each client. Never destroyed, as threads may free
+/// sampled memory during process shutdown.
+static std::array<SampleTable, ArenaMallocMaxClients>& getSampleTables() {
+    static folly::Indestructible<std::array<SampleTable, ArenaMallocMaxClients>>
+            tables;
+    return *tables;
+}
+
+/// Draw the bytes until the next sample from an exponential distribution
+static int64_t getNextSampleBytes(JEArenaHeapProfiler::ThreadState& state,
+                                  size_t interval) {
+    if (state.random == 0) {
+        state.random = reinterpret_cast<uintptr_t>(&state) ^
+                       std::chrono::steady_clock::now()
+                               .time_since_epoch()
+                               .count();
+        state.random |= 1;
+    }
+    // xorshift64*
+    auto x = state.random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    state.random = x;
+    const auto r = x * 0x2545F4914F6CDD1DULL;
+    // uniform in (0, 1]
+    const double u = double((r >> 11) + 1) * 0x1.0p-53;
+    const double next = -std::log(u) * double(interval);
+    return int64_t(std::min(next, 0x1.0p62));
+}
+
+void JEArenaHeapProfiler::setSampleInterval(size_t bytes) {
+    sampleInterval = bytes;
+}
+
+size_t JEArenaHeapProfiler::getSampleInterval() {
+    return sampleInterval;
+}
+
+bool JEArenaHeapProfiler::sampleSlow(ThreadState& state, uint8_t index) {
+    const auto interval = sampleInterval.load();
+    if (interval == 0) {
+        state.bytesUntilSample = DisabledRecheckBytes;
+        return false;
+    }
+    state.bytesUntilSample = getNextSampleBytes(state, interval);
+    return index != NoClientIndex;
+}
+
+void JEArenaHeapProfiler::recordSample(uint8_t index, void* ptr, size_t size) {
+    Sample sample;
+    sample.size = size;
+    sample.interval = std::max(sampleInterval.load(), size_t(1));
+    // Skip this function and the allocator function calling it
+    sample.depth =
+            cb::backtrace::capture(sample.frames.data(), MaxFrames, 2);
+
+    auto locked = getSampleTables()[index].lock();
+    if (locked->insert_or_assign(ptr, sample).second) {
+        const auto slot = getFilterSlot(uintptr_t(ptr));
+        sampleFilter[index][slot].fetch_add(1, std::memory_order_relaxed);
+        globalFilter[slot].fetch_add(1, std::memory_order_relaxed);
+        liveSamples++;
+    }
+}
+
+bool JEArenaHeapProfiler::removeClientSample(uint8_t index,
+                                             size_t slot,
+                                             void* ptr) {
+    if (sampleFilter[index][slot].load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    auto locked = getSampleTables()[index].lock();
+    if (locked->erase(ptr)) {
+        sampleFilter[index][slot].fetch_sub(1, std::memory_order_relaxed);
+        globalFilter[slot].fetch_sub(1, std::memory_order_relaxed);
+        liveSamples--;
+        return true;
+    }
+    return false;
+}
+
+bool JEArenaHeapProfiler::removeSample(uint8_t index, void* ptr) {
+    const auto slot = getFilterSlot(uintptr_t(ptr));
+    if (globalFilter[slot].load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    if (index != NoClientIndex && removeClientSample(index, slot, ptr)) {
+        return true;
+    }
+    // Freed under another client (or none), find the client which sampled it
+    for (size_t other = 0; other < ArenaMallocMaxClients; ++other) {
+        if (other != index && removeClientSample(uint8_t(other), slot, ptr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Copy the samples of the client
+static std::vector<Sample> getSamples(const ArenaMallocClient& client) {
+    std::vector<Sample> samples;
+    auto locked = getSampleTables()[client.index].lock();
+    samples.reserve(locked->size());
+    for (const auto& [ptr, sample] : *locked) {
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+// The public methods run under a NoArenaGuard, so that the allocations of
+// the tables (and of the dumps) are neither accounted to, nor sampled for,
+// the client. It also means a sample can't be recorded against a table while
+// this thread has it locked.
+
+size_t JEArenaHeapProfiler::getSampleCount(const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    return getSampleTables()[client.index].lock()->size();
+}
+
+size_t JEArenaHeapProfiler::getEstimatedBytes(
+        const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    double bytes = 0;
+    for (const auto& sample : getSamples(client)) {
+        bytes += sample.getEstimatedBytes();
+    }
+    return size_t(bytes);
+}
+
+std::string JEArenaHeapProfiler::dumpFolded(const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    std::map<std::vector<void*>, double> stacks;
+    for (const auto& sample : getSamples(client)) {
+        stacks[sample.getStack()] += sample.getEstimatedBytes();
+    }
+
+    std::unordered_map<void*, std::string> symbols;
+    std::string output;
+    for (const auto& [stack, bytes] : stacks) {
+        // Folded stacks are written outermost frame first
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+            auto symbol = symbols.find(*it);
+            if (symbol == symbols.end()) {
+                symbol = symbols.emplace(*it, cb::backtrace::symbolize(*it))
+                                 .first;
+            }
+            if (it != stack.rbegin()) {
+                output.push_back(';');
+            }
+            output.append(symbol->second);
+        }
+        output.append(fmt::format(" {}\n", uint64_t(bytes)));
+    }
+    return output;
+}
+
+std::string JEArenaHeapProfiler::dumpPprof(const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    struct Totals {
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+    };
+    std::map<std::vector<void*>, Totals> stacks;
+    Totals total;
+    size_t interval = 1;
+    for (const auto& sample : getSamples(client)) {
+        auto& totals = stacks[sample.getStack()];
+        totals.objects++;
+        totals.bytes += sample.size;
+        total.objects++;
+        total.bytes += sample.size;
+        interval = std::max(interval, sample.interval);
+    }
+
+    // pprof and jeprof scale the sampled values back up using the interval
+    std::string output = fmt::format("heap_v2/{}\n  t*: {}: {} [0: 0]\n",
+                                     interval,
+                                     total.objects,
+                                     total.bytes);
+    for (const auto& [stack, totals] : stacks) {
+        output.push_back('@');
+        for (const auto* frame : stack) {
+            output.append(fmt::format(" {}", frame));
+        }
+        output.append(fmt::format(
+                "\n  t*: {}: {} [0: 0]\n", totals.objects, totals.bytes));
+    }
+
+    output.append("\nMAPPED_LIBRARIES:\n");
+#ifdef __linux__
+    try {
+        output.append(cb::io::loadFile("/proc/self/maps"));
+    } catch (const std::exception&) {
+        // The addresses can't be symbolized, but the profile is still valid
+    }
+#endif
+    return output;
+}
+
+void JEArenaHeapProfiler::reset(const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    auto locked = getSampleTables()[client.index].lock();
+    liveSamples -= locked->size();
+    locked->clear();
+    auto& filter = sampleFilter[client.index];
+    for (size_t slot = 0; slot < filter.size(); ++slot) {
+        globalFilter[slot].fetch_sub(
+                filter[slot].exchange(0, std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    }
+}
+
+} // namespace cb
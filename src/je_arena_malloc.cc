@@ -11,20 +11,29 @@
 #include "relaxed_atomic.h"
 
 #include <platform/backtrace.h>
+#include <platform/dirutils.h>
 #include <platform/je_arena_malloc.h>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <folly/ScopeGuard.h>
 #include <folly/Synchronized.h>
 #include <gsl/gsl-lite.hpp>
 #include <jemalloc/jemalloc.h>
 #include <platform/terminal_color.h>
 
+#include <algorithm>
+#include <array>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <system_error>
 #include <type_traits>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 // We are storing the arena in a uint16_t, assert that this constant is as
 // expected, MALLCTL_ARENAS_ALL -1 is the largest possible arena ID
 static_assert(MALLCTL_ARENAS_ALL <= std::numeric_limits<uint16_t>::max(),
@@ -65,37 +74,59 @@ static bool isTcacheEnabled(bool requested) {
     return tcacheEnabled && requested && !arenaDebugChecksEnabled();
 }
 
+/// @return the arena for the domain, 0 (auto select) if there's no client
+static uint16_t getArenaForDomain(uint8_t index,
+                                  const DomainToArena& arenas,
+                                  MemoryDomain domain) {
+    if (index == NoClientIndex) {
+        return 0;
+    }
+    return arenas.at(size_t(domain));
+}
+
 JEArenaMallocBase::CurrentClient::CurrentClient(uint8_t index,
                                                 MemoryDomain domain,
-                                                uint16_t arena,
+                                                const DomainToArena& arenas,
                                                 int tcacheFlags)
-    : tcacheFlags(tcacheFlags), arena(arena), index(index), domain(domain) {
+    : tcacheFlags(tcacheFlags),
+      arenas(arenas),
+      arena(getArenaForDomain(index, arenas, domain)),
+      index(index),
+      domain(domain) {
 }
 
-MemoryDomain JEArenaMallocBase::CurrentClient::setDomain(MemoryDomain domain,
-                                                         uint16_t arena) {
+MemoryDomain JEArenaMallocBase::CurrentClient::setDomain(MemoryDomain domain) {
     auto currentDomain = this->domain;
-    this->arena = arena;
+    this->arena = getArenaForDomain(index, arenas, domain);
     this->domain = domain;
     return currentDomain;
 }
 
 /**
  * Allocate a new arena which will have the allocator hooks replaced with our
- * own alloc/dalloc hooks (which just call the original hooks).
+ * own alloc/dalloc hooks (which call the original hooks, adding huge page
+ * advice if enabled for the arena).
  *
  * @return the ID of the new arena
  */
 static uint16_t makeArena();
 
+/// Enable or disable huge page backing of the new extents of the arenas
+static void setArenaHugePages(const DomainToArena& arenas, bool enabled);
+
+/// Disable huge pages for the arenas and withdraw the advice given to their
+/// extents, before the arenas are reused by another client
+static void resetArenaHugePages(const DomainToArena& arenas);
+
 int JEArenaMallocBase::CurrentClient::getMallocFlags() const {
     return MALLOCX_ARENA(arena) | tcacheFlags;
 }
 
-// Note: we can exceed uint64_t - just incurs an extra TLS read on what is
-// quite hot code.
-static_assert(sizeof(JEArenaMallocBase::CurrentClient) == sizeof(uint64_t),
-              "Expected CurrentClient to be sizeof(uint64_t)");
+// Note: CurrentClient holds the arenas of every domain so that setDomain is
+// lock-free, which takes it over uint64_t - just an extra TLS read on what is
+// quite hot code. Keep it within two words.
+static_assert(sizeof(JEArenaMallocBase::CurrentClient) <= 2 * sizeof(uint64_t),
+              "Expected CurrentClient to be <= 2 * sizeof(uint64_t)");
 
 /**
  * ThreadLocalData
@@ -104,6 +135,7 @@ static_assert(sizeof(JEArenaMallocBase::CurrentClient) == sizeof(uint64_t),
  *                 methods for pushing the correct flags (arena) to jemalloc.
  * tcacheIds - An array of jemalloc thread cache identifiers, each thread:client
  *             needs its own id.
+ * heapProfiler - The thread's JEArenaHeapProfiler sampling state.
  *
  * Note this is a struct to reduce the number of tls_get_addr calls when it is
  * used. If this struct is made a class, or wrapped in a CachelinePadded, or
@@ -123,6 +155,10 @@ public:
         return currentClient;
     }
 
+    JEArenaHeapProfiler::ThreadState& getHeapProfilerState() {
+        return heapProfiler;
+    }
+
     static ThreadLocalData& get() {
         static thread_local ThreadLocalData tld = {};
         return tld;
@@ -150,6 +186,8 @@ private:
 
     /// Actual array of identifiers, value of 0 means no tcache has been created
     uint16_t tcacheIds[ArenaMallocMaxClients] = {0};
+
+    JEArenaHeapProfiler::ThreadState heapProfiler;
 };
 
 /**
@@ -261,14 +299,12 @@ static void verifyMemDeallocatedByCorrectClient(
     }
 }
 
-JEArenaMalloc::ClientHandle switchToClientImpl(uint8_t index,
-                                               MemoryDomain domain,
-                                               uint16_t arena,
-                                               int tcacheFlags) {
+JEArenaMalloc::ClientHandle switchToClientImpl(
+        const JEArenaMalloc::ClientHandle& client) {
     auto& currentClient = ThreadLocalData::get().getCurrentClient();
     auto previous = currentClient;
 
-    currentClient = {index, domain, arena, tcacheFlags};
+    currentClient = client;
     return previous;
 }
 
@@ -297,6 +333,11 @@ ArenaMallocClient JEArenaMalloc::registerClient(bool threadCache) {
 
 template <>
 void JEArenaMalloc::unregisterClient(const ArenaMallocClient& client) {
+    // Any samples left were leaked or freed under another client, they must
+    // not be reported against the next user of the index. The same goes for
+    // the size histogram.
+    JEArenaHeapProfiler::reset(client);
+    JEArenaSizeHistogram::setEnabled(client, false);
     auto lockedClients = Clients::get().wlock();
     auto& c = lockedClients->at(client.index);
     if (!c.used) {
@@ -308,6 +349,7 @@ void JEArenaMalloc::unregisterClient(const ArenaMallocClient& client) {
     // Reset the state, but we re-use the arenas for the next time this is
     // used.
     c.reset();
+    resetArenaHugePages(client.arenas);
 }
 
 template <>
@@ -329,11 +371,14 @@ template <>
 JEArenaMalloc::ClientHandle JEArenaMalloc::switchToClient(
         const ArenaMallocClient& client, MemoryDomain domain, bool tcache) {
     if (client.index == NoClientIndex) {
-        return switchToClientImpl(
-                NoClientIndex,
-                cb::MemoryDomain::None,
-                /* arena */ 0,
-                isTcacheEnabled(client.threadCache) ? 0 : MALLOCX_TCACHE_NONE);
+        auto previous = switchToClientImpl(
+                {NoClientIndex,
+                 cb::MemoryDomain::None,
+                 /* arenas */ {},
+                 isTcacheEnabled(client.threadCache) ? 0
+                                                     : MALLOCX_TCACHE_NONE});
+        clientSwitched(previous.index, NoClientIndex);
+        return previous;
     }
 
     int tcacheFlags = MALLOCX_TCACHE_NONE;
@@ -350,30 +395,25 @@ JEArenaMalloc::ClientHandle JEArenaMalloc::switchToClient(
         // flags so tcache is still MALLOCX_TCACHE_NONE
         ThreadLocalData::get().getTCacheID(client);
     }
-    return switchToClientImpl(client.index,
-                              domain,
-                              client.arenas.at(size_t(domain)),
-                              tcacheFlags);
+    auto previous = switchToClientImpl(
+            {client.index, domain, client.arenas, tcacheFlags});
+    clientSwitched(previous.index, client.index);
+    return previous;
 }
 
 template <>
 JEArenaMalloc::ClientHandle JEArenaMalloc::switchToClient(
         const ClientHandle& client) {
-    return switchToClientImpl(
-            client.index, client.domain, client.arena, client.tcacheFlags);
+    auto previous = switchToClientImpl(client);
+    clientSwitched(previous.index, client.index);
+    return previous;
 }
 
 template <>
 MemoryDomain JEArenaMalloc::setDomain(MemoryDomain domain) {
-    auto& currentClient = ThreadLocalData::get().getCurrentClient();
-    if (currentClient.index == NoClientIndex) {
-        return ThreadLocalData::get().getCurrentClient().setDomain(domain, 0);
-    }
-    auto locked = Clients::get().rlock();
-    const auto arenaForDomain =
-            locked->at(currentClient.index).arenas.at(size_t(domain));
-    return ThreadLocalData::get().getCurrentClient().setDomain(domain,
-                                                               arenaForDomain);
+    // The arenas of the current client were cached when it was switched to
+    // and a client's arenas don't change while it is registered.
+    return ThreadLocalData::get().getCurrentClient().setDomain(domain);
 }
 
 template <>
@@ -389,19 +429,95 @@ JEArenaMalloc::ClientHandle JEArenaMalloc::switchFromClient() {
             isTcacheEnabled(true));
 }
 
+/**
+ * Run func with no client selected on this thread, restoring client after.
+ * Used for the heap profiler's tables, whose own allocations must be neither
+ * accounted to nor sampled for the client.
+ */
+template <typename Func>
+static auto withoutClient(const JEArenaMalloc::ClientHandle& client,
+                          Func func) {
+    auto& currentClient = ThreadLocalData::get().getCurrentClient();
+    currentClient = {};
+    auto restore = folly::makeGuard([&currentClient, &client]() {
+        currentClient = client;
+    });
+    return func();
+}
+
+template <>
+void* JEArenaMalloc::sampledAllocate(const ClientHandle& client,
+                                     size_t size,
+                                     size_t alignment,
+                                     int flags) {
+    // Sampled allocations get (at least) SampleAlignment, which free uses to
+    // skip the sample lookup for most pointers. The tracker must account
+    // the aligned size as free will use the real size of the allocation.
+    alignment = std::max(alignment, JEArenaHeapProfiler::SampleAlignment);
+    memAllocated(client.index,
+                 client.domain,
+                 size,
+                 std::align_val_t{alignment});
+    auto* ptr = je_mallocx(
+            size, client.getMallocFlags() | flags | MALLOCX_ALIGN(alignment));
+    if (ptr) {
+        try {
+            withoutClient(client, [client, ptr, size]() {
+                JEArenaHeapProfiler::recordSample(client.index, ptr, size);
+            });
+        } catch (const std::exception&) {
+            // Failing to record the sample mustn't fail the allocation
+        }
+    }
+    return ptr;
+}
+
+template <>
+bool JEArenaMalloc::removeSample(const ClientHandle& client, void* ptr) {
+    return withoutClient(client, [client, ptr]() {
+        return JEArenaHeapProfiler::removeSample(client.index, ptr);
+    });
+}
+
+/// Count an allocation in the client's size histogram, if enabled
+static void histogramAllocated(uint8_t index, size_t size) {
+    if (auto* histogram = JEArenaSizeHistogram::get(index)) {
+        histogram->memAllocated(size);
+    }
+}
+
+/// Count a free in the client's size histogram, if enabled
+static void histogramDeallocated(uint8_t index) {
+    if (auto* histogram = JEArenaSizeHistogram::get(index)) {
+        histogram->memDeallocated();
+    }
+}
+
 template <>
 void* JEArenaMalloc::malloc(size_t size) {
     if (size == 0) {
         size = 8;
     }
-    auto c = ThreadLocalData::get().getCurrentClient();
+    auto& tld = ThreadLocalData::get();
+    auto c = tld.getCurrentClient();
+    histogramAllocated(c.index, size);
+    if (JEArenaHeapProfiler::shouldSample(
+                tld.getHeapProfilerState(), c.index, size)) {
+        return sampledAllocate(c, size, 0, 0);
+    }
     memAllocated(c.index, c.domain, size);
     return je_mallocx(size, c.getMallocFlags());
 }
 
 template <>
 void* JEArenaMalloc::calloc(size_t nmemb, size_t size) {
-    auto c = ThreadLocalData::get().getCurrentClient();
+    auto& tld = ThreadLocalData::get();
+    auto c = tld.getCurrentClient();
+    histogramAllocated(c.index, nmemb * size);
+    if (JEArenaHeapProfiler::shouldSample(
+                tld.getHeapProfilerState(), c.index, nmemb * size)) {
+        return sampledAllocate(c, nmemb * size, 0, MALLOCX_ZERO);
+    }
     memAllocated(c.index, c.domain, nmemb * size);
     return je_mallocx(nmemb * size, c.getMallocFlags() | MALLOCX_ZERO);
 }
@@ -415,10 +531,15 @@ void* JEArenaMalloc::realloc(void* ptr, size_t size) {
     auto c = ThreadLocalData::get().getCurrentClient();
 
     if (!ptr) {
-        memAllocated(c.index, c.domain, size);
-        return je_mallocx(size, c.getMallocFlags());
+        return JEArenaMalloc::malloc(size);
     }
 
+    if (JEArenaHeapProfiler::maybeSampled(ptr)) {
+        // The reallocated memory isn't sampled
+        removeSample(c, ptr);
+    }
+    histogramDeallocated(c.index);
+    histogramAllocated(c.index, size);
     memDeallocated(c.index, c.domain, ptr);
     memAllocated(c.index, c.domain, size);
     return je_rallocx(ptr, size, c.getMallocFlags());
@@ -429,7 +550,13 @@ void* JEArenaMalloc::aligned_alloc(size_t alignment, size_t size) {
     if (size == 0) {
         size = 8;
     }
-    auto c = ThreadLocalData::get().getCurrentClient();
+    auto& tld = ThreadLocalData::get();
+    auto c = tld.getCurrentClient();
+    histogramAllocated(c.index, size);
+    if (JEArenaHeapProfiler::shouldSample(
+                tld.getHeapProfilerState(), c.index, size)) {
+        return sampledAllocate(c, size, alignment, 0);
+    }
     memAllocated(c.index, c.domain, size, std::align_val_t{alignment});
     return je_mallocx(size, c.getMallocFlags() | MALLOCX_ALIGN(alignment));
 }
@@ -441,6 +568,10 @@ void JEArenaMalloc::free(void* ptr) {
         if (arenaDebugChecksEnabled()) {
             verifyMemDeallocatedByCorrectClient(c, ptr, je_sallocx(ptr, 0));
         }
+        histogramDeallocated(c.index);
+        if (JEArenaHeapProfiler::maybeSampled(ptr)) {
+            removeSample(c, ptr);
+        }
         memDeallocated(c.index, c.domain, ptr);
         je_dallocx(ptr, c.getMallocFlags());
     }
@@ -459,6 +590,18 @@ void JEArenaMalloc::sized_free(void* ptr, size_t size) {
         if (arenaDebugChecksEnabled()) {
             verifyMemDeallocatedByCorrectClient(c, ptr, size);
         }
+        histogramDeallocated(c.index);
+        const bool sampled = JEArenaHeapProfiler::maybeSampled(ptr) &&
+                             removeSample(c, ptr);
+        if (sampled || JEArenaHeapProfiler::maybeSampledSmall(ptr, size)) {
+            // Sampled allocations have a larger alignment than size implies,
+            // so free them by their real size. This doesn't depend on the
+            // current client, sdallocx with a small size would corrupt the
+            // heap.
+            memDeallocated(c.index, c.domain, ptr);
+            je_dallocx(ptr, c.getMallocFlags());
+            return;
+        }
         memDeallocated(c.index, c.domain, size);
         je_sdallocx(ptr, size, c.getMallocFlags());
     }
@@ -705,6 +848,206 @@ AllocatorHooks AllocatorHooks::initialise() {
 
 static AllocatorHooks allocatorHooks = AllocatorHooks::initialise();
 
+/// The huge page state of an arena
+struct ArenaHugePages {
+    /// Should new extents of the arena be backed by huge pages?
+    RelaxedAtomic<bool> enabled;
+    /// Bytes of the arena's extents currently advised MADV_HUGEPAGE
+    RelaxedAtomic<size_t> advised;
+};
+
+/// The huge page state of every arena, indexed by arena id. Hooks run inside
+/// jemalloc (possibly with arena locks held) so they must not allocate, hence
+/// a fixed array.
+static std::array<ArenaHugePages, MALLCTL_ARENAS_ALL> arenaHugePages;
+
+/// The size of a transparent huge page, 0 until huge pages are first enabled
+/// (and if the platform doesn't support them)
+static RelaxedAtomic<size_t> hugePageSize{0};
+
+/// A range of an arena's extent which is advised MADV_HUGEPAGE
+struct HugePageRange {
+    unsigned arena;
+    uintptr_t begin;
+    /// 0 if the slot is free
+    uintptr_t end;
+};
+
+/**
+ * The advised ranges of all arenas, so that the advice can be withdrawn when
+ * the arena's client is unregistered (jemalloc retains extents, so the next
+ * client of the arena would otherwise reuse them). Extents grow
+ * geometrically so there are few of them; a range which doesn't fit isn't
+ * advised. A fixed array and a leaf lock, as the hooks must not allocate.
+ */
+struct HugePageRanges {
+    std::mutex mutex;
+    std::array<HugePageRange, 1024> ranges;
+};
+static HugePageRanges hugePageRanges;
+
+#ifdef MADV_HUGEPAGE
+/// Track [begin, end) of the arena as advised
+/// @return false if there's no room to track the range
+static bool addHugePageRange(unsigned arena, uintptr_t begin, uintptr_t end) {
+    std::lock_guard<std::mutex> guard(hugePageRanges.mutex);
+    for (auto& range : hugePageRanges.ranges) {
+        if (range.end == 0) {
+            range = {arena, begin, end};
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+/// @return the transparent huge page size of the system, 0 if not supported
+static size_t readHugePageSize() {
+#ifdef MADV_HUGEPAGE
+    try {
+        return std::stoul(cb::io::loadFile(
+                "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"));
+    } catch (const std::exception&) {
+        // The kernel doesn't support transparent huge pages
+    }
+#endif
+    return 0;
+}
+
+/// @return the whole huge pages within [addr, addr + size) as {begin, end}
+static std::pair<uintptr_t, uintptr_t> getHugePageRange(void* addr,
+                                                        size_t size) {
+    const auto pageSize = hugePageSize.load();
+    const auto begin = reinterpret_cast<uintptr_t>(addr);
+    const auto hugeBegin = (begin + pageSize - 1) & ~(pageSize - 1);
+    const auto hugeEnd = (begin + size) & ~(pageSize - 1);
+    return {hugeBegin, std::max(hugeBegin, hugeEnd)};
+}
+
+/**
+ * Advise the kernel how to back a new extent of an arena with huge pages
+ * enabled. The whole huge pages of the extent are advised MADV_HUGEPAGE. An
+ * extent too small to hold one (or which the kernel refuses to advise) is
+ * advised MADV_NOHUGEPAGE instead, so that with THP set to "always" it isn't
+ * backed by a huge page it only partially uses.
+ */
+static void adviseHugePages(unsigned arena, void* addr, size_t size) {
+#ifdef MADV_HUGEPAGE
+    const auto [begin, end] = getHugePageRange(addr, size);
+    if (end > begin && madvise(reinterpret_cast<void*>(begin),
+                               end - begin,
+                               MADV_HUGEPAGE) == 0) {
+        if (addHugePageRange(arena, begin, end)) {
+            arenaHugePages[arena].advised += end - begin;
+            return;
+        }
+        // The advice couldn't be withdrawn later, so don't keep it
+    }
+    (void)madvise(addr, size, MADV_NOHUGEPAGE);
+#else
+    (void)arena;
+    (void)addr;
+    (void)size;
+#endif
+}
+
+/// Called when an extent is unmapped, to stop counting its huge pages
+static void releaseHugePages(unsigned arena, void* addr, size_t size) {
+    if (arena >= arenaHugePages.size() || hugePageSize.load() == 0) {
+        return;
+    }
+    const auto begin = reinterpret_cast<uintptr_t>(addr);
+    const auto end = begin + size;
+    size_t released = 0;
+    {
+        std::lock_guard<std::mutex> guard(hugePageRanges.mutex);
+        for (auto& range : hugePageRanges.ranges) {
+            if (range.end == 0 || range.arena != arena ||
+                range.end <= begin || range.begin >= end) {
+                continue;
+            }
+            if (range.begin < begin) {
+                // If unmapped from the middle this stops tracking the tail
+                // too (its advice can't be withdrawn, but that's rare)
+                released += range.end - begin;
+                range.end = begin;
+            } else if (range.end > end) {
+                released += end - range.begin;
+                range.begin = end;
+            } else {
+                released += range.end - range.begin;
+                range.end = 0;
+            }
+        }
+    }
+    auto& advised = arenaHugePages[arena].advised;
+    auto current = advised.load();
+    size_t next;
+    do {
+        next = current - std::min(current, released);
+    } while (!advised.compare_exchange_weak(current, next));
+}
+
+static void setArenaHugePages(const DomainToArena& arenas, bool enabled) {
+    for (const auto arena : arenas) {
+        if (arena != 0) {
+            arenaHugePages.at(arena).enabled = enabled;
+        }
+    }
+}
+
+static void resetArenaHugePages(const DomainToArena& arenas) {
+    setArenaHugePages(arenas, false);
+    std::lock_guard<std::mutex> guard(hugePageRanges.mutex);
+    for (auto& range : hugePageRanges.ranges) {
+        if (range.end == 0 ||
+            std::find(arenas.begin(), arenas.end(), range.arena) ==
+                    arenas.end()) {
+            continue;
+        }
+#ifdef MADV_NOHUGEPAGE
+        (void)madvise(reinterpret_cast<void*>(range.begin),
+                      range.end - range.begin,
+                      MADV_NOHUGEPAGE);
+#endif
+        range.end = 0;
+    }
+    for (const auto arena : arenas) {
+        if (arena != 0) {
+            arenaHugePages.at(arena).advised = 0;
+        }
+    }
+}
+
+template <>
+bool JEArenaMalloc::setHugePagesEnabled(const ArenaMallocClient& client,
+                                        bool enabled) {
+    static const size_t pageSize = [] {
+        const auto size = readHugePageSize();
+        hugePageSize = size;
+        return size;
+    }();
+    if (pageSize == 0) {
+        return false;
+    }
+    setArenaHugePages(client.arenas, enabled);
+    return true;
+}
+
+template <>
+size_t JEArenaMalloc::getHugePageBytes(const ArenaMallocClient& client) {
+    // Arenas may be shared between the domains of the client
+    const auto& arenas = client.arenas;
+    size_t bytes = 0;
+    for (size_t ii = 0; ii < arenas.size(); ii++) {
+        const auto end = arenas.begin() + ii;
+        if (std::find(arenas.begin(), end, arenas[ii]) == end) {
+            bytes += arenaHugePages.at(arenas[ii]).advised;
+        }
+    }
+    return bytes;
+}
+
 static void* cb_alloc(extent_hooks_t* extent_hooks,
                       void* newAddr,
                       size_t size,
@@ -712,8 +1055,18 @@ static void* cb_alloc(extent_hooks_t* extent_hooks,
                       bool* zero,
                       bool* commit,
                       unsigned arena_ind) {
-    return allocatorHooks.jemalloc_hooks.alloc(
+    const bool hugePages = arena_ind < arenaHugePages.size() &&
+                           arenaHugePages[arena_ind].enabled;
+    if (hugePages && newAddr == nullptr && size >= hugePageSize) {
+        // Align so that the whole extent can be backed by huge pages
+        alignment = std::max(alignment, hugePageSize.load());
+    }
+    auto* ret = allocatorHooks.jemalloc_hooks.alloc(
             extent_hooks, newAddr, size, alignment, zero, commit, arena_ind);
+    if (ret && hugePages) {
+        adviseHugePages(arena_ind, ret, size);
+    }
+    return ret;
 }
 
 static bool cb_dalloc(extent_hooks_t* extent_hooks,
@@ -721,8 +1074,13 @@ static bool cb_dalloc(extent_hooks_t* extent_hooks,
                       size_t size,
                       bool committed,
                       unsigned arena_ind) {
-    return allocatorHooks.jemalloc_hooks.dalloc(
+    // Returns true if jemalloc opted out, keeping the extent mapped
+    const auto optOut = allocatorHooks.jemalloc_hooks.dalloc(
             extent_hooks, addr, size, committed, arena_ind);
+    if (!optOut) {
+        releaseHugePages(arena_ind, addr, size);
+    }
+    return optOut;
 }
 
 static void cb_destroy(extent_hooks_t* extent_hooks,
@@ -730,6 +1088,7 @@ static void cb_destroy(extent_hooks_t* extent_hooks,
                        size_t size,
                        bool committed,
                        unsigned arena_ind) {
+    releaseHugePages(arena_ind, addr, size);
     allocatorHooks.jemalloc_hooks.destroy(
             extent_hooks, addr, size, committed, arena_ind);
 }
@@ -9,12 +9,15 @@
  */
 
 #include <jemalloc/jemalloc.h>
+#include <platform/dirutils.h>
 #include <platform/je_arena_malloc.h>
 #include <platform/sized_buffer.h>
 
 #include <array>
 #include <cstdio>
+#include <optional>
 #include <string>
+#include <string_view>
 
 // Helper function for calling mallctl
 static int getJemallocStat(const std::string& property, size_t* value) {
@@ -82,13 +85,33 @@ static cb::FragmentationStats getFragmentation(int arena) {
     return {allocated, resident};
 }
 
+template <>
+std::optional<size_t> cb::JEArenaMalloc::getAnonHugePageBytes() {
+#ifdef __linux__
+    try {
+        const auto rollup = cb::io::loadFile("/proc/self/smaps_rollup");
+        const std::string_view key = "AnonHugePages:";
+        const auto pos = rollup.find(key);
+        if (pos != std::string::npos) {
+            // The value is in kB
+            return std::stoull(rollup.substr(pos + key.size())) * 1024;
+        }
+    } catch (const std::exception&) {
+        // smaps_rollup requires Linux 4.14
+    }
+#endif
+    return {};
+}
+
 template <>
 bool cb::JEArenaMalloc::getStats(
         const cb::ArenaMallocClient& client,
         std::unordered_map<std::string, size_t>& statsMap) {
     // TODO: Just give stats about primary domain for now, maybe aggregate ?
-    return getJeMallocStats(client.arenas.at(size_t(MemoryDomain::Primary)),
-                            statsMap);
+    const auto missing = getJeMallocStats(
+            client.arenas.at(size_t(MemoryDomain::Primary)), statsMap);
+    statsMap["huge_pages_advised"] = getHugePageBytes(client);
+    return missing;
 }
 
 template <>
@@ -116,6 +139,18 @@ std::string cb::JEArenaMalloc::getDetailedStats() {
     return buffer;
 }
 
+template <>
+void cb::JEArenaMalloc::setSizeHistogramEnabled(
+        const cb::ArenaMallocClient& client, bool enabled) {
+    JEArenaSizeHistogram::setEnabled(client, enabled);
+}
+
+template <>
+std::string cb::JEArenaMalloc::getSizeHistogramJson(
+        const cb::ArenaMallocClient& client) {
+    return JEArenaSizeHistogram::getJson(client);
+}
+
 template <>
 cb::FragmentationStats cb::JEArenaMalloc::getFragmentationStats(
         const cb::ArenaMallocClient& client) {
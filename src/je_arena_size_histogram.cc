@@ -0,0 +1,168 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+#include <platform/je_arena_size_histogram.h>
+
+#include <folly/lang/Aligned.h>
+#include <folly/lang/Bits.h>
+#include <nlohmann/json.hpp>
+#include <platform/cb_arena_malloc.h>
+#include <platform/corestore.h>
+#include <relaxed_atomic.h>
+
+#include <mutex>
+
+namespace cb {
+
+struct JEArenaSizeHistogram::Counters {
+    struct Core {
+        std::array<RelaxedAtomic<uint64_t>, NumBuckets> buckets{};
+        RelaxedAtomic<uint64_t> frees{};
+    };
+
+    CoreStore<folly::cacheline_aligned<Core>> cores;
+};
+
+std::array<std::atomic<JEArenaSizeHistogram*>, ArenaMallocMaxClients + 1>
+        JEArenaSizeHistogram::active{};
+
+/// Guards the creation of histograms
+static std::mutex histogramsMutex;
+
+/// All histograms ever created, indexed by client. Once created a histogram
+/// is never freed as other threads may still be updating it after it has been
+/// disabled; it is reused if the client index enables it again.
+static std::array<JEArenaSizeHistogram*, ArenaMallocMaxClients> histograms{};
+
+JEArenaSizeHistogram::JEArenaSizeHistogram()
+    : counters(std::make_unique<Counters>()) {
+}
+
+JEArenaSizeHistogram::~JEArenaSizeHistogram() = default;
+
+size_t JEArenaSizeHistogram::getBucket(size_t size) {
+    if (size <= 8) {
+        return 0;
+    }
+    if (size <= 64) {
+        return (size + 15) / 16;
+    }
+    if (size > MaxSize) {
+        return NumBuckets - 1;
+    }
+    // 2^lg < size <= 2^(lg + 1), in four steps of 2^(lg - 2)
+    const size_t lg = folly::findLastSet(size - 1) - 1;
+    const size_t step = size_t(1) << (lg - 2);
+    const size_t pos = (size - (size_t(1) << lg) + step - 1) / step - 1;
+    return 5 + (lg - 6) * 4 + pos;
+}
+
+void JEArenaSizeHistogram::memAllocated(size_t size) {
+    counters->cores.get()->buckets[getBucket(size)]++;
+}
+
+void JEArenaSizeHistogram::memDeallocated() {
+    counters->cores.get()->frees++;
+}
+
+size_t JEArenaSizeHistogram::getBucketSize(size_t bucket) {
+    if (bucket == 0) {
+        return 8;
+    }
+    if (bucket <= 4) {
+        return bucket * 16;
+    }
+    if (bucket >= NumBuckets - 1) {
+        return 0;
+    }
+    const size_t lg = 6 + (bucket - 5) / 4;
+    const size_t pos = (bucket - 5) % 4;
+    return (size_t(1) << lg) + ((pos + 1) << (lg - 2));
+}
+
+void JEArenaSizeHistogram::setEnabled(const ArenaMallocClient& client,
+                                      bool enabled) {
+    // The histogram belongs to no client
+    NoArenaGuard guard;
+    std::lock_guard<std::mutex> lock(histogramsMutex);
+    if (!enabled) {
+        active[client.index] = nullptr;
+        return;
+    }
+    auto*& histogram = histograms.at(client.index);
+    if (!histogram) {
+        histogram = new JEArenaSizeHistogram();
+    }
+    histogram->reset();
+    active[client.index] = histogram;
+}
+
+std::string JEArenaSizeHistogram::getJson(const ArenaMallocClient& client) {
+    NoArenaGuard guard;
+    auto* histogram = get(client.index);
+    if (!histogram) {
+        return "null";
+    }
+    return histogram->toJson();
+}
+
+void JEArenaSizeHistogram::reset() {
+    for (auto& core : counters->cores) {
+        for (auto& bucket : core->buckets) {
+            bucket.reset();
+        }
+        core->frees.reset();
+    }
+    start = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::string JEArenaSizeHistogram::toJson() const {
+    std::array<uint64_t, NumBuckets> buckets{};
+    uint64_t frees = 0;
+    for (const auto& core : counters->cores) {
+        for (size_t ii = 0; ii < NumBuckets; ii++) {
+            buckets[ii] += core->buckets[ii];
+        }
+        frees += core->frees;
+    }
+
+    uint64_t allocations = 0;
+    auto sizes = nlohmann::json::array();
+    for (size_t ii = 0; ii < NumBuckets; ii++) {
+        if (buckets[ii] == 0) {
+            continue;
+        }
+        allocations += buckets[ii];
+        if (ii == NumBuckets - 1) {
+            sizes.push_back(nlohmann::json{{"min_size", MaxSize + 1},
+                                           {"count", buckets[ii]}});
+        } else {
+            sizes.push_back(nlohmann::json{{"max_size", getBucketSize(ii)},
+                                           {"count", buckets[ii]}});
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    const auto elapsed =
+            std::chrono::duration<double>(
+                    now - std::chrono::steady_clock::duration(start.load()))
+                    .count();
+    nlohmann::json json = {{"duration_s", elapsed},
+                           {"allocations", allocations},
+                           {"frees", frees},
+                           {"size_classes", std::move(sizes)}};
+    if (elapsed > 0) {
+        json["allocation_rate"] = double(allocations) / elapsed;
+        json["free_rate"] = double(frees) / elapsed;
+    }
+    return json.dump();
+}
+
+} // namespace cb
@@ -238,6 +238,31 @@ std::string SystemArenaMalloc::getDetailedStats() {
     return {};
 }
 
+void SystemArenaMalloc::setSizeHistogramEnabled(
+        const ArenaMallocClient& client, bool enabled) {
+    // Not supported
+    (void)client;
+    (void)enabled;
+}
+
+std::string SystemArenaMalloc::getSizeHistogramJson(
+        const ArenaMallocClient& client) {
+    (void)client;
+    return "null";
+}
+
+bool SystemArenaMalloc::setHugePagesEnabled(const ArenaMallocClient& client,
+                                            bool enabled) {
+    // Not supported
+    (void)client;
+    (void)enabled;
+    return false;
+}
+
+std::optional<size_t> SystemArenaMalloc::getAnonHugePageBytes() {
+    return {};
+}
+
 cb::FragmentationStats SystemArenaMalloc::getFragmentationStats(
         const cb::ArenaMallocClient& client) {
     size_t alloc = getPreciseAllocated(client);
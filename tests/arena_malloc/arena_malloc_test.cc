@@ -10,13 +10,20 @@
 
 #include <folly/ScopeGuard.h>
 #include <folly/portability/GTest.h>
+#include <nlohmann/json.hpp>
 #include <platform/cb_arena_malloc.h>
 #include <platform/cb_malloc.h>
+#include <platform/sysinfo.h>
+#include <algorithm>
+#include <filesystem>
+#include <latch>
 #include <thread>
 #include <vector>
 
 #if defined(HAVE_JEMALLOC)
 #include <jemalloc/jemalloc.h>
+#include <platform/je_arena_heap_profiler.h>
+#include <platform/je_arena_size_histogram.h>
 #endif
 
 class ArenaMalloc : public ::testing::Test {
@@ -360,6 +367,294 @@ TEST_F(ArenaMalloc, DISABLED_thresholds) {
     cb::ArenaMalloc::unregisterClient(client);
 }
 
+#if defined(HAVE_JEMALLOC)
+TEST_F(ArenaMalloc, thresholdsThreadLocalDeltas) {
+#else
+TEST_F(ArenaMalloc, DISABLED_thresholdsThreadLocalDeltas) {
+#endif
+    if (cb::ArenaMalloc::isTrackingAlwaysPrecise()) {
+        // Tracking always precise, test not applicable.
+        return;
+    }
+    auto client = cb::ArenaMalloc::registerClient();
+    client.estimateUpdateThreshold = 1024;
+    client.threadLocalDeltas = true;
+    cb::ArenaMalloc::setAllocatedThreshold(client);
+    cb::ArenaMalloc::switchToClient(client);
+    auto p1 = cb_malloc(100);
+
+    // p1 is held in this thread's delta, the estimate doesn't see it
+    EXPECT_EQ(0, cb::ArenaMalloc::getEstimatedAllocated(client));
+
+    // A precise read from the same thread pushes the thread's delta out
+    auto p1val = cb::ArenaMalloc::getPreciseAllocated(client);
+    EXPECT_NE(0, p1val);
+    EXPECT_EQ(p1val, cb::ArenaMalloc::getEstimatedAllocated(client));
+    EXPECT_EQ(p1val,
+              cb::ArenaMalloc::getPreciseAllocated(client,
+                                                   cb::MemoryDomain::Primary));
+
+    // Exceeding the thread and core thresholds (half of 1024 each) updates
+    // the estimate without a switch or a precise read
+    auto p2 = cb_malloc(1025);
+    auto p2val = cb::ArenaMalloc::getEstimatedAllocated(client);
+    EXPECT_GT(p2val, p1val);
+    EXPECT_EQ(p2val, cb::ArenaMalloc::getPreciseAllocated(client));
+
+    cb_free(p1);
+    cb_free(p2);
+    cb::ArenaMalloc::switchFromClient();
+    EXPECT_EQ(0, cb::ArenaMalloc::getPreciseAllocated(client));
+    cb::ArenaMalloc::unregisterClient(client);
+}
+
+// At most one thread per core may hold deltas of a client, any others must
+// update the core counters directly to keep the drift bound.
+#if defined(HAVE_JEMALLOC)
+TEST_F(ArenaMalloc, threadLocalDeltasLimitedToCores) {
+#else
+TEST_F(ArenaMalloc, DISABLED_threadLocalDeltasLimitedToCores) {
+#endif
+    if (cb::ArenaMalloc::isTrackingAlwaysPrecise()) {
+        // Tracking always precise, test not applicable.
+        return;
+    }
+    auto client = cb::ArenaMalloc::registerClient();
+    client.estimateUpdateThreshold = 1024 * 1024;
+    client.threadLocalDeltas = true;
+    cb::ArenaMalloc::setAllocatedThreshold(client);
+
+    const auto extra = size_t(2);
+    const auto nthreads = cb::get_cpu_count() + extra;
+    std::latch allocated(static_cast<std::ptrdiff_t>(nthreads + 1));
+    std::latch done(1);
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < nthreads; ++ii) {
+        threads.emplace_back([&client, &allocated, &done]() {
+            cb::ArenaMalloc::switchToClient(client);
+            auto* p = cb_malloc(100);
+            allocated.count_down();
+            // Stay switched to the client so the deltas are not flushed
+            done.wait();
+            cb_free(p);
+            cb::ArenaMalloc::switchFromClient();
+        });
+    }
+    allocated.arrive_and_wait();
+
+    // Every thread holds a live allocation; only the ones which could not
+    // batch are visible to a precise read from a thread which holds none.
+    const auto visible = cb::ArenaMalloc::getPreciseAllocated(client);
+    EXPECT_GE(visible, extra * 100);
+    EXPECT_LT(visible, nthreads * 100);
+
+    done.count_down();
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(0, cb::ArenaMalloc::getPreciseAllocated(client));
+    cb::ArenaMalloc::unregisterClient(client);
+}
+
+#if defined(HAVE_JEMALLOC)
+TEST_F(ArenaMalloc, HeapProfiler) {
+    auto client = cb::ArenaMalloc::registerClient(false);
+    // Sample every allocation
+    cb::JEArenaHeapProfiler::setSampleInterval(1);
+    auto disable = folly::makeGuard(
+            []() { cb::JEArenaHeapProfiler::setSampleInterval(0); });
+    // A thread picks up a new interval within 1MiB of allocation
+    cb_free(cb_malloc(2 * 1024 * 1024));
+
+    std::vector<void*> allocations;
+    allocations.reserve(10);
+    cb::ArenaMalloc::switchToClient(client);
+    for (int i = 0; i < 10; i++) {
+        allocations.push_back(cb_malloc(1000));
+    }
+    cb::ArenaMalloc::switchFromClient();
+
+    EXPECT_EQ(10, cb::JEArenaHeapProfiler::getSampleCount(client));
+    EXPECT_EQ(10000, cb::JEArenaHeapProfiler::getEstimatedBytes(client));
+    for (auto* ptr : allocations) {
+        EXPECT_EQ(0,
+                  reinterpret_cast<uintptr_t>(ptr) %
+                          cb::JEArenaHeapProfiler::SampleAlignment);
+    }
+
+    // All of the allocations were made from the same call stack
+    auto folded = cb::JEArenaHeapProfiler::dumpFolded(client);
+    EXPECT_NE(std::string::npos, folded.find(" 10000\n")) << folded;
+    auto pprof = cb::JEArenaHeapProfiler::dumpPprof(client);
+    EXPECT_EQ(0, pprof.rfind("heap_v2/1\n  t*: 10: 10000 [0: 0]\n@ 0x", 0))
+            << pprof;
+    EXPECT_NE(std::string::npos, pprof.find("MAPPED_LIBRARIES:"));
+
+    // Freeing removes the samples, and the tracking accounted the sampled
+    // allocations at their real size
+    cb::ArenaMalloc::switchToClient(client);
+    for (auto* ptr : allocations) {
+        cb_free(ptr);
+    }
+    cb::ArenaMalloc::switchFromClient();
+    EXPECT_EQ(0, cb::JEArenaHeapProfiler::getSampleCount(client));
+    EXPECT_EQ(0, cb::ArenaMalloc::getPreciseAllocated(client));
+    cb::ArenaMalloc::unregisterClient(client);
+}
+
+// A sampled allocation freed with its (small) size without the client which
+// sampled it must still be freed by its real size and lose its sample.
+TEST_F(ArenaMalloc, HeapProfilerSizedFreeWithoutClient) {
+    auto client = cb::ArenaMalloc::registerClient(false);
+    cb::JEArenaHeapProfiler::setSampleInterval(1);
+    auto disable = folly::makeGuard(
+            []() { cb::JEArenaHeapProfiler::setSampleInterval(0); });
+    cb_free(cb_malloc(2 * 1024 * 1024));
+
+    cb::ArenaMalloc::switchToClient(client);
+    auto* ptr = cb_malloc(100);
+    cb::ArenaMalloc::switchFromClient();
+    ASSERT_EQ(1, cb::JEArenaHeapProfiler::getSampleCount(client));
+
+    cb_sized_free(ptr, 100);
+    EXPECT_EQ(0, cb::JEArenaHeapProfiler::getSampleCount(client));
+
+    // Freeing the page into the small size class would hand overlapping
+    // memory out to these allocations
+    std::vector<char*> allocations;
+    for (int i = 0; i < 1000; i++) {
+        auto* p = static_cast<char*>(cb_malloc(100));
+        std::fill(p, p + 100, char(i));
+        allocations.push_back(p);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(char(i), allocations[i][0]);
+        EXPECT_EQ(char(i), allocations[i][99]);
+        cb_free(allocations[i]);
+    }
+    cb::ArenaMalloc::unregisterClient(client);
+}
+#endif
+
+#if defined(HAVE_JEMALLOC)
+// The histogram buckets must match jemalloc's size classes
+TEST_F(ArenaMalloc, SizeHistogramBuckets) {
+    for (size_t size = 1; size <= 1024 * 1024; size++) {
+        ASSERT_EQ(je_nallocx(size, 0),
+                  cb::JEArenaSizeHistogram::getBucketSize(
+                          cb::JEArenaSizeHistogram::getBucket(size)))
+                << size;
+    }
+    EXPECT_EQ(cb::JEArenaSizeHistogram::NumBuckets - 2,
+              cb::JEArenaSizeHistogram::getBucket(
+                      cb::JEArenaSizeHistogram::MaxSize));
+    EXPECT_EQ(cb::JEArenaSizeHistogram::NumBuckets - 1,
+              cb::JEArenaSizeHistogram::getBucket(
+                      cb::JEArenaSizeHistogram::MaxSize + 1));
+}
+
+TEST_F(ArenaMalloc, SizeHistogram) {
+    auto client = cb::ArenaMalloc::registerClient(false);
+    EXPECT_EQ("null", cb::ArenaMalloc::getSizeHistogramJson(client));
+    cb::ArenaMalloc::setSizeHistogramEnabled(client, true);
+
+    cb::ArenaMalloc::switchToClient(client);
+    auto* p1 = cb_malloc(10);
+    auto* p2 = cb_malloc(10);
+    auto* p3 = cb_malloc(100);
+    cb_free(p1);
+    cb::ArenaMalloc::switchFromClient();
+    // Allocations without the client aren't counted
+    cb_free(cb_malloc(10));
+
+    auto json = nlohmann::json::parse(
+            cb::ArenaMalloc::getSizeHistogramJson(client));
+    EXPECT_EQ(3, json["allocations"]);
+    EXPECT_EQ(1, json["frees"]);
+    EXPECT_EQ(nlohmann::json::parse(R"([{"max_size":16,"count":2},
+                                        {"max_size":112,"count":1}])"),
+              json["size_classes"]);
+
+    cb::ArenaMalloc::setSizeHistogramEnabled(client, false);
+    EXPECT_EQ("null", cb::ArenaMalloc::getSizeHistogramJson(client));
+
+    cb::ArenaMalloc::switchToClient(client);
+    cb_free(p2);
+    cb_free(p3);
+    cb::ArenaMalloc::switchFromClient();
+
+    // Unregistering disables the histogram, the next client using the index
+    // must not inherit it
+    cb::ArenaMalloc::setSizeHistogramEnabled(client, true);
+    cb::ArenaMalloc::unregisterClient(client);
+    auto next = cb::ArenaMalloc::registerClient(false);
+    ASSERT_EQ(client.index, next.index);
+    EXPECT_EQ("null", cb::ArenaMalloc::getSizeHistogramJson(next));
+    cb::ArenaMalloc::switchToClient(next);
+    cb_free(cb_malloc(10));
+    cb::ArenaMalloc::switchFromClient();
+    EXPECT_EQ("null", cb::ArenaMalloc::getSizeHistogramJson(next));
+    cb::ArenaMalloc::unregisterClient(next);
+}
+#endif
+
+#if defined(HAVE_JEMALLOC) && defined(__linux__)
+TEST_F(ArenaMalloc, HugePages) {
+    auto client = cb::ArenaMalloc::registerClient(false);
+    if (!cb::ArenaMalloc::setHugePagesEnabled(client, true)) {
+        cb::ArenaMalloc::unregisterClient(client);
+        GTEST_SKIP() << "Transparent huge pages are not supported";
+    }
+
+    std::unordered_map<std::string, size_t> stats;
+    cb::ArenaMalloc::getStats(client, stats);
+    const auto before = stats["huge_pages_advised"];
+
+    // Large enough to need a new extent, which is huge page backed
+    const size_t size = 256 * 1024 * 1024;
+    cb::ArenaMalloc::switchToClient(client);
+    auto* p = cb_malloc(size);
+    cb::ArenaMalloc::switchFromClient();
+    ASSERT_NE(nullptr, p);
+
+    cb::ArenaMalloc::getStats(client, stats);
+    EXPECT_GE(stats["huge_pages_advised"], before + size);
+
+    // The process' huge page usage is only read on request (smaps_rollup
+    // needs Linux 4.14)
+    stats.clear();
+    cb::ArenaMalloc::getGlobalStats(stats);
+    EXPECT_EQ(0, stats.count("anon_huge_pages"));
+    if (std::filesystem::exists("/proc/self/smaps_rollup")) {
+        EXPECT_TRUE(cb::ArenaMalloc::getAnonHugePageBytes().has_value());
+    }
+
+    cb::ArenaMalloc::switchToClient(client);
+    cb_free(p);
+    cb::ArenaMalloc::switchFromClient();
+    cb::ArenaMalloc::unregisterClient(client);
+
+    // The next client of the (reused) arenas didn't ask for huge pages, it
+    // must neither inherit the advice nor report it
+    auto next = cb::ArenaMalloc::registerClient(false);
+    ASSERT_EQ(client.index, next.index);
+    ASSERT_EQ(client.arenas, next.arenas);
+    stats.clear();
+    cb::ArenaMalloc::getStats(next, stats);
+    EXPECT_EQ(0, stats["huge_pages_advised"]);
+    cb::ArenaMalloc::switchToClient(next);
+    p = cb_malloc(size);
+    cb::ArenaMalloc::switchFromClient();
+    ASSERT_NE(nullptr, p);
+    cb::ArenaMalloc::getStats(next, stats);
+    EXPECT_EQ(0, stats["huge_pages_advised"]);
+    cb::ArenaMalloc::switchToClient(next);
+    cb_free(p);
+    cb::ArenaMalloc::switchFromClient();
+    cb::ArenaMalloc::unregisterClient(next);
+}
+#endif
+
 TEST_F(ArenaMalloc, threadsRegister) {
     cb::ArenaMallocClient c1, c2;
     std::thread a([&c1]() { c1 = cb::ArenaMalloc::registerClient(); });
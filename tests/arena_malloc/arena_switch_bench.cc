@@ -0,0 +1,68 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+/*
+ * Benchmark the cost of switching client and domain in JEArenaMalloc, which
+ * KV-Engine does for almost every operation.
+ */
+
+#include <benchmark/benchmark.h>
+#include <platform/je_arena_malloc.h>
+#include <platform/sysinfo.h>
+
+/// A single client shared by all of the benchmark threads
+static const cb::ArenaMallocClient& getClient() {
+    static const auto client = cb::JEArenaMalloc::registerClient(true);
+    return client;
+}
+
+/// switchToClient + switch back to the previous client
+static void SwitchToClient(benchmark::State& state) {
+    const auto& client = getClient();
+    while (state.KeepRunning()) {
+        auto previous = cb::JEArenaMalloc::switchToClient(
+                client, cb::MemoryDomain::Primary, true);
+        cb::JEArenaMalloc::switchToClient(previous);
+    }
+}
+
+/// Flip between the Primary and Secondary domain of the current client
+static void SetDomain(benchmark::State& state) {
+    auto previous = cb::JEArenaMalloc::switchToClient(
+            getClient(), cb::MemoryDomain::Primary, true);
+    while (state.KeepRunning()) {
+        cb::JEArenaMalloc::setDomain(cb::MemoryDomain::Secondary);
+        cb::JEArenaMalloc::setDomain(cb::MemoryDomain::Primary);
+    }
+    cb::JEArenaMalloc::switchToClient(previous);
+}
+
+/// The pattern of a typical operation, switch to the client, do some work in
+/// the Secondary domain, then switch back.
+static void SwitchToClientSetDomain(benchmark::State& state) {
+    const auto& client = getClient();
+    while (state.KeepRunning()) {
+        auto previous = cb::JEArenaMalloc::switchToClient(
+                client, cb::MemoryDomain::Primary, true);
+        cb::JEArenaMalloc::setDomain(cb::MemoryDomain::Secondary);
+        cb::JEArenaMalloc::setDomain(cb::MemoryDomain::Primary);
+        cb::JEArenaMalloc::switchToClient(previous);
+    }
+}
+
+static void threads(benchmark::internal::Benchmark* b) {
+    b->Threads(1)
+            ->Threads(static_cast<int>(cb::get_cpu_count()))
+            ->Threads(static_cast<int>(cb::get_cpu_count() * 4));
+}
+
+BENCHMARK(SwitchToClient)->Apply(threads);
+BENCHMARK(SetDomain)->Apply(threads);
+BENCHMARK(SwitchToClientSetDomain)->Apply(threads);
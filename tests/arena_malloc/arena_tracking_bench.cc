@@ -26,6 +26,10 @@ public:
         trackingImpl::clientRegistered(client, arenaDebugChecksEnabled);
     }
 
+    static void setAllocatedThreshold(const cb::ArenaMallocClient& client) {
+        trackingImpl::setAllocatedThreshold(client);
+    }
+
     static void memAllocated(uint8_t index, size_t size) {
         trackingImpl::memAllocated(index, cb::MemoryDomain::Primary, size);
     }
@@ -37,19 +41,42 @@ public:
 
 using BenchJEArenaMalloc = TestJEArenaMalloc<cb::JEArenaCoreLocalTracker>;
 
+/**
+ * Fixture for the default mode, where every update goes to the core-local
+ * counters.
+ */
 class MemoryAllocationStat : public benchmark::Fixture {
 public:
+    void SetUp(const benchmark::State& state) override {
+        if (state.thread_index() == 0) {
+            // memUsed merge must be 4 times higher so in theory we merge at
+            // the same rate as TLS (because 4 more threads than cores).
+            client.estimateUpdateThreshold = 10240 * 4;
+            client.threadLocalDeltas = useThreadLocalDeltas();
+            BenchJEArenaMalloc::setAllocatedThreshold(client);
+        }
+    }
+
+    virtual bool useThreadLocalDeltas() const {
+        return false;
+    }
+
     cb::ArenaMallocClient client{{}, 1, true};
 };
 
-BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNRead1)(benchmark::State& state) {
-    if (state.thread_index() == 0) {
-        // memUsed merge must be 4 times higher so in theory we merge at the
-        // same rate as TLS (because 4 more threads than cores).
-        client.estimateUpdateThreshold = 10240 * 4;
-        BenchJEArenaMalloc::setAllocatedThreshold(client);
+/**
+ * Fixture for the threadLocalDeltas mode, where updates are batched in plain
+ * thread-local integers before reaching the core-local counters.
+ */
+class ThreadLocalMemoryAllocationStat : public MemoryAllocationStat {
+public:
+    bool useThreadLocalDeltas() const override {
+        return true;
     }
+};
 
+static void allocNRead1(benchmark::State& state,
+                        const cb::ArenaMallocClient& client) {
     while (state.KeepRunning()) {
         // range = allocations per read
         for (int i = 0; i < state.range(0); i++) {
@@ -64,14 +91,8 @@ BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNRead1)(benchmark::State& state) {
     }
 }
 
-BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadM)(benchmark::State& state) {
-    if (state.thread_index() == 0) {
-        // memUsed merge must be 4 times higher so in theory we merge at the
-        // same rate as TLS (because 4 more threads than cores).
-        client.estimateUpdateThreshold = 10240 * 4;
-        BenchJEArenaMalloc::setAllocatedThreshold(client);
-    }
-
+static void allocNReadM(benchmark::State& state,
+                        const cb::ArenaMallocClient& client) {
     while (state.KeepRunning()) {
         // range = allocations per read
         for (int i = 0; i < state.range(0); i++) {
@@ -87,15 +108,8 @@ BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadM)(benchmark::State& state) {
     }
 }
 
-BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadPreciseM)
-(benchmark::State& state) {
-    if (state.thread_index() == 0) {
-        // memUsed merge must be 4 times higher so in theory we merge at the
-        // same rate as TLS (because 4 more threads than cores).
-        client.estimateUpdateThreshold = 10240 * 4;
-        BenchJEArenaMalloc::setAllocatedThreshold(client);
-    }
-
+static void allocNReadPreciseM(benchmark::State& state,
+                               const cb::ArenaMallocClient& client) {
     while (state.KeepRunning()) {
         // range = allocations per read
         for (int i = 0; i < state.range(0); i++) {
@@ -111,31 +125,105 @@ BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadPreciseM)
     }
 }
 
+/// Alloc and dealloc the same size, the common steady state of a client
+static void allocFree(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        for (int i = 0; i < state.range(0); i++) {
+            BenchJEArenaMalloc::memAllocated(1, 128);
+            BenchJEArenaMalloc::memDeallocated(1, 128);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+
+BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNRead1)(benchmark::State& state) {
+    allocNRead1(state, client);
+}
+
+BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadM)(benchmark::State& state) {
+    allocNReadM(state, client);
+}
+
+BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocNReadPreciseM)
+(benchmark::State& state) {
+    allocNReadPreciseM(state, client);
+}
+
+BENCHMARK_DEFINE_F(MemoryAllocationStat, AllocFree)(benchmark::State& state) {
+    allocFree(state);
+}
+
+BENCHMARK_DEFINE_F(ThreadLocalMemoryAllocationStat, AllocNRead1)
+(benchmark::State& state) {
+    allocNRead1(state, client);
+}
+
+BENCHMARK_DEFINE_F(ThreadLocalMemoryAllocationStat, AllocNReadM)
+(benchmark::State& state) {
+    allocNReadM(state, client);
+}
+
+BENCHMARK_DEFINE_F(ThreadLocalMemoryAllocationStat, AllocNReadPreciseM)
+(benchmark::State& state) {
+    allocNReadPreciseM(state, client);
+}
+
+BENCHMARK_DEFINE_F(ThreadLocalMemoryAllocationStat, AllocFree)
+(benchmark::State& state) {
+    allocFree(state);
+}
+
 // Tests cover a rough, but realistic range seen from a running cluster (with
 // pillowfight load). The range was discovered by counting calls to
 // memAllocated/deallocated and then logging how many had occurred for each
 // getEstimatedTotalMemoryUsed. A previous version of this file used the Range
 // API and can be used if this test is being used to perform deeper analysis of
 // this code.
-BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocNRead1)
-        ->Threads(static_cast<int>(cb::get_cpu_count() * 4))
-        ->Args({0})
-        ->Args({200})
-        ->Args({1000});
-
-BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocNReadM)
-        ->Threads(static_cast<int>(cb::get_cpu_count() * 4))
-        ->Args({0, 10})
-        ->Args({200, 10})
-        ->Args({1000, 10})
-        ->Args({0, 1000})
-        ->Args({200, 200})
-        ->Args({1000, 10});
+static void allocNRead1Args(benchmark::internal::Benchmark* b) {
+    b->Threads(static_cast<int>(cb::get_cpu_count() * 4))
+            ->Args({0})
+            ->Args({200})
+            ->Args({1000});
+}
+
+static void allocNReadMArgs(benchmark::internal::Benchmark* b) {
+    b->Threads(static_cast<int>(cb::get_cpu_count() * 4))
+            ->Args({0, 10})
+            ->Args({200, 10})
+            ->Args({1000, 10})
+            ->Args({0, 1000})
+            ->Args({200, 200})
+            ->Args({1000, 10});
+}
+
+static void allocNReadPreciseMArgs(benchmark::internal::Benchmark* b) {
+    b->Threads(static_cast<int>(cb::get_cpu_count() * 4))
+            // This benchmark is configured to run 'alloc heavy'. The
+            // getPrecise function is only used by getStats, which is
+            // infrequent relative to memory alloc/dealloc
+            ->Args({1000, 10})
+            ->Args({100000, 10});
+}
+
+static void allocFreeArgs(benchmark::internal::Benchmark* b) {
+    b->Threads(static_cast<int>(cb::get_cpu_count()))
+            ->Threads(static_cast<int>(cb::get_cpu_count() * 4))
+            ->Args({1000});
+}
+
+BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocNRead1)->Apply(allocNRead1Args);
+BENCHMARK_REGISTER_F(ThreadLocalMemoryAllocationStat, AllocNRead1)
+        ->Apply(allocNRead1Args);
+
+BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocNReadM)->Apply(allocNReadMArgs);
+BENCHMARK_REGISTER_F(ThreadLocalMemoryAllocationStat, AllocNReadM)
+        ->Apply(allocNReadMArgs);
 
 BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocNReadPreciseM)
-        ->Threads(static_cast<int>(cb::get_cpu_count() * 4))
-        // This benchmark is configured to run 'alloc heavy'. The getPrecise
-        // function is only used by getStats, which is infrequent relative to
-        // memory alloc/dealloc
-        ->Args({1000, 10})
-        ->Args({100000, 10});
+        ->Apply(allocNReadPreciseMArgs);
+BENCHMARK_REGISTER_F(ThreadLocalMemoryAllocationStat, AllocNReadPreciseM)
+        ->Apply(allocNReadPreciseMArgs);
+
+BENCHMARK_REGISTER_F(MemoryAllocationStat, AllocFree)->Apply(allocFreeArgs);
+BENCHMARK_REGISTER_F(ThreadLocalMemoryAllocationStat, AllocFree)
+        ->Apply(allocFreeArgs);
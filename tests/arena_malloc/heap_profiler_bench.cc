@@ -0,0 +1,104 @@
+/*
+ *     Copyright 2026-Present Couchbase, Inc.
+ *
+ *   Use of this software is governed by the Business Source License included
+ *   in the file licenses/BSL-Couchbase.txt.  As of the Change Date specified
+ *   in that file, in accordance with the Business Source License, use of this
+ *   software will be governed by the Apache License, Version 2.0, included in
+ *   the file licenses/APL2.txt.
+ */
+
+/*
+ * Benchmark the cost of the JEArenaHeapProfiler on the allocation and free
+ * paths of JEArenaMalloc, with sampling off and on.
+ */
+
+#include <benchmark/benchmark.h>
+#include <platform/je_arena_heap_profiler.h>
+#include <platform/je_arena_malloc.h>
+#include <platform/sysinfo.h>
+
+#include <mutex>
+#include <vector>
+
+/// A single client shared by all of the benchmark threads
+static const cb::ArenaMallocClient& getClient() {
+    static const auto client = cb::JEArenaMalloc::registerClient(true);
+    return client;
+}
+
+/// A thread picks up a new sample interval within 1MiB of allocation
+static void refreshSampleInterval() {
+    cb::JEArenaMalloc::free(cb::JEArenaMalloc::malloc(2 * 1024 * 1024));
+}
+
+/**
+ * Make sure the client has at least count live samples, so that frees have
+ * to rule them out. The samples are never freed.
+ */
+static void createLiveSamples(size_t count) {
+    static std::mutex mutex;
+    static std::vector<void*> samples;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (samples.size() >= count) {
+        return;
+    }
+    const auto interval = cb::JEArenaHeapProfiler::getSampleInterval();
+    cb::JEArenaHeapProfiler::setSampleInterval(1);
+    refreshSampleInterval();
+    auto previous = cb::JEArenaMalloc::switchToClient(
+            getClient(), cb::MemoryDomain::Primary, true);
+    std::vector<void*> allocations;
+    allocations.reserve(count - samples.size());
+    while (allocations.size() < allocations.capacity()) {
+        allocations.push_back(cb::JEArenaMalloc::malloc(64));
+    }
+    cb::JEArenaMalloc::switchToClient(previous);
+    cb::JEArenaHeapProfiler::setSampleInterval(interval);
+    samples.insert(samples.end(), allocations.begin(), allocations.end());
+}
+
+/// malloc + free of small allocations, sampling every state.range(0) bytes
+static void MallocFree(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        cb::JEArenaHeapProfiler::setSampleInterval(state.range(0));
+    }
+    refreshSampleInterval();
+    auto previous = cb::JEArenaMalloc::switchToClient(
+            getClient(), cb::MemoryDomain::Primary, true);
+    while (state.KeepRunning()) {
+        auto* ptr = cb::JEArenaMalloc::malloc(256);
+        benchmark::DoNotOptimize(ptr);
+        cb::JEArenaMalloc::free(ptr);
+    }
+    cb::JEArenaMalloc::switchToClient(previous);
+}
+
+/**
+ * Free of page aligned (so possibly sampled) allocations while the client
+ * has state.range(0) live samples. Sampling stays on, with an interval large
+ * enough that none of the allocations made here are sampled.
+ */
+static void PageAlignedFree(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        createLiveSamples(state.range(0));
+        cb::JEArenaHeapProfiler::setSampleInterval(size_t(1) << 40);
+    }
+    refreshSampleInterval();
+    auto previous = cb::JEArenaMalloc::switchToClient(
+            getClient(), cb::MemoryDomain::Primary, true);
+    const auto alignment = cb::JEArenaHeapProfiler::SampleAlignment;
+    while (state.KeepRunning()) {
+        auto* ptr = cb::JEArenaMalloc::aligned_alloc(alignment, alignment);
+        benchmark::DoNotOptimize(ptr);
+        cb::JEArenaMalloc::free(ptr);
+    }
+    cb::JEArenaMalloc::switchToClient(previous);
+}
+
+static void threads(benchmark::internal::Benchmark* b) {
+    b->Threads(1)->Threads(static_cast<int>(cb::get_cpu_count()));
+}
+
+BENCHMARK(MallocFree)->Arg(0)->Arg(512 * 1024)->Apply(threads);
+BENCHMARK(PageAlignedFree)->Arg(0)->Arg(1000)->Apply(threads);